@@ -0,0 +1,329 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint8_t, uint32_t, uint64_t, UINT32_MAX
+#include <stdio.h>  // for FILE, fopen, fread, fwrite, fclose
+#include <stdlib.h> // for calloc, malloc, realloc, free
+#include <string.h> // for memcmp, memcpy
+
+#include "archive.h"
+#include "gb.h"
+#include "hash.h"
+
+#define ARCHIVE_MAGIC ("GBSA")
+#define ARCHIVE_VERSION (1)
+
+#define CHUNK_SIZE (1 << 20) // Pages are allocated this many bytes at a time
+#define NO_PAGE (UINT32_MAX)
+
+struct archive {
+    size_t page_size;
+    size_t pages_per_state; // The last one is zero-padded
+    void *scratch;          // One state, padded to whole pages
+
+    // Page i is in chunks[i / pages_per_chunk]
+    uint8_t **chunks;
+    size_t num_chunks;
+    size_t pages_per_chunk;
+    uint64_t *page_hashes;
+    size_t num_pages;
+    size_t pages_capacity;
+
+    // Open addressing with linear probing; each slot holds a page ID
+    uint32_t *slots;
+    size_t num_slots;
+
+    // pages_per_state page IDs per snapshot
+    uint32_t *ids;
+    uint64_t num_snapshots;
+    uint64_t snapshots_capacity;
+};
+
+struct archive_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t state_size; // sizeof(struct gb), to catch layout changes
+    uint64_t page_size;
+    uint64_t num_pages;
+    uint64_t num_snapshots;
+};
+
+static uint8_t *page(struct archive const *const archive, uint32_t const id) {
+    return archive->chunks[id / archive->pages_per_chunk] +
+           (id % archive->pages_per_chunk) * archive->page_size;
+}
+
+static uint32_t *find_slot(struct archive const *const archive,
+                           uint8_t const *const data, uint64_t const hash) {
+    size_t s = hash & (archive->num_slots - 1);
+    while (archive->slots[s] != NO_PAGE) {
+        uint32_t const id = archive->slots[s];
+        if (archive->page_hashes[id] == hash &&
+            memcmp(page(archive, id), data, archive->page_size) == 0) {
+            break;
+        }
+        s = (s + 1) & (archive->num_slots - 1);
+    }
+    return &archive->slots[s];
+}
+
+static int grow_slots(struct archive *const archive) {
+    size_t const num_slots = archive->num_slots * 2;
+    uint32_t *const slots = malloc(num_slots * sizeof(*slots));
+    if (slots == NULL) {
+        return -1;
+    }
+    for (size_t s = 0; s < num_slots; s++) {
+        slots[s] = NO_PAGE;
+    }
+    for (size_t id = 0; id < archive->num_pages; id++) {
+        size_t s = archive->page_hashes[id] & (num_slots - 1);
+        while (slots[s] != NO_PAGE) {
+            s = (s + 1) & (num_slots - 1);
+        }
+        slots[s] = id;
+    }
+    free(archive->slots);
+    archive->slots = slots;
+    archive->num_slots = num_slots;
+    return 0;
+}
+
+// Makes room for one more page
+static int reserve_page(struct archive *const archive) {
+    if (archive->num_pages >= NO_PAGE - 1) {
+        return -1;
+    }
+    if (archive->num_pages == archive->pages_capacity) {
+        size_t const capacity = archive->pages_capacity * 2;
+        uint64_t *const hashes =
+            realloc(archive->page_hashes, capacity * sizeof(*hashes));
+        if (hashes == NULL) {
+            return -1;
+        }
+        archive->page_hashes = hashes;
+        archive->pages_capacity = capacity;
+    }
+    if (archive->num_pages ==
+        archive->num_chunks * archive->pages_per_chunk) {
+        uint8_t **const chunks = realloc(
+            archive->chunks, (archive->num_chunks + 1) * sizeof(*chunks));
+        if (chunks == NULL) {
+            return -1;
+        }
+        archive->chunks = chunks;
+        archive->chunks[archive->num_chunks] = malloc(CHUNK_SIZE);
+        if (archive->chunks[archive->num_chunks] == NULL) {
+            return -1;
+        }
+        archive->num_chunks++;
+    }
+    // Keep the table at most half full
+    if ((archive->num_pages + 1) * 2 > archive->num_slots) {
+        return grow_slots(archive);
+    }
+    return 0;
+}
+
+// The ID of the page holding data, which is added if it's new. Returns NO_PAGE
+// on allocation failure.
+static uint32_t intern_page(struct archive *const archive,
+                            uint8_t const *const data) {
+    uint64_t const hash = hash64(data, archive->page_size, 0);
+    uint32_t *slot = find_slot(archive, data, hash);
+    if (*slot != NO_PAGE) {
+        return *slot;
+    }
+    if (reserve_page(archive) != 0) {
+        return NO_PAGE;
+    }
+    slot = find_slot(archive, data, hash); // The table may have grown
+    uint32_t const id = archive->num_pages++;
+    memcpy(page(archive, id), data, archive->page_size);
+    archive->page_hashes[id] = hash;
+    *slot = id;
+    return id;
+}
+
+static int reserve_snapshot(struct archive *const archive) {
+    if (archive->num_snapshots < archive->snapshots_capacity) {
+        return 0;
+    }
+    uint64_t const capacity =
+        archive->snapshots_capacity == 0 ? 64 : archive->snapshots_capacity * 2;
+    uint32_t *const ids = realloc(
+        archive->ids, capacity * archive->pages_per_state * sizeof(*ids));
+    if (ids == NULL) {
+        return -1;
+    }
+    archive->ids = ids;
+    archive->snapshots_capacity = capacity;
+    return 0;
+}
+
+struct archive *archive_open(size_t const page_size) {
+    if (page_size < 64 || page_size > 65536 ||
+        (page_size & (page_size - 1)) != 0) {
+        return NULL;
+    }
+    struct archive *const archive = calloc(1, sizeof(*archive));
+    if (archive == NULL) {
+        return NULL;
+    }
+    archive->page_size = page_size;
+    archive->pages_per_state =
+        (sizeof(struct gb) + page_size - 1) / page_size;
+    archive->pages_per_chunk = CHUNK_SIZE / page_size;
+    archive->pages_capacity = 1024;
+    archive->num_slots = 2048;
+    // calloc, so the padding at the end of the last page stays zero
+    archive->scratch = calloc(archive->pages_per_state, page_size);
+    archive->page_hashes =
+        malloc(archive->pages_capacity * sizeof(*archive->page_hashes));
+    archive->slots = malloc(archive->num_slots * sizeof(*archive->slots));
+    if (archive->scratch == NULL || archive->page_hashes == NULL ||
+        archive->slots == NULL) {
+        archive_close(archive);
+        return NULL;
+    }
+    for (size_t s = 0; s < archive->num_slots; s++) {
+        archive->slots[s] = NO_PAGE;
+    }
+    return archive;
+}
+
+int archive_add(struct archive *const archive, struct gb const *const gb,
+                uint64_t *const id) {
+    if (reserve_snapshot(archive) != 0) {
+        return -1;
+    }
+    save_state(gb, archive->scratch);
+    uint8_t const *const pages = archive->scratch;
+    uint32_t *const ids =
+        archive->ids + archive->num_snapshots * archive->pages_per_state;
+    for (size_t p = 0; p < archive->pages_per_state; p++) {
+        ids[p] = intern_page(archive, pages + p * archive->page_size);
+        if (ids[p] == NO_PAGE) {
+            return -1;
+        }
+    }
+    *id = archive->num_snapshots++;
+    return 0;
+}
+
+int archive_restore(struct archive const *const archive, uint64_t const id,
+                    struct gb *const gb) {
+    if (id >= archive->num_snapshots) {
+        return -1;
+    }
+    // Rebuilt in a scratch machine, so that load_state() decides what to keep
+    // of gb's
+    struct gb scratch;
+    uint32_t const *const ids = archive->ids + id * archive->pages_per_state;
+    uint8_t *const out = (uint8_t *)&scratch;
+    for (size_t p = 0; p < archive->pages_per_state; p++) {
+        size_t const offset = p * archive->page_size;
+        size_t const left = sizeof(scratch) - offset;
+        memcpy(out + offset, page(archive, ids[p]),
+               left < archive->page_size ? left : archive->page_size);
+    }
+    load_state(gb, &scratch);
+    return 0;
+}
+
+void archive_get_stats(struct archive const *const archive,
+                       struct archive_stats *const out) {
+    out->snapshots = archive->num_snapshots;
+    out->unique_pages = archive->num_pages;
+    out->raw_bytes = archive->num_snapshots * sizeof(struct gb);
+    out->stored_bytes =
+        archive->num_pages * archive->page_size +
+        archive->num_snapshots * archive->pages_per_state * sizeof(uint32_t);
+}
+
+int archive_write(struct archive const *const archive,
+                  char const *const path) {
+    FILE *const f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    struct archive_header header = {
+        .version = ARCHIVE_VERSION,
+        .state_size = sizeof(struct gb),
+        .page_size = archive->page_size,
+        .num_pages = archive->num_pages,
+        .num_snapshots = archive->num_snapshots,
+    };
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+    uint1_t ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t id = 0; ok && id < archive->num_pages; id++) {
+        ok = fwrite(page(archive, id), archive->page_size, 1, f) == 1;
+    }
+    size_t const num_ids = archive->num_snapshots * archive->pages_per_state;
+    ok = ok && fwrite(archive->ids, sizeof(*archive->ids), num_ids, f) ==
+                   num_ids;
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+// Fills a new archive from an open file
+static uint1_t read_contents(struct archive *const archive, FILE *const f,
+                             struct archive_header const *const header) {
+    for (uint64_t i = 0; i < header->num_pages; i++) {
+        if (fread(archive->scratch, archive->page_size, 1, f) != 1 ||
+            intern_page(archive, archive->scratch) != i) {
+            return 0; // Short, duplicate or out of memory
+        }
+    }
+    for (uint64_t i = 0; i < header->num_snapshots; i++) {
+        if (reserve_snapshot(archive) != 0) {
+            return 0;
+        }
+        uint32_t *const ids =
+            archive->ids + archive->num_snapshots * archive->pages_per_state;
+        if (fread(ids, sizeof(*ids), archive->pages_per_state, f) !=
+            archive->pages_per_state) {
+            return 0;
+        }
+        for (size_t p = 0; p < archive->pages_per_state; p++) {
+            if (ids[p] >= archive->num_pages) {
+                return 0;
+            }
+        }
+        archive->num_snapshots++;
+    }
+    return 1;
+}
+
+struct archive *archive_read(char const *const path) {
+    FILE *const f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    struct archive_header header;
+    struct archive *archive = NULL;
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == ARCHIVE_VERSION &&
+        header.state_size == sizeof(struct gb)) {
+        archive = archive_open(header.page_size);
+    }
+    if (archive != NULL && !read_contents(archive, f, &header)) {
+        archive_close(archive);
+        archive = NULL;
+    }
+    fclose(f);
+    return archive;
+}
+
+void archive_close(struct archive *const archive) {
+    if (archive == NULL) {
+        return;
+    }
+    for (size_t c = 0; c < archive->num_chunks; c++) {
+        free(archive->chunks[c]);
+    }
+    free(archive->chunks);
+    free(archive->page_hashes);
+    free(archive->slots);
+    free(archive->ids);
+    free(archive->scratch);
+    free(archive);
+}
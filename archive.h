@@ -0,0 +1,42 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include "gb.h"
+
+// A snapshot archive for large numbers of save states that mostly share their
+// memory, e.g., exploration archives. Each state is split into fixed-size
+// pages, and each distinct page is stored once, found by its hash; a snapshot
+// is just its list of page IDs. Pages are compared in full, not just by hash,
+// so restores are always exact.
+
+struct archive_stats {
+    uint64_t snapshots;
+    uint64_t unique_pages;
+    uint64_t raw_bytes;    // What the snapshots would take as save states
+    uint64_t stored_bytes; // Pages plus page ID lists
+};
+
+// page_size must be a power of two from 64 to 65536; 256 or 1024 work well.
+// Returns NULL if it isn't, or on allocation failure.
+struct archive *archive_open(size_t page_size);
+
+// Adds a save state of gb (see save_state()) and sets *id to its snapshot ID,
+// counting up from 0. Returns 0 on success, or -1 on allocation failure.
+int archive_add(struct archive *archive, struct gb const *gb, uint64_t *id);
+
+// Loads snapshot id into gb, keeping gb's host-side attachments as
+// load_state() does. Returns 0 on success, or -1 if there's no such snapshot.
+int archive_restore(struct archive const *archive, uint64_t id, struct gb *gb);
+
+void archive_get_stats(struct archive const *archive,
+                       struct archive_stats *out);
+
+// Archive files, like save state files, only load into builds with the same
+// struct gb layout. archive_write() returns 0 on success, or -1 on failure;
+// archive_read() returns NULL on failure.
+int archive_write(struct archive const *archive, char const *path);
+
+struct archive *archive_read(char const *path);
+
+void archive_close(struct archive *archive);
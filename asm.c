@@ -0,0 +1,958 @@
+#define _GNU_SOURCE   // for getopt(3)
+#include <ctype.h>    // for isalnum, isalpha, isdigit, isspace, toupper
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for int*_t, uint*_t
+#include <stdio.h>    // for fprintf, snprintf, fopen, fread, fwrite, FILE
+#include <stdlib.h>   // for EXIT_*, free, malloc, realloc, strtol
+#include <string.h>   // for mem*, str*
+#include <strings.h>  // for strcasecmp, strncasecmp
+#include <unistd.h>   // for getopt
+
+#include "disasm.h"
+
+// A small two-pass SM83 assembler. It accepts every instruction step()
+// understands, spelled the way step() prints them, plus the usual shorthands:
+// LDI/LDD, (HL+)/(HL-), [ ] for ( ), "SUB B" for "SUB A, B", "LD HL, SP+e",
+// and "RST 0x38". Unlike step()'s output, JR takes a target address rather
+// than a distance, and the (0xFFnn) forms of LD must be written LDH, since
+// "LD A, (0xFF44)" could also mean the 3-byte LD A, (nn).
+//
+// Syntax:
+//   label:               Global label
+//   .label:              Local label, scoped to the last global label
+//   NAME EQU expr        Constant (also NAME = expr)
+//   ORG expr             Set the output address
+//   DB expr, "str", ...  Bytes
+//   DW expr, ...         Little-endian words
+//   DS count[, fill]     Reserve count bytes
+//   TITLE "str"          Cartridge title
+//   ; comment
+// Numbers may be decimal, 0x/$ hex, 0b/% binary, or 'c'. @ is the address of
+// the current statement. Expressions support + - * / % & | ^ << >> ~ and ( ).
+//
+// The output is a 32 KiB ROM-only cartridge with the Nintendo logo (unless the
+// source provides its own), title, and both checksums filled in.
+
+#define ROM_SIZE (0x8000)
+#define MAX_SYMBOLS (4096)
+#define MAX_NAME (64)
+#define MAX_OPERANDS (2)
+#define MAX_PATTERNS (512)
+
+static uint8_t const NINTENDO_LOGO[48] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83,
+    0x00, 0x0C, 0x00, 0x0D, 0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+    0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99, 0xBB, 0xBB, 0x67, 0x63,
+    0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E,
+};
+
+#define LOGO_OFFSET (0x104)
+#define TITLE_OFFSET (0x134)
+#define TITLE_LENGTH (16)
+#define HEADER_CHECKSUM_OFFSET (0x14D)
+#define GLOBAL_CHECKSUM_OFFSET (0x14E)
+
+// An instruction form, e.g. "LD A, (#)" where # is an expression.
+struct pattern {
+    char mnemonic[8];
+    char operands[MAX_OPERANDS][16];
+    size_t num_operands;
+    uint8_t is_cb;
+    uint8_t opcode;
+    enum operand operand;
+    uint8_t length;
+};
+
+struct symbol {
+    char name[MAX_NAME];
+    int32_t value;
+};
+
+struct assembler {
+    char const *path;
+    size_t line_number;
+    int pass;
+    uint16_t pc;
+    uint16_t statement_pc; // The value of @
+    uint8_t rom[ROM_SIZE];
+    uint8_t written[ROM_SIZE];
+    char title[TITLE_LENGTH + 1];
+    char scope[MAX_NAME]; // The last global label, for local labels
+    struct symbol symbols[MAX_SYMBOLS];
+    size_t num_symbols;
+    size_t num_errors;
+};
+
+static struct pattern patterns[MAX_PATTERNS];
+static size_t num_patterns;
+
+static void error(struct assembler *const as, char const *const message,
+                  char const *const detail) {
+    fprintf(stderr, "%s:%zu: error: %s%s%s\n", as->path, as->line_number,
+            message, detail == NULL ? "" : ": ", detail == NULL ? "" : detail);
+    as->num_errors++;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1])) {
+        s[--len] = '\0';
+    }
+    return s;
+}
+
+// Copies at most len bytes of src, truncating to fit.
+static void copy_string(char *const dst, size_t const dst_size,
+                        char const *const src, size_t len) {
+    if (len >= dst_size) {
+        len = dst_size - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+// Uppercases s, drops whitespace, and turns [ ] into ( ), for comparing
+// operands against patterns.
+static void normalize(char const *s, char *const out, size_t const out_size) {
+    size_t n = 0;
+    for (; *s != '\0' && n + 1 < out_size; s++) {
+        if (isspace((unsigned char)*s)) {
+            continue;
+        }
+        out[n++] = *s == '['   ? '('
+                   : *s == ']' ? ')'
+                               : toupper((unsigned char)*s);
+    }
+    out[n] = '\0';
+}
+
+static void add_pattern(char const *const text, uint8_t const is_cb,
+                        uint8_t const opcode, enum operand const operand,
+                        uint8_t const length) {
+    struct pattern *const p = &patterns[num_patterns++];
+    memset(p, 0, sizeof(*p));
+    p->is_cb = is_cb;
+    p->opcode = opcode;
+    p->operand = operand;
+    p->length = length;
+
+    char buf[64];
+    copy_string(buf, sizeof(buf), text, strlen(text));
+    char *const space = strchr(buf, ' ');
+    if (space != NULL) {
+        *space = '\0';
+    }
+    copy_string(p->mnemonic, sizeof(p->mnemonic), buf, strlen(buf));
+    if (space == NULL) {
+        return;
+    }
+    char *operands = space + 1;
+    while (operands != NULL && p->num_operands < MAX_OPERANDS) {
+        char *const comma = strchr(operands, ',');
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+        normalize(operands, p->operands[p->num_operands++],
+                  sizeof(p->operands[0]));
+        operands = comma == NULL ? NULL : comma + 1;
+    }
+}
+
+// Replaces the first occurrence of from in s with to.
+static void replace(char *const s, char const *const from,
+                    char const *const to) {
+    char *const at = strstr(s, from);
+    if (at != NULL) {
+        memmove(at + strlen(to), at + strlen(from),
+                strlen(at + strlen(from)) + 1);
+        memcpy(at, to, strlen(to));
+    }
+}
+
+// Builds the patterns from the disassembler's opcode table, so that the two
+// always agree on what step() can execute.
+static void build_patterns(void) {
+    for (int opcode = 0; opcode < 0x100; opcode++) {
+        struct opcode_info const *const info = &OPCODE_INFO[opcode];
+        if (info->prefix == NULL || info->operand == OPERAND_CB) {
+            continue;
+        }
+        char text[64];
+        snprintf(text, sizeof(text), "%s%s%s", info->prefix,
+                 info->operand == OPERAND_NONE ? "" : "#", info->suffix);
+        switch (info->operand) {
+        case OPERAND_HEX8: // LD A, (0xFF#) is written LDH A, (#)
+            replace(text, "(0xFF#)", "(#)");
+            replace(text, "LD ", "LDH ");
+            break;
+        case OPERAND_HEX16:
+        case OPERAND_HEX16_SHORT:
+            replace(text, "0x#", "#");
+            break;
+        case OPERAND_NONE:
+        case OPERAND_U8:
+        case OPERAND_S8:
+        case OPERAND_REL8:
+        case OPERAND_CB:
+        default:
+            break;
+        }
+        add_pattern(text, 0, opcode, info->operand, info->length);
+    }
+    for (int cb_opcode = 0; cb_opcode < 0x100; cb_opcode++) {
+        uint8_t const bytes[3] = {0xCB, cb_opcode, 0};
+        char text[64];
+        disassemble(bytes, text, sizeof(text));
+        add_pattern(text, 1, cb_opcode, OPERAND_NONE, 2);
+    }
+}
+
+static struct symbol *find_symbol(struct assembler *const as,
+                                  char const *const name) {
+    for (size_t i = 0; i < as->num_symbols; i++) {
+        if (strcmp(as->symbols[i].name, name) == 0) {
+            return &as->symbols[i];
+        }
+    }
+    return NULL;
+}
+
+// Expands a local label (.name) into its full name (scope.name).
+static void full_name(struct assembler const *const as, char const *const name,
+                      char *const out, size_t const out_size) {
+    size_t const scope_len = name[0] == '.' ? strlen(as->scope) : 0;
+    copy_string(out, out_size, as->scope, scope_len);
+    copy_string(out + strlen(out), out_size - strlen(out), name, strlen(name));
+}
+
+static void define_symbol(struct assembler *const as, char const *const name,
+                          int32_t const value) {
+    char full[MAX_NAME];
+    full_name(as, name, full, sizeof(full));
+    struct symbol *sym = find_symbol(as, full);
+    if (sym != NULL) {
+        if (as->pass == 1) {
+            error(as, "symbol defined twice", full);
+        }
+        sym->value = value;
+        return;
+    }
+    if (as->num_symbols == MAX_SYMBOLS) {
+        error(as, "too many symbols", NULL);
+        return;
+    }
+    sym = &as->symbols[as->num_symbols++];
+    copy_string(sym->name, sizeof(sym->name), full, strlen(full));
+    sym->value = value;
+}
+
+// Expression parsing, by recursive descent. Each level advances *s.
+struct expr {
+    struct assembler *as;
+    char const *s;
+    uint8_t undefined; // Refers to a symbol that isn't defined (yet)
+    uint8_t bad;
+};
+
+static int32_t parse_or(struct expr *e);
+
+static void skip_space(struct expr *const e) {
+    while (isspace((unsigned char)*e->s)) {
+        e->s++;
+    }
+}
+
+static int32_t parse_number(struct expr *const e, int const base) {
+    char *end;
+    long const value = strtol(e->s, &end, base);
+    if (end == e->s) {
+        e->bad = 1;
+    }
+    e->s = end;
+    return value;
+}
+
+static int32_t parse_primary(struct expr *const e) {
+    skip_space(e);
+    char const c = *e->s;
+    if (c == '(') {
+        e->s++;
+        int32_t const value = parse_or(e);
+        skip_space(e);
+        if (*e->s != ')') {
+            e->bad = 1;
+            return 0;
+        }
+        e->s++;
+        return value;
+    } else if (c == '-') {
+        e->s++;
+        return -parse_primary(e);
+    } else if (c == '+') {
+        e->s++;
+        return parse_primary(e);
+    } else if (c == '~') {
+        e->s++;
+        return ~parse_primary(e);
+    } else if (c == '@') {
+        e->s++;
+        return e->as->statement_pc;
+    } else if (c == '$') {
+        e->s++;
+        return parse_number(e, 16);
+    } else if (c == '%') {
+        e->s++;
+        return parse_number(e, 2);
+    } else if (c == '\'' && e->s[1] != '\0' && e->s[2] == '\'') {
+        int32_t const value = (unsigned char)e->s[1];
+        e->s += 3;
+        return value;
+    } else if (c == '0' && (e->s[1] == 'x' || e->s[1] == 'X')) {
+        e->s += 2;
+        return parse_number(e, 16);
+    } else if (c == '0' && (e->s[1] == 'b' || e->s[1] == 'B')) {
+        e->s += 2;
+        return parse_number(e, 2);
+    } else if (isdigit((unsigned char)c)) {
+        return parse_number(e, 10);
+    } else if (isalpha((unsigned char)c) || c == '_' || c == '.') {
+        char name[MAX_NAME];
+        size_t n = 0;
+        while ((isalnum((unsigned char)*e->s) || *e->s == '_' ||
+                *e->s == '.') &&
+               n + 1 < sizeof(name)) {
+            name[n++] = *e->s++;
+        }
+        name[n] = '\0';
+        char full[MAX_NAME];
+        full_name(e->as, name, full, sizeof(full));
+        struct symbol const *const sym = find_symbol(e->as, full);
+        if (sym == NULL) {
+            e->undefined = 1;
+            return 0;
+        }
+        return sym->value;
+    }
+    e->bad = 1;
+    return 0;
+}
+
+static int32_t parse_mul(struct expr *const e) {
+    int32_t value = parse_primary(e);
+    while (1) {
+        skip_space(e);
+        char const op = *e->s;
+        if (op != '*' && op != '/' && op != '%') {
+            return value;
+        }
+        e->s++;
+        int32_t const rhs = parse_primary(e);
+        if (op == '*') {
+            value *= rhs;
+        } else if (rhs == 0) {
+            e->bad = !e->undefined;
+            value = 0;
+        } else if (op == '/') {
+            value /= rhs;
+        } else {
+            value %= rhs;
+        }
+    }
+}
+
+static int32_t parse_add(struct expr *const e) {
+    int32_t value = parse_mul(e);
+    while (1) {
+        skip_space(e);
+        char const op = *e->s;
+        if (op != '+' && op != '-') {
+            return value;
+        }
+        e->s++;
+        int32_t const rhs = parse_mul(e);
+        value = op == '+' ? value + rhs : value - rhs;
+    }
+}
+
+static int32_t parse_shift(struct expr *const e) {
+    int32_t value = parse_add(e);
+    while (1) {
+        skip_space(e);
+        if (strncmp(e->s, "<<", 2) == 0) {
+            e->s += 2;
+            value = (uint32_t)value << parse_add(e);
+        } else if (strncmp(e->s, ">>", 2) == 0) {
+            e->s += 2;
+            value >>= parse_add(e);
+        } else {
+            return value;
+        }
+    }
+}
+
+static int32_t parse_and(struct expr *const e) {
+    int32_t value = parse_shift(e);
+    while (1) {
+        skip_space(e);
+        if (*e->s != '&') {
+            return value;
+        }
+        e->s++;
+        value &= parse_shift(e);
+    }
+}
+
+static int32_t parse_xor(struct expr *const e) {
+    int32_t value = parse_and(e);
+    while (1) {
+        skip_space(e);
+        if (*e->s != '^') {
+            return value;
+        }
+        e->s++;
+        value ^= parse_and(e);
+    }
+}
+
+static int32_t parse_or(struct expr *const e) {
+    int32_t value = parse_xor(e);
+    while (1) {
+        skip_space(e);
+        if (*e->s != '|') {
+            return value;
+        }
+        e->s++;
+        value |= parse_xor(e);
+    }
+}
+
+// Evaluates text. In pass 1, undefined symbols evaluate to 0, since they may
+// be labels defined further down. In pass 2, they are errors.
+static int32_t evaluate(struct assembler *const as, char const *const text) {
+    struct expr e = {.as = as, .s = text};
+    int32_t const value = parse_or(&e);
+    skip_space(&e);
+    if (e.bad || *e.s != '\0') {
+        error(as, "bad expression", text);
+    } else if (e.undefined && as->pass == 2) {
+        error(as, "undefined symbol in", text);
+    }
+    return value;
+}
+
+// Like evaluate(), but the value must be known in pass 1 (for ORG, DS, EQU).
+static int32_t evaluate_now(struct assembler *const as,
+                            char const *const text) {
+    struct expr e = {.as = as, .s = text};
+    int32_t const value = parse_or(&e);
+    skip_space(&e);
+    if (e.bad || *e.s != '\0') {
+        error(as, "bad expression", text);
+    } else if (e.undefined) {
+        error(as, "expression must not refer to later symbols", text);
+    }
+    return value;
+}
+
+static void emit8(struct assembler *const as, uint8_t const val) {
+    if (as->pass == 2) {
+        if (as->pc >= ROM_SIZE) {
+            error(as, "output past the end of the ROM", NULL);
+        } else {
+            as->rom[as->pc] = val;
+            as->written[as->pc] = 1;
+        }
+    }
+    as->pc++;
+}
+
+static void emit_byte_value(struct assembler *const as, int32_t const value,
+                            char const *const text) {
+    if (as->pass == 2 && (value < -128 || value > 0xFF)) {
+        error(as, "value does not fit in a byte", text);
+    }
+    emit8(as, value);
+}
+
+static void emit_word_value(struct assembler *const as, int32_t const value,
+                            char const *const text) {
+    if (as->pass == 2 && (value < -32768 || value > 0xFFFF)) {
+        error(as, "value does not fit in a word", text);
+    }
+    emit8(as, value);
+    emit8(as, value >> 8);
+}
+
+// Splits text on commas outside of quotes. Returns the number of pieces.
+static size_t split_operands(char *const text, char **const out,
+                             size_t const max) {
+    size_t n = 0;
+    uint8_t in_string = 0;
+    char *start = text;
+    for (char *p = text;; p++) {
+        if (*p == '"') {
+            in_string = !in_string;
+        } else if ((*p == ',' && !in_string) || *p == '\0') {
+            uint8_t const done = *p == '\0';
+            *p = '\0';
+            if (n < max) {
+                out[n++] = trim(start);
+            }
+            start = p + 1;
+            if (done) {
+                break;
+            }
+        }
+    }
+    if (n == 1 && out[0][0] == '\0') {
+        return 0;
+    }
+    return n;
+}
+
+static uint8_t is_reserved_operand(char const *const normalized) {
+    static char const *const RESERVED[] = {
+        "A",  "B",  "C",  "D",  "E",  "H",  "L", "AF",
+        "BC", "DE", "HL", "SP", "NZ", "Z",  "NC",
+    };
+    for (size_t i = 0; i < sizeof(RESERVED) / sizeof(RESERVED[0]); i++) {
+        if (strcmp(normalized, RESERVED[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Matches operand against one pattern operand. If the pattern takes an
+// expression, its text is copied into expr.
+static uint8_t match_operand(char const *const pattern,
+                             char const *const operand, char *const expr,
+                             size_t const expr_size) {
+    char normalized[64];
+    normalize(operand, normalized, sizeof(normalized));
+    size_t const len = strlen(operand);
+    if (strcmp(pattern, "#") == 0) {
+        if (normalized[0] == '(' || is_reserved_operand(normalized)) {
+            return 0;
+        }
+        copy_string(expr, expr_size, operand, len);
+        return 1;
+    } else if (strcmp(pattern, "(#)") == 0) {
+        if (len < 2 || normalized[0] != '(' ||
+            normalized[strlen(normalized) - 1] != ')') {
+            return 0;
+        }
+        normalized[strlen(normalized) - 1] = '\0';
+        if (is_reserved_operand(normalized + 1) ||
+            strcmp(normalized + 1, "HLI") == 0 ||
+            strcmp(normalized + 1, "HLD") == 0) {
+            return 0;
+        }
+        copy_string(expr, expr_size, operand + 1, len - 2);
+        return 1;
+    }
+    return strcmp(pattern, normalized) == 0;
+}
+
+// Rewrites the common alternative spellings into the ones step() uses.
+static void canonicalize(char *const mnemonic, char const **const operands,
+                         size_t *const num_operands) {
+    char first[64] = "";
+    char second[64] = "";
+    if (*num_operands > 0) {
+        normalize(operands[0], first, sizeof(first));
+    }
+    if (*num_operands > 1) {
+        normalize(operands[1], second, sizeof(second));
+    }
+
+    if (strcasecmp(mnemonic, "LDI") == 0 || strcasecmp(mnemonic, "LDD") == 0) {
+        char const *const hl =
+            toupper((unsigned char)mnemonic[2]) == 'I' ? "(HLI)" : "(HLD)";
+        strcpy(mnemonic, "LD");
+        if (strcmp(first, "(HL)") == 0) {
+            operands[0] = hl;
+        } else if (strcmp(second, "(HL)") == 0) {
+            operands[1] = hl;
+        }
+    }
+    for (size_t i = 0; i < *num_operands; i++) {
+        char normalized[64];
+        normalize(operands[i], normalized, sizeof(normalized));
+        if (strcmp(normalized, "(HL+)") == 0) {
+            operands[i] = "(HLI)";
+        } else if (strcmp(normalized, "(HL-)") == 0) {
+            operands[i] = "(HLD)";
+        } else if (strcmp(normalized, "(0XFF00+C)") == 0 ||
+                   strcmp(normalized, "($FF00+C)") == 0) {
+            operands[i] = "(C)";
+        }
+    }
+    if (strcasecmp(mnemonic, "LDH") == 0 &&
+        (strcmp(first, "(C)") == 0 || strcmp(second, "(C)") == 0)) {
+        strcpy(mnemonic, "LD");
+    }
+    if (strcasecmp(mnemonic, "JP") == 0 && *num_operands == 1 &&
+        strcmp(first, "HL") == 0) {
+        operands[0] = "(HL)";
+    }
+    if (strcasecmp(mnemonic, "LD") == 0 && *num_operands == 2 &&
+        strcmp(first, "HL") == 0 && strncmp(second, "SP", 2) == 0 &&
+        (second[2] == '+' || second[2] == '-')) {
+        // LD HL, SP+e is LDHL SP, e. The operand was trimmed, so it starts
+        // with SP.
+        char const *offset = operands[1] + 2;
+        while (isspace((unsigned char)*offset)) {
+            offset++;
+        }
+        strcpy(mnemonic, "LDHL");
+        operands[0] = "SP";
+        operands[1] = *offset == '+' ? offset + 1 : offset;
+    }
+    static char const *const ALU[] = {"ADD", "ADC", "SUB", "SBC",
+                                      "AND", "XOR", "OR",  "CP"};
+    for (size_t i = 0; i < sizeof(ALU) / sizeof(ALU[0]); i++) {
+        if (strcasecmp(mnemonic, ALU[i]) == 0 && *num_operands == 1) {
+            operands[1] = operands[0];
+            operands[0] = "A";
+            *num_operands = 2;
+            break;
+        }
+    }
+}
+
+static void assemble_rst(struct assembler *const as, char const *const text) {
+    int32_t const n = evaluate(as, text);
+    if (n % 8 == 0 && 0 <= n && n <= 0x38) {
+        emit8(as, 0xC7 | n);
+    } else if (0 <= n && n < 8) { // step() spells RST 0x38 as RST 7
+        emit8(as, 0xC7 | (n << 3));
+    } else {
+        error(as, "bad RST vector", text);
+        emit8(as, 0);
+    }
+}
+
+static void emit_operand(struct assembler *const as,
+                         struct pattern const *const p, uint16_t const start,
+                         char *const expr) {
+    int32_t const value = expr[0] == '\0' ? 0 : evaluate(as, trim(expr));
+    switch (p->operand) {
+    case OPERAND_U8:
+    case OPERAND_S8:
+        emit_byte_value(as, value, expr);
+        break;
+    case OPERAND_HEX8: // LDH takes either 0xFFnn or nn
+        if (as->pass == 2 && !(0 <= value && value <= 0xFF) &&
+            !(0xFF00 <= value && value <= 0xFFFF)) {
+            error(as, "LDH address out of range", expr);
+        }
+        emit8(as, value);
+        break;
+    case OPERAND_HEX16:
+    case OPERAND_HEX16_SHORT:
+        emit_word_value(as, value, expr);
+        break;
+    case OPERAND_REL8: {
+        int32_t const offset = value - (start + 2);
+        if (as->pass == 2 && (offset < -128 || offset > 127)) {
+            error(as, "jump target out of range", expr);
+        }
+        emit8(as, offset);
+        break;
+    }
+    case OPERAND_NONE:
+        while (as->pc - start < p->length) { // STOP's padding byte
+            emit8(as, 0);
+        }
+        break;
+    case OPERAND_CB:
+    default:
+        break;
+    }
+}
+
+static void assemble_instruction(struct assembler *const as,
+                                 char *const mnemonic, char *const args) {
+    char *pieces[MAX_OPERANDS + 1];
+    size_t num_operands = split_operands(args, pieces, MAX_OPERANDS + 1);
+    if (num_operands > MAX_OPERANDS) {
+        error(as, "too many operands", mnemonic);
+        return;
+    }
+    char const *operands[MAX_OPERANDS] = {NULL};
+    for (size_t i = 0; i < num_operands; i++) {
+        operands[i] = pieces[i];
+    }
+    canonicalize(mnemonic, operands, &num_operands);
+
+    if (strcasecmp(mnemonic, "RST") == 0 && num_operands == 1) {
+        assemble_rst(as, operands[0]);
+        return;
+    }
+    if (strcasecmp(mnemonic, "STOP") == 0 && num_operands == 1) {
+        num_operands = 0; // The operand byte is always 0 anyway
+    }
+
+    // Patterns made only of registers win over ones taking an expression, so
+    // that "LD A, (HL)" isn't read as "LD A, (#)" with a symbol named HL.
+    for (int with_expr = 0; with_expr <= 1; with_expr++) {
+        for (size_t i = 0; i < num_patterns; i++) {
+            struct pattern const *const p = &patterns[i];
+            if ((p->operand != OPERAND_NONE) != with_expr ||
+                p->num_operands != num_operands ||
+                strcasecmp(p->mnemonic, mnemonic) != 0) {
+                continue;
+            }
+            char expr[256] = "";
+            uint8_t matched = 1;
+            for (size_t j = 0; j < num_operands && matched; j++) {
+                matched = match_operand(p->operands[j], operands[j], expr,
+                                        sizeof(expr));
+            }
+            if (!matched) {
+                continue;
+            }
+
+            uint16_t const start = as->pc;
+            if (p->is_cb) {
+                emit8(as, 0xCB);
+            }
+            emit8(as, p->opcode);
+            emit_operand(as, p, start, expr);
+            return;
+        }
+    }
+    error(as, "no such instruction", mnemonic);
+}
+
+static void assemble_data(struct assembler *const as, char *const args,
+                          uint8_t const words) {
+    char *items[256];
+    size_t const n = split_operands(args, items, 256);
+    for (size_t i = 0; i < n; i++) {
+        size_t const len = strlen(items[i]);
+        if (!words && len >= 2 && items[i][0] == '"' &&
+            items[i][len - 1] == '"') {
+            for (size_t j = 1; j + 1 < len; j++) {
+                emit8(as, items[i][j]);
+            }
+        } else if (words) {
+            emit_word_value(as, evaluate(as, items[i]), items[i]);
+        } else {
+            emit_byte_value(as, evaluate(as, items[i]), items[i]);
+        }
+    }
+}
+
+static void assemble_line(struct assembler *const as, char *line) {
+    // Strip the comment
+    uint8_t in_string = 0;
+    for (char *p = line; *p != '\0'; p++) {
+        if (*p == '"') {
+            in_string = !in_string;
+        } else if (*p == ';' && !in_string) {
+            *p = '\0';
+            break;
+        }
+    }
+    line = trim(line);
+
+    // Labels
+    char *const colon = strchr(line, ':');
+    if (colon != NULL && strchr(line, '"') == NULL) {
+        *colon = '\0';
+        char *const label = trim(line);
+        if (label[0] != '.') {
+            snprintf(as->scope, sizeof(as->scope), "%s", label);
+        }
+        define_symbol(as, label, as->pc);
+        line = trim(colon + (colon[1] == ':' ? 2 : 1));
+    }
+    if (line[0] == '\0') {
+        return;
+    }
+    as->statement_pc = as->pc;
+
+    char *mnemonic = line;
+    char *args = line;
+    while (*args != '\0' && !isspace((unsigned char)*args)) {
+        args++;
+    }
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+    args = trim(args);
+
+    // NAME EQU expr, or NAME = expr
+    if (strncasecmp(args, "EQU", 3) == 0 && isspace((unsigned char)args[3])) {
+        define_symbol(as, mnemonic, evaluate_now(as, trim(args + 3)));
+        return;
+    } else if (args[0] == '=') {
+        define_symbol(as, mnemonic, evaluate_now(as, trim(args + 1)));
+        return;
+    }
+
+    if (strcasecmp(mnemonic, "ORG") == 0) {
+        as->pc = evaluate_now(as, args);
+    } else if (strcasecmp(mnemonic, "DB") == 0) {
+        assemble_data(as, args, 0);
+    } else if (strcasecmp(mnemonic, "DW") == 0) {
+        assemble_data(as, args, 1);
+    } else if (strcasecmp(mnemonic, "DS") == 0) {
+        char *items[2];
+        size_t const n = split_operands(args, items, 2);
+        int32_t const count = n > 0 ? evaluate_now(as, items[0]) : 0;
+        int32_t const fill = n > 1 ? evaluate(as, items[1]) : 0;
+        for (int32_t i = 0; i < count; i++) {
+            emit8(as, fill);
+        }
+    } else if (strcasecmp(mnemonic, "TITLE") == 0) {
+        size_t const len = strlen(args);
+        if (len < 2 || args[0] != '"' || args[len - 1] != '"') {
+            error(as, "TITLE needs a string", args);
+        } else {
+            args[len - 1] = '\0';
+            snprintf(as->title, sizeof(as->title), "%s", args + 1);
+        }
+    } else {
+        assemble_instruction(as, mnemonic, args);
+    }
+}
+
+static void assemble(struct assembler *const as, char const *const source) {
+    for (as->pass = 1; as->pass <= 2; as->pass++) {
+        as->pc = 0;
+        as->line_number = 0;
+        as->scope[0] = '\0';
+        char const *p = source;
+        while (*p != '\0') {
+            char const *const end = strchr(p, '\n');
+            size_t const len = end == NULL ? strlen(p) : (size_t)(end - p);
+            char line[1024];
+            as->line_number++;
+            if (len >= sizeof(line)) {
+                error(as, "line too long", NULL);
+            } else {
+                memcpy(line, p, len);
+                line[len] = '\0';
+                assemble_line(as, line);
+            }
+            p += len + (end == NULL ? 0 : 1);
+        }
+        if (as->num_errors > 0) {
+            return;
+        }
+    }
+}
+
+static void fix_header(struct assembler *const as) {
+    uint8_t has_logo = 0;
+    for (size_t i = 0; i < sizeof(NINTENDO_LOGO); i++) {
+        has_logo |= as->written[LOGO_OFFSET + i];
+    }
+    if (!has_logo) {
+        memcpy(as->rom + LOGO_OFFSET, NINTENDO_LOGO, sizeof(NINTENDO_LOGO));
+    }
+    if (as->title[0] != '\0') {
+        memset(as->rom + TITLE_OFFSET, 0, TITLE_LENGTH);
+        memcpy(as->rom + TITLE_OFFSET, as->title, strlen(as->title));
+    }
+
+    uint8_t header_checksum = 0;
+    for (size_t i = TITLE_OFFSET; i < HEADER_CHECKSUM_OFFSET; i++) {
+        header_checksum = header_checksum - as->rom[i] - 1;
+    }
+    as->rom[HEADER_CHECKSUM_OFFSET] = header_checksum;
+
+    uint16_t global_checksum = 0;
+    for (size_t i = 0; i < ROM_SIZE; i++) {
+        if (i != GLOBAL_CHECKSUM_OFFSET && i != GLOBAL_CHECKSUM_OFFSET + 1) {
+            global_checksum += as->rom[i];
+        }
+    }
+    as->rom[GLOBAL_CHECKSUM_OFFSET] = global_checksum >> 8; // Big-endian
+    as->rom[GLOBAL_CHECKSUM_OFFSET + 1] = global_checksum;
+}
+
+static char *read_file(char const *const path) {
+    FILE *const f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    size_t size = 0;
+    size_t capacity = 4096;
+    char *buf = malloc(capacity);
+    while (buf != NULL) {
+        size += fread(buf + size, 1, capacity - size - 1, f);
+        if (size + 1 < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char *const bigger = realloc(buf, capacity);
+        if (bigger == NULL) {
+            free(buf);
+        }
+        buf = bigger;
+    }
+    fclose(f);
+    if (buf != NULL) {
+        buf[size] = '\0';
+    }
+    return buf;
+}
+
+int main(int argc, char *const *const argv) {
+    char const *out_path = NULL;
+    char const *title = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:t:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 't':
+            title = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-o out.gb] [-t title] <source.asm>\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || out_path == NULL) {
+        fprintf(stderr, "Usage: %s -o out.gb [-t title] <source.asm>\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *const source = read_file(argv[optind]);
+    if (source == NULL) {
+        fprintf(stderr, "Couldn't read %s!\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    build_patterns();
+    static struct assembler as;
+    as.path = argv[optind];
+    if (title != NULL) {
+        snprintf(as.title, sizeof(as.title), "%s", title);
+    }
+    assemble(&as, source);
+    free(source);
+    if (as.num_errors > 0) {
+        return EXIT_FAILURE;
+    }
+    fix_header(&as);
+
+    FILE *const f = fopen(out_path, "wb");
+    if (f == NULL || fwrite(as.rom, 1, ROM_SIZE, f) != ROM_SIZE) {
+        fprintf(stderr, "Couldn't write %s!\n", out_path);
+        return EXIT_FAILURE;
+    }
+    fclose(f);
+    return EXIT_SUCCESS;
+}
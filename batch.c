@@ -0,0 +1,480 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint*_t, int16_t
+#include <stdlib.h> // for calloc, free
+
+#include "batch.h"
+
+#if defined(COUNTERS) || defined(VERBOSE)
+#define VECTOR_PATH (0) // The vector path doesn't count or print instructions
+#else
+#define VECTOR_PATH (1)
+#endif
+
+#define LANES (BATCH_LANES)
+
+#define LCD_CONTROL_ADDRESS (0xFF40)
+#define ECHO_RAM_ADDRESS (0xE000)
+#define HRAM_ADDRESS (0xFF80)
+#define IE_ADDRESS (0xFFFF)
+
+enum {
+    FLAG_Z = 0b10000000,
+    FLAG_N = 0b01000000,
+    FLAG_H = 0b00100000,
+    FLAG_C = 0b00010000,
+    FLAG_UNUSED = 0b00001111, // Kept as they are by every instruction
+};
+
+// Registers as opcodes number them. 6 stands for (HL), so its row is unused.
+enum lane_reg {
+    REG_B = 0,
+    REG_C = 1,
+    REG_D = 2,
+    REG_E = 3,
+    REG_H = 4,
+    REG_L = 5,
+    REG_A = 7,
+};
+
+enum alu_op {
+    ALU_ADD = 0,
+    ALU_ADC = 1,
+    ALU_SUB = 2,
+    ALU_SBC = 3,
+    ALU_AND = 4,
+    ALU_XOR = 5,
+    ALU_OR = 6,
+    ALU_CP = 7,
+};
+
+struct batch {
+    struct gb *lanes[LANES];
+    size_t num_lanes;
+
+    // Lane registers. For lanes whose live bit is set these are the real
+    // values and struct gb's copies are stale; otherwise it's the reverse.
+    uint8_t r[8][LANES];
+    uint8_t f[LANES];
+    uint16_t sp[LANES];
+    uint1_t live[LANES];
+
+    // For vectorisable opcodes, as step() sees them
+    uint8_t lengths[256];
+    uint8_t cycles[256];
+
+    struct batch_stats stats;
+};
+
+static void gather(struct batch *const batch, size_t const i) {
+    struct gb const *const gb = batch->lanes[i];
+    batch->r[REG_A][i] = gb->af >> 8;
+    batch->f[i] = gb->af;
+    batch->r[REG_B][i] = gb->bc >> 8;
+    batch->r[REG_C][i] = gb->bc;
+    batch->r[REG_D][i] = gb->de >> 8;
+    batch->r[REG_E][i] = gb->de;
+    batch->r[REG_H][i] = gb->hl >> 8;
+    batch->r[REG_L][i] = gb->hl;
+    batch->sp[i] = gb->sp;
+    batch->live[i] = 1;
+}
+
+static void scatter(struct batch *const batch, size_t const i) {
+    struct gb *const gb = batch->lanes[i];
+    gb->af = (batch->r[REG_A][i] << 8) | batch->f[i];
+    gb->bc = (batch->r[REG_B][i] << 8) | batch->r[REG_C][i];
+    gb->de = (batch->r[REG_D][i] << 8) | batch->r[REG_E][i];
+    gb->hl = (batch->r[REG_H][i] << 8) | batch->r[REG_L][i];
+    gb->sp = batch->sp[i];
+    batch->live[i] = 0;
+}
+
+// Whether an instruction can take the vector path rather than step()
+static uint1_t vectorisable(uint8_t const opcode) {
+    uint8_t const dst = (opcode >> 3) & 0b111;
+    uint8_t const src = opcode & 0b111;
+    switch (opcode) {
+    case 0x00: // NOP
+    case 0x2F: // CPL
+    case 0x37: // SCF
+    case 0x3F: // CCF
+        return 1;
+    default:
+        break;
+    }
+    if ((opcode & 0xC0) == 0x40) { // LD r, r' (and HALT, which is 0x76)
+        return dst != 6 && src != 6;
+    }
+    if ((opcode & 0xC0) == 0x80) { // ALU A, r
+        return src != 6;
+    }
+    switch (opcode & 0xC7) {
+    case 0xC6: // ALU A, n
+    case 0x03: // INC rr, DEC rr
+        return 1;
+    case 0x06: // LD r, n
+    case 0x04: // INC r
+    case 0x05: // DEC r
+        return dst != 6;
+    default:
+        return 0;
+    }
+}
+
+// Lengths and cycle counts have to match step()'s exactly, so rather than
+// keeping a second copy of them, each instruction is run once through step()
+// on a scratch machine. None of them depend on register values.
+static int learn_timings(struct batch *const batch) {
+    if (!VECTOR_PATH) {
+        return 0;
+    }
+    struct gb *const scratch = calloc(1, sizeof(*scratch));
+    if (scratch == NULL) {
+        return -1;
+    }
+    uint16_t const pc = 0xC000;
+    for (size_t opcode = 0; opcode < 256; opcode++) {
+        if (!vectorisable(opcode)) {
+            continue;
+        }
+        initialize_flat(scratch);
+        scratch->need_to_do_interrupts = 0;
+        scratch->pc = pc;
+        scratch->address_space[pc] = opcode;
+        step(scratch);
+        batch->lengths[opcode] = scratch->pc - pc;
+        batch->cycles[opcode] = scratch->cycles_to_wait;
+    }
+    free(scratch);
+    return 0;
+}
+
+// dst = src in the lanes whose mask byte is 0xFF
+static void blend(uint8_t *const dst, uint8_t const *const src,
+                  uint8_t const *const mask) {
+    for (size_t i = 0; i < LANES; i++) {
+        dst[i] = (src[i] & mask[i]) | (dst[i] & ~mask[i]);
+    }
+}
+
+static void alu(struct batch *const batch, enum alu_op const op,
+                uint8_t const *const operand, uint8_t const *const mask) {
+    uint8_t const *const a = batch->r[REG_A];
+    uint8_t const *const f = batch->f;
+    uint8_t result[LANES];
+    uint8_t flags[LANES];
+    switch (op) {
+    case ALU_ADD:
+    case ALU_ADC: {
+        uint8_t const use_carry = op == ALU_ADC;
+        for (size_t i = 0; i < LANES; i++) {
+            uint8_t const carry = use_carry & (f[i] >> 4);
+            uint16_t const sum = a[i] + operand[i] + carry;
+            uint8_t const half = (a[i] & 0xF) + (operand[i] & 0xF) + carry;
+            result[i] = sum;
+            flags[i] = (f[i] & FLAG_UNUSED) | (result[i] == 0 ? FLAG_Z : 0) |
+                       (half > 0xF ? FLAG_H : 0) | (sum > 0xFF ? FLAG_C : 0);
+        }
+        break;
+    }
+    case ALU_SUB:
+    case ALU_SBC:
+    case ALU_CP: {
+        uint8_t const use_carry = op == ALU_SBC;
+        for (size_t i = 0; i < LANES; i++) {
+            uint8_t const carry = use_carry & (f[i] >> 4);
+            int16_t const difference = a[i] - operand[i] - carry;
+            int16_t const half = (a[i] & 0xF) - (operand[i] & 0xF) - carry;
+            result[i] = difference;
+            flags[i] = (f[i] & FLAG_UNUSED) | FLAG_N |
+                       (result[i] == 0 ? FLAG_Z : 0) |
+                       (half < 0 ? FLAG_H : 0) |
+                       (difference < 0 ? FLAG_C : 0);
+        }
+        break;
+    }
+    case ALU_AND:
+        for (size_t i = 0; i < LANES; i++) {
+            result[i] = a[i] & operand[i];
+            flags[i] = (f[i] & FLAG_UNUSED) | FLAG_H |
+                       (result[i] == 0 ? FLAG_Z : 0);
+        }
+        break;
+    case ALU_XOR:
+        for (size_t i = 0; i < LANES; i++) {
+            result[i] = a[i] ^ operand[i];
+            flags[i] = (f[i] & FLAG_UNUSED) | (result[i] == 0 ? FLAG_Z : 0);
+        }
+        break;
+    case ALU_OR:
+        for (size_t i = 0; i < LANES; i++) {
+            result[i] = a[i] | operand[i];
+            flags[i] = (f[i] & FLAG_UNUSED) | (result[i] == 0 ? FLAG_Z : 0);
+        }
+        break;
+    default:
+        return;
+    }
+    if (op != ALU_CP) {
+        blend(batch->r[REG_A], result, mask);
+    }
+    blend(batch->f, flags, mask);
+}
+
+// Executes an instruction that vectorisable() accepted in the masked lanes
+static void execute(struct batch *const batch, uint8_t const opcode,
+                    uint8_t const *const imm, uint8_t const *const mask) {
+    uint8_t const dst = (opcode >> 3) & 0b111;
+    uint8_t const src = opcode & 0b111;
+    uint8_t *const a = batch->r[REG_A];
+    uint8_t *const f = batch->f;
+    uint8_t value[LANES];
+    uint8_t flags[LANES];
+
+    switch (opcode) {
+    case 0x00: // NOP
+        return;
+    case 0x2F: // CPL
+        for (size_t i = 0; i < LANES; i++) {
+            value[i] = ~a[i];
+            flags[i] = f[i] | FLAG_H | FLAG_N;
+        }
+        blend(a, value, mask);
+        blend(f, flags, mask);
+        return;
+    case 0x37: // SCF
+        for (size_t i = 0; i < LANES; i++) {
+            flags[i] = (f[i] | FLAG_C) & ~(FLAG_H | FLAG_N);
+        }
+        blend(f, flags, mask);
+        return;
+    case 0x3F: // CCF
+        for (size_t i = 0; i < LANES; i++) {
+            flags[i] = (f[i] ^ FLAG_C) & ~(FLAG_H | FLAG_N);
+        }
+        blend(f, flags, mask);
+        return;
+    default:
+        break;
+    }
+
+    if ((opcode & 0xC0) == 0x40) { // LD r, r'
+        blend(batch->r[dst], batch->r[src], mask);
+        return;
+    }
+    if ((opcode & 0xC0) == 0x80) { // ALU A, r
+        alu(batch, dst, batch->r[src], mask);
+        return;
+    }
+    switch (opcode & 0xC7) {
+    case 0xC6: // ALU A, n
+        alu(batch, dst, imm, mask);
+        return;
+    case 0x06: // LD r, n
+        blend(batch->r[dst], imm, mask);
+        return;
+    case 0x04: { // INC r
+        uint8_t *const r = batch->r[dst];
+        for (size_t i = 0; i < LANES; i++) {
+            value[i] = r[i] + 1;
+            flags[i] = (f[i] & (FLAG_C | FLAG_UNUSED)) |
+                       (value[i] == 0 ? FLAG_Z : 0) |
+                       ((r[i] & 0xF) == 0xF ? FLAG_H : 0);
+        }
+        blend(r, value, mask);
+        blend(f, flags, mask);
+        return;
+    }
+    case 0x05: { // DEC r
+        uint8_t *const r = batch->r[dst];
+        for (size_t i = 0; i < LANES; i++) {
+            value[i] = r[i] - 1;
+            flags[i] = (f[i] & (FLAG_C | FLAG_UNUSED)) | FLAG_N |
+                       (value[i] == 0 ? FLAG_Z : 0) |
+                       ((r[i] & 0xF) == 0 ? FLAG_H : 0);
+        }
+        blend(r, value, mask);
+        blend(f, flags, mask);
+        return;
+    }
+    case 0x03: { // INC rr (bit 3 clear), DEC rr (bit 3 set)
+        uint16_t const delta = opcode & 0b1000 ? 0xFFFF : 1;
+        uint8_t const dd = (opcode >> 4) & 0b11;
+        if (dd == 3) { // SP
+            for (size_t i = 0; i < LANES; i++) {
+                batch->sp[i] += mask[i] ? delta : 0;
+            }
+            return;
+        }
+        uint8_t *const hi = batch->r[2 * dd];
+        uint8_t *const lo = batch->r[2 * dd + 1];
+        uint8_t new_hi[LANES];
+        for (size_t i = 0; i < LANES; i++) {
+            uint16_t const pair = ((hi[i] << 8) | lo[i]) + delta;
+            new_hi[i] = pair >> 8;
+            value[i] = pair;
+        }
+        blend(hi, new_hi, mask);
+        blend(lo, value, mask);
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+// Whether lane i's next step could take the vector path. The instruction
+// bytes have to be plain memory, so ROM, VRAM, cartridge RAM, WRAM and HRAM,
+// and the lane can't have anything attached that step() reports to.
+static uint1_t can_vectorise(struct batch const *const batch, size_t const i) {
+    struct gb const *const gb = batch->lanes[i];
+    uint16_t const pc = gb->pc;
+    return VECTOR_PATH && !gb->halted && !gb->need_to_do_interrupts &&
+           gb->trace == NULL && gb->coverage == NULL && gb->debugger == NULL &&
+           (gb->flat_bus || pc < ECHO_RAM_ADDRESS - 1 ||
+            (pc >= HRAM_ADDRESS && pc < IE_ADDRESS - 1)) &&
+           vectorisable(gb->address_space[pc]);
+}
+
+// Runs one step on the lanes with active set
+static void step_lanes(struct batch *const batch, uint1_t const *const active) {
+    size_t const n = batch->num_lanes;
+
+    // Find the largest group of lanes at the same PC, with the same opcode
+    uint1_t eligible[LANES] = {0};
+    for (size_t i = 0; i < n; i++) {
+        eligible[i] = active[i] && can_vectorise(batch, i);
+    }
+    size_t leader = n;
+    size_t leader_count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!eligible[i]) {
+            continue;
+        }
+        struct gb const *const gb = batch->lanes[i];
+        size_t count = 0;
+        for (size_t j = i; j < n; j++) {
+            count += eligible[j] && batch->lanes[j]->pc == gb->pc &&
+                     batch->lanes[j]->address_space[gb->pc] ==
+                         gb->address_space[gb->pc];
+        }
+        if (count > leader_count) {
+            leader = i;
+            leader_count = count;
+        }
+    }
+
+    uint8_t mask[LANES] = {0};
+    if (leader < n) {
+        uint16_t const pc = batch->lanes[leader]->pc;
+        uint8_t const opcode = batch->lanes[leader]->address_space[pc];
+        uint8_t const length = batch->lengths[opcode];
+        uint8_t const cycles = batch->cycles[opcode];
+        uint8_t imm[LANES] = {0};
+        for (size_t j = leader; j < n; j++) {
+            struct gb const *const gb = batch->lanes[j];
+            if (eligible[j] && gb->pc == pc &&
+                gb->address_space[pc] == opcode) {
+                mask[j] = 0xFF;
+                imm[j] = gb->address_space[(uint16_t)(pc + 1)];
+                if (!batch->live[j]) {
+                    gather(batch, j);
+                }
+            }
+        }
+        execute(batch, opcode, imm, mask);
+        for (size_t j = leader; j < n; j++) {
+            if (mask[j]) {
+                batch->lanes[j]->pc += length;
+                batch->lanes[j]->cycles_to_wait += cycles;
+                batch->stats.vector_steps++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (!active[i]) {
+            continue;
+        }
+        if (!mask[i]) {
+            if (batch->live[i]) {
+                scatter(batch, i);
+            }
+            step(batch->lanes[i]);
+            batch->stats.scalar_steps++;
+        }
+        wait(batch->lanes[i]);
+    }
+}
+
+struct batch *batch_open(struct gb *const *const lanes,
+                         size_t const num_lanes) {
+    if (num_lanes == 0 || num_lanes > LANES) {
+        return NULL;
+    }
+    struct batch *const batch = calloc(1, sizeof(*batch));
+    if (batch == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < num_lanes; i++) {
+        batch->lanes[i] = lanes[i];
+    }
+    batch->num_lanes = num_lanes;
+    if (learn_timings(batch) != 0) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void batch_step(struct batch *const batch) {
+    uint1_t active[LANES];
+    for (size_t i = 0; i < LANES; i++) {
+        active[i] = i < batch->num_lanes;
+    }
+    step_lanes(batch, active);
+}
+
+void batch_run_frame(struct batch *const batch) {
+    size_t const n = batch->num_lanes;
+    uint64_t start_frame[LANES];
+    uint64_t start_cycle[LANES];
+    uint1_t active[LANES] = {0};
+    for (size_t i = 0; i < n; i++) {
+        start_frame[i] = batch->lanes[i]->frame_count;
+        start_cycle[i] = batch->lanes[i]->cycle_count;
+        active[i] = 1;
+    }
+    size_t remaining = n;
+    while (remaining > 0) {
+        step_lanes(batch, active);
+        for (size_t i = 0; i < n; i++) {
+            struct gb const *const gb = batch->lanes[i];
+            if (active[i] &&
+                (gb->frame_count != start_frame[i] ||
+                 (!(gb->address_space[LCD_CONTROL_ADDRESS] >> 7) &&
+                  gb->cycle_count - start_cycle[i] >= CYCLES_PER_FRAME))) {
+                active[i] = 0;
+                remaining--;
+            }
+        }
+    }
+    batch_sync(batch);
+}
+
+void batch_sync(struct batch *const batch) {
+    for (size_t i = 0; i < batch->num_lanes; i++) {
+        if (batch->live[i]) {
+            scatter(batch, i);
+        }
+    }
+}
+
+void batch_get_stats(struct batch const *const batch,
+                     struct batch_stats *const out) {
+    *out = batch->stats;
+}
+
+void batch_close(struct batch *const batch) {
+    free(batch);
+}
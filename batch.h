@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include "gb.h"
+
+// An experimental engine that runs up to BATCH_LANES instances side by side.
+// The register files of the instances are kept in structure-of-arrays form,
+// one array element per lane. At every step, the largest group of lanes that
+// are at the same PC with the same opcode executes that instruction together,
+// as loops over the lane arrays that the compiler turns into SIMD; every other
+// lane takes a normal scalar step(). Lanes that split up rejoin a group
+// whenever their PCs meet again, e.g., at a common vblank wait loop.
+//
+// Only register-only instructions (8-bit loads and ALU operations, INC/DEC,
+// CPL/SCF/CCF and NOP) take the vector path. Anything that touches memory,
+// branches or is halted goes through step(), as does every instruction of a
+// lane that is being traced, has its coverage recorded or has a debugger
+// attached, and everything in builds with COUNTERS or VERBOSE. Timing (wait())
+// is always per lane.
+
+#define BATCH_LANES (16)
+
+struct batch_stats {
+    uint64_t vector_steps; // Lane-steps that took the vector path
+    uint64_t scalar_steps; // Lane-steps that took step()
+};
+
+// Returns NULL if num_lanes is 0 or more than BATCH_LANES, or on allocation
+// failure. The lanes must stay alive until batch_close().
+struct batch *batch_open(struct gb *const *lanes, size_t num_lanes);
+
+// Runs one step (see step() and wait()) on every lane. Afterwards, lanes'
+// registers may be held in the batch; see batch_sync().
+void batch_step(struct batch *batch);
+
+// Runs every lane until its next vblank, or for a frame's worth of cycles if
+// none comes, exactly like run_frame() on each. Leaves the lanes in sync.
+void batch_run_frame(struct batch *batch);
+
+// Writes registers held by the batch back into the lanes. Call it before
+// reading or changing a lane's registers between calls to batch_step().
+void batch_sync(struct batch *batch);
+
+void batch_get_stats(struct batch const *batch, struct batch_stats *out);
+
+void batch_close(struct batch *batch);
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE   // for clock_gettime(2), getopt(3)
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint*_t
+#include <stdio.h>    // for fprintf, snprintf, fopen, fgets, fclose, FILE
+#include <stdlib.h>   // for EXIT_FAILURE, EXIT_SUCCESS, strtod, strtoull
+#include <string.h>   // for memcpy, strlen, strrchr, strstr
+#include <time.h>     // for clock_gettime
+#include <unistd.h>   // for getopt
+
+#include "gb.h"
+
+// Each workload is a tiny ROM, assembled from bench/*.asm by gb-asm, that
+// stresses one part of the emulator. They all leave the LCD on, so every
+// workload also pays for the PPU. A workload is named after its ROM file.
+
+#define WARMUP_FRAMES (10)
+
+struct result {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frames;
+    uint64_t wall_ns;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct result run_workload(char const *const rom_path,
+                                  uint64_t const num_frames) {
+    static struct gb gb;
+    initialize(&gb, rom_path);
+    for (int i = 0; i < WARMUP_FRAMES; i++) {
+        run_frame(&gb);
+    }
+
+    uint64_t const start_cycle = gb.cycle_count;
+    uint64_t const start_frame = gb.frame_count;
+    uint64_t const end_cycle = start_cycle + num_frames * CYCLES_PER_FRAME;
+    uint64_t instructions = 0;
+
+    uint64_t const start = now_ns();
+    while (gb.cycle_count < end_cycle) {
+        instructions += !gb.halted;
+        step(&gb);
+        wait(&gb);
+    }
+    uint64_t const wall_ns = now_ns() - start;
+
+    return (struct result){
+        .cycles = gb.cycle_count - start_cycle,
+        .instructions = instructions,
+        .frames = gb.frame_count - start_frame,
+        .wall_ns = wall_ns,
+    };
+}
+
+static double emulated_mhz(struct result const *const r) {
+    return r->cycles * 1e3 / r->wall_ns;
+}
+
+// The file name of path, without directories or extension.
+static void workload_name(char const *const path, char *const name,
+                          size_t const name_size) {
+    char const *const slash = strrchr(path, '/');
+    char const *const base = slash == NULL ? path : slash + 1;
+    char const *const dot = strrchr(base, '.');
+    size_t len = dot == NULL ? strlen(base) : (size_t)(dot - base);
+    if (len >= name_size) {
+        len = name_size - 1;
+    }
+    memcpy(name, base, len);
+    name[len] = '\0';
+}
+
+// Reads the emulated_mhz of the named workload from a file written by -o.
+// Returns 0 if the workload isn't there.
+static double baseline_mhz(char const *const path, char const *const name) {
+    FILE *const f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    char line[512];
+    char key[96];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    double mhz = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char const *const field = strstr(line, "\"emulated_mhz\": ");
+        if (strstr(line, key) != NULL && field != NULL) {
+            mhz = strtod(field + strlen("\"emulated_mhz\": "), NULL);
+            break;
+        }
+    }
+    fclose(f);
+    return mhz;
+}
+
+static void usage(char const *const argv0) {
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-r repeats] [-o out.json] "
+            "[-b baseline.json] [-t threshold_percent] <rom_file>...\n",
+            argv0);
+}
+
+int main(int argc, char *const *const argv) {
+    uint64_t num_frames = 300;
+    uint64_t repeats = 3;
+    char const *out_path = NULL;
+    char const *baseline_path = NULL;
+    double threshold = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:o:b:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            num_frames = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            repeats = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 't':
+            threshold = strtod(optarg, NULL);
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc || num_frames == 0 || repeats == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *const out = out_path == NULL ? stdout : fopen(out_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Couldn't open %s!\n", out_path);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    fprintf(out, "{\"workloads\": [\n");
+    for (int i = optind; i < argc; i++) {
+        char name[64];
+        workload_name(argv[i], name, sizeof(name));
+
+        // Keep the fastest run; anything slower was disturbed by the host.
+        struct result best = {0};
+        for (uint64_t j = 0; j < repeats; j++) {
+            struct result const r = run_workload(argv[i], num_frames);
+            if (j == 0 || r.wall_ns < best.wall_ns) {
+                best = r;
+            }
+        }
+
+        double const mhz = emulated_mhz(&best);
+        fprintf(out,
+                "  {\"name\": \"%s\", \"cycles\": %" PRIu64
+                ", \"instructions\": %" PRIu64 ", \"frames\": %" PRIu64
+                ", \"wall_ns\": %" PRIu64
+                ", \"emulated_mhz\": %.3f, \"fps\": %.1f"
+                ", \"ns_per_instruction\": %.2f}%s\n",
+                name, best.cycles, best.instructions,
+                best.frames, best.wall_ns, mhz,
+                best.frames * 1e9 / best.wall_ns,
+                best.instructions == 0
+                    ? 0.0
+                    : (double)best.wall_ns / best.instructions,
+                i + 1 == argc ? "" : ",");
+
+        if (baseline_path != NULL) {
+            double const base = baseline_mhz(baseline_path, name);
+            if (base == 0) {
+                fprintf(stderr, "%s: no baseline\n", name);
+            } else if (mhz < base * (1 - threshold / 100)) {
+                fprintf(stderr,
+                        "%s: REGRESSION: %.3f emulated MHz vs %.3f baseline "
+                        "(%+.1f%%)\n",
+                        name, mhz, base,
+                        (mhz / base - 1) * 100);
+                status = EXIT_FAILURE;
+            } else {
+                fprintf(stderr,
+                        "%s: ok: %.3f emulated MHz vs %.3f baseline "
+                        "(%+.1f%%)\n",
+                        name, mhz, base,
+                        (mhz / base - 1) * 100);
+            }
+        }
+    }
+    fprintf(out, "]}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    return status;
+}
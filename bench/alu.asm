@@ -0,0 +1,27 @@
+; Register-to-register ALU instructions in a tight loop.
+
+    TITLE "alu"
+
+    ORG 0x100
+    nop
+    jp start
+
+    ORG 0x150
+start:
+    di
+    ld sp, 0xFFFE
+    xor a
+    ld b, 3
+    ld c, 5
+.loop:
+    add a, b
+    xor a, c
+    inc b
+    dec c
+    and a, d
+    or a, e
+    sub a, h
+    cp a, l
+    swap a
+    add a, a
+    jr .loop
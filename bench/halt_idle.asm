@@ -0,0 +1,22 @@
+; HALTs, waking only for an empty vblank handler. Nearly all of the time goes
+; to the PPU and timers.
+
+    TITLE "halt_idle"
+
+    ORG 0x40 ; Vblank
+    reti
+
+    ORG 0x100
+    nop
+    jp start
+
+    ORG 0x150
+start:
+    di
+    ld sp, 0xFFFE
+    ld a, 0b00001 ; Vblank
+    ldh (0xFFFF), a
+    ei
+.loop:
+    halt
+    jr .loop
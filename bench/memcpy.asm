@@ -0,0 +1,25 @@
+; Copies 4 KiB of WRAM to WRAM, over and over.
+
+    TITLE "memcpy"
+
+    ORG 0x100
+    nop
+    jp start
+
+    ORG 0x150
+start:
+    di
+    ld sp, 0xFFFE
+.copy:
+    ld hl, 0xC000
+    ld de, 0xD000
+    ld bc, 0x1000
+.loop:
+    ld a, (hli)
+    ld (de), a
+    inc de
+    dec bc
+    ld a, b
+    or a, c
+    jr nz, .loop
+    jr .copy
@@ -0,0 +1,51 @@
+; Draws 40 sprites, reloading OAM by DMA in every vblank.
+
+    TITLE "sprites"
+
+    ORG 0x40 ; Vblank
+    ld a, 0xC0
+    ldh (0xFF46), a ; DMA from 0xC000
+    reti
+
+    ORG 0x100
+    nop
+    jp start
+
+    ORG 0x150
+start:
+    di
+    ld sp, 0xFFFE
+
+    ; Lay 40 unflipped sprites out across the screen in WRAM.
+    ld hl, 0xC000
+    ld b, 40
+    ld c, 16 ; Y
+    ld d, 8  ; X
+    ld e, 0  ; Tile
+.fill:
+    ld a, c
+    ld (hli), a
+    ld a, d
+    ld (hli), a
+    ld a, e
+    ld (hli), a
+    xor a
+    ld (hli), a
+    ld a, c
+    add a, 3
+    ld c, a
+    ld a, d
+    add a, 4
+    ld d, a
+    inc e
+    dec b
+    jr nz, .fill
+
+    ld a, 0x93 ; LCD, BG and OBJ on
+    ldh (0xFF40), a
+    ld a, 0b00001 ; Vblank
+    ldh (0xFFFF), a
+    ei
+.loop:
+    halt
+    jr .loop
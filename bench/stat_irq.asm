@@ -0,0 +1,25 @@
+; HALTs, waking for STAT interrupts on LYC, OAM scan and hblank.
+
+    TITLE "stat_irq"
+
+    ORG 0x48 ; STAT
+    inc (hl)
+    reti
+
+    ORG 0x100
+    nop
+    jp start
+
+    ORG 0x150
+start:
+    di
+    ld sp, 0xFFFE
+    ld hl, 0xFF80
+    ld a, 0b01101000 ; LYC, OAM and hblank interrupt sources
+    ldh (0xFF41), a
+    ld a, 0b00010 ; STAT
+    ldh (0xFFFF), a
+    ei
+.loop:
+    halt
+    jr .loop
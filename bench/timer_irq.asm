@@ -0,0 +1,29 @@
+; Runs NOPs while the timer interrupts as fast as it can.
+
+    TITLE "timer_irq"
+
+    ORG 0x50 ; Timer
+    inc (hl)
+    reti
+
+    ORG 0x100
+    nop
+    jp start
+
+    ORG 0x150
+start:
+    di
+    ld sp, 0xFFFE
+    ld hl, 0xFF80
+    ld a, 0xFF
+    ldh (0xFF06), a ; TMA
+    ld a, 0b101 ; Enabled, fastest clock
+    ldh (0xFF07), a ; TAC
+    ld a, 0b00100 ; Timer
+    ldh (0xFFFF), a
+    ei
+.loop:
+    nop
+    nop
+    nop
+    jr .loop
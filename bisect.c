@@ -0,0 +1,407 @@
+#define _GNU_SOURCE   // for clock_gettime(2), getopt(3)
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint8_t, uint64_t
+#include <stdio.h>    // for printf, fprintf
+#include <stdlib.h>   // for EXIT_FAILURE, EXIT_SUCCESS, free, strtoull
+#include <time.h>     // for clock_gettime
+#include <unistd.h>   // for getopt
+
+#include "client.h"
+#include "compare.h"
+#include "engine.h"
+#include "gb.h"
+#include "hash.h"
+#include "inputs.h"
+#include "server.h"
+
+// Finds the first instruction where two engines diverge, without comparing
+// every instruction of a long run. Both machines run freely, and every -k
+// frames their state hashes are compared and a checkpoint is saved. Once a
+// checkpoint differs, a binary search from the last matching checkpoint finds
+// the first frame after which the states differ, and only that frame is
+// replayed with instruction-level lockstep comparison.
+//
+// The machine under test can also be another build: with -p, it runs in that
+// build's gb-server, started as a child process, and is driven through the
+// server protocol. Its checkpoints are its own save states, and it's compared
+// through SERVER_HASH_STATE and SERVER_STEP, which don't depend on the layout
+// of struct gb. Its frames end exactly where run_frame() ends them, so -r
+// should name an engine that doesn't run past that step (e.g., the reference).
+
+#define DEFAULT_WINDOW (16)
+#define LCD_CONTROL_ADDRESS (0xFF40)
+
+struct bisect {
+    struct lockstep ls; // Without b or engine if there's a peer
+    struct client *peer; // The other build's gb-server, or NULL
+    char const *peer_name;
+    uint8_t peer_buttons; // What the peer was last told to hold
+    uint1_t failed; // Set if the peer stopped answering
+};
+
+struct checkpoint {
+    struct gb a;
+    struct gb b;
+    uint8_t *peer_state; // In the peer's own layout
+    size_t peer_state_size;
+    uint64_t frame;
+    uint64_t steps;
+};
+
+static uint8_t held_buttons(struct gb const *const gb) {
+    uint8_t buttons = 0;
+    for (size_t b = 0; b < NUM_BUTTONS; b++) {
+        buttons |= !gb->buttons_pressed[b] << b; // Active low
+    }
+    return buttons;
+}
+
+static void save_checkpoint(struct checkpoint *const cp,
+                            struct bisect *const bs) {
+    save_state(bs->ls.a, &cp->a);
+    if (bs->peer == NULL) {
+        save_state(bs->ls.b, &cp->b);
+    } else {
+        free(cp->peer_state);
+        cp->peer_state = NULL;
+        bs->failed |= client_save_state(bs->peer, &cp->peer_state,
+                                        &cp->peer_state_size) != 0;
+    }
+    cp->frame = bs->ls.frame;
+    cp->steps = bs->ls.steps;
+}
+
+static void load_checkpoint(struct bisect *const bs,
+                            struct checkpoint const *const cp) {
+    load_state(bs->ls.a, &cp->a);
+    if (bs->peer == NULL) {
+        load_state(bs->ls.b, &cp->b);
+    } else {
+        bs->failed |= client_load_state(bs->peer, cp->peer_state,
+                                        cp->peer_state_size) != 0;
+        bs->peer_buttons = held_buttons(bs->ls.a); // They're in the state
+    }
+    bs->ls.frame = cp->frame;
+    bs->ls.steps = cp->steps;
+}
+
+static uint1_t states_match(struct bisect *const bs) {
+    if (bs->peer == NULL) {
+        return hash_state(bs->ls.a) == hash_state(bs->ls.b);
+    }
+    uint64_t hash = 0;
+    bs->failed |= client_hash_state(bs->peer, &hash) != 0;
+    return hash_state(bs->ls.a) == hash;
+}
+
+// Applies this frame's inputs to a and tells the peer, if the buttons changed.
+// Frames the peer still has to run go first.
+static void apply_peer_inputs(struct bisect *const bs, uint32_t *const pending) {
+    if (bs->ls.inputs != NULL) {
+        input_script_apply(bs->ls.inputs, bs->ls.a, bs->ls.frame);
+    }
+    uint8_t const buttons = held_buttons(bs->ls.a);
+    if (buttons == bs->peer_buttons) {
+        return;
+    }
+    if (*pending > 0) {
+        bs->failed |= client_run_frames(bs->peer, *pending) != 0;
+        *pending = 0;
+    }
+    bs->failed |= client_set_buttons(bs->peer, buttons) != 0;
+    bs->peer_buttons = buttons;
+}
+
+// Whether a frame that started at start_frame and start_cycle is over, with
+// the same boundaries as run_frame(), which gb-server uses
+static uint1_t frame_done(struct gb const *const gb, uint64_t const start_frame,
+                          uint64_t const start_cycle) {
+    return gb->frame_count != start_frame ||
+           (!(gb->address_space[LCD_CONTROL_ADDRESS] >> 7) &&
+            gb->cycle_count - start_cycle >= CYCLES_PER_FRAME);
+}
+
+// Runs both machines up to frame, without comparing them.
+static void run_to(struct bisect *const bs, uint64_t const frame) {
+    if (bs->peer == NULL) {
+        while (bs->ls.frame < frame) {
+            lockstep_run_frame(&bs->ls);
+        }
+        return;
+    }
+    // The peer runs frames in batches, between changes of buttons.
+    uint32_t pending = 0;
+    while (bs->ls.frame < frame && !bs->failed) {
+        apply_peer_inputs(bs, &pending);
+        uint64_t const start_frame = bs->ls.a->frame_count;
+        uint64_t const start_cycle = bs->ls.a->cycle_count;
+        do {
+            bs->ls.steps += engine_run(bs->ls.reference);
+        } while (!frame_done(bs->ls.a, start_frame, start_cycle));
+        pending++;
+        bs->ls.frame++;
+    }
+    if (pending > 0) {
+        bs->failed |= client_run_frames(bs->peer, pending) != 0;
+    }
+}
+
+// Copies what the peer described into b, which only stands in for it. Memory
+// is left alone, except for the bytes at PC, for window_record().
+static void describe_peer(struct gb *const b,
+                          struct server_machine const *const m) {
+    b->af = m->af;
+    b->bc = m->bc;
+    b->de = m->de;
+    b->hl = m->hl;
+    b->sp = m->sp;
+    b->pc = m->pc;
+    b->ime = m->ime;
+    b->halted = m->halted;
+    b->fault = m->fault;
+    b->need_to_do_interrupts = m->need_to_do_interrupts;
+    b->cycle_count = m->cycle_count;
+    b->cycles_to_wait = m->cycles_to_wait;
+    b->dot_count = m->dot_count;
+    b->frame_count = m->frame_count;
+    b->graphics_mode = m->graphics_mode;
+    b->joypad_mode = m->joypad_mode;
+    for (size_t i = 0; i < 4; i++) {
+        b->address_space[(uint16_t)(b->pc + i)] = m->pcmem >> (8 * i);
+    }
+}
+
+// lockstep_compare_frames() for one frame against the peer: each engine_run()
+// on a is followed by as many steps on the peer, and the machines are compared
+// field by field, with memory and the screen by their hashes. Returns 1, after
+// printing a report, if they diverge.
+static uint1_t compare_peer_frame(struct bisect *const bs,
+                                  struct gb *const b) {
+    static struct window window_a;
+    static struct window window_b;
+    window_a.size = bs->ls.window_size;
+    window_a.count = 0;
+    window_b.size = bs->ls.window_size;
+    window_b.count = 0;
+    struct gb *const a = bs->ls.a;
+    uint32_t pending = 0;
+    apply_peer_inputs(bs, &pending);
+    struct server_machine m;
+    bs->failed |= client_step(bs->peer, 0, &m) != 0;
+    describe_peer(b, &m);
+
+    uint64_t const start_frame = a->frame_count;
+    uint64_t const start_cycle = a->cycle_count;
+    while (!bs->failed && !frame_done(a, start_frame, start_cycle)) {
+        window_record(&window_a, a);
+        window_record(&window_b, b);
+        uint64_t const steps = engine_run(bs->ls.reference);
+        bs->ls.steps += steps;
+        bs->failed |= client_step(bs->peer, steps, &m) != 0;
+        describe_peer(b, &m);
+
+        uint1_t const memory_differs =
+            hash64(a->address_space, sizeof(a->address_space), 0) !=
+            m.memory_hash;
+        // The screen only changes when a frame is drawn.
+        uint1_t const screen_differs =
+            a->frame_count != start_frame &&
+            hash64(a->screen, sizeof(a->screen), 0) != m.screen_hash;
+        if (!compare_machines(a, b, 0, 0, 0) && !memory_differs &&
+            !screen_differs) {
+            continue;
+        }
+        printf("Divergence after %" PRIu64 " steps (cycle %" PRIu64
+               ", frame %" PRIu64 "):\n",
+               bs->ls.steps, a->cycle_count, bs->ls.frame);
+        printf("  %-22s %-18s %-18s\n", "", bs->ls.reference->engine->name,
+               bs->peer_name);
+        // Only now is the peer's memory worth fetching.
+        uint1_t const have_memory =
+            memory_differs &&
+            client_get_ram(bs->peer, 0, sizeof(b->address_space),
+                           b->address_space) == 0;
+        compare_machines(a, b, have_memory, 0, 1);
+        if (screen_differs) {
+            printf("  %-22s 0x%016" PRIX64 " 0x%016" PRIX64 "\n", "screen",
+                   hash64(a->screen, sizeof(a->screen), 0), m.screen_hash);
+        }
+        window_print(bs->ls.reference->engine->name, &window_a);
+        window_print(bs->peer_name, &window_b);
+        return 1;
+    }
+    bs->ls.frame++;
+    return 0;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(char const *const argv0) {
+    fprintf(stderr,
+            "Usage: %s [-r reference_engine] [-e engine] [-n frames] "
+            "[-k checkpoint_interval] [-w window] [-i inputs] "
+            "[-p other_gb_server] <rom_file>\n",
+            argv0);
+}
+
+int main(int argc, char *const *const argv) {
+    char const *reference_name = "reference";
+    char const *engine_name = "reference";
+    uint64_t num_frames = 60 * 60 * 10;
+    uint64_t interval = 256;
+    size_t window_size = DEFAULT_WINDOW;
+    char const *inputs_path = NULL;
+    char const *peer_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:e:n:k:w:i:p:")) != -1) {
+        switch (opt) {
+        case 'r':
+            reference_name = optarg;
+            break;
+        case 'e':
+            engine_name = optarg;
+            break;
+        case 'n':
+            num_frames = strtoull(optarg, NULL, 0);
+            break;
+        case 'k':
+            interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            window_size = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            inputs_path = optarg;
+            break;
+        case 'p':
+            peer_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || interval == 0 || window_size == 0 ||
+        window_size > MAX_WINDOW) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    struct engine const *const reference = find_engine(reference_name);
+    struct engine const *const engine = find_engine(engine_name);
+    if (reference == NULL || engine == NULL) {
+        fprintf(stderr, "No such engine: %s\n",
+                reference == NULL ? reference_name : engine_name);
+        return EXIT_FAILURE;
+    }
+    struct input_script inputs = {0};
+    if (inputs_path != NULL && input_script_read(&inputs, inputs_path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    static struct gb a;
+    static struct gb b; // Only a stand-in for the peer, if there is one
+    initialize(&a, argv[optind]);
+    struct bisect bs = {
+        .ls =
+            {
+                .a = &a,
+                .b = &b,
+                .inputs = &inputs,
+                .memory_interval = 1,
+                .window_size = window_size,
+            },
+        .peer_name = peer_path != NULL ? peer_path : engine->name,
+        .peer_buttons = held_buttons(&a),
+    };
+    bs.ls.reference = engine_open(reference, &a);
+    if (peer_path != NULL) {
+        bs.peer = client_spawn(peer_path, argv[optind]);
+        if (bs.peer == NULL) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        initialize(&b, argv[optind]);
+        bs.ls.engine = engine_open(engine, &b);
+    }
+    if (bs.ls.reference == NULL || (bs.peer == NULL && bs.ls.engine == NULL)) {
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+    uint64_t const start = now_ns();
+
+    // Run freely, checking every interval frames. The checkpoint is the last
+    // frame where the states matched, and bad the first where they didn't.
+    static struct checkpoint checkpoint;
+    save_checkpoint(&checkpoint, &bs);
+    uint64_t bad = 0;
+    while (bs.ls.frame < num_frames && !bs.failed) {
+        uint64_t const next = bs.ls.frame + interval < num_frames
+                                  ? bs.ls.frame + interval
+                                  : num_frames;
+        run_to(&bs, next);
+        if (!states_match(&bs)) {
+            bad = bs.ls.frame;
+            break;
+        }
+        save_checkpoint(&checkpoint, &bs);
+    }
+    int status = EXIT_FAILURE;
+    if (bs.failed) {
+        goto done;
+    }
+    if (bad == 0) {
+        printf("No divergence between %s and %s in %" PRIu64
+               " frames (%.2fs)\n",
+               reference->name, bs.peer_name, bs.ls.frame,
+               (now_ns() - start) / 1e9);
+        status = EXIT_SUCCESS;
+        goto done;
+    }
+    printf("States match after frame %" PRIu64 " but not after frame %" PRIu64
+           "; bisecting\n",
+           checkpoint.frame, bad);
+
+    // Binary search, moving the checkpoint forward whenever the states match.
+    while (bad - checkpoint.frame > 1 && !bs.failed) {
+        uint64_t const mid = checkpoint.frame + (bad - checkpoint.frame) / 2;
+        load_checkpoint(&bs, &checkpoint);
+        run_to(&bs, mid);
+        if (states_match(&bs)) {
+            save_checkpoint(&checkpoint, &bs);
+        } else {
+            bad = mid;
+        }
+    }
+    if (bs.failed) {
+        goto done;
+    }
+    printf("First divergent frame: %" PRIu64 " (%.2fs)\n", checkpoint.frame,
+           (now_ns() - start) / 1e9);
+
+    // Replay just that frame, one instruction at a time.
+    load_checkpoint(&bs, &checkpoint);
+    uint1_t const found = bs.peer == NULL ? lockstep_compare_frames(&bs.ls, 1)
+                                          : compare_peer_frame(&bs, &b);
+    if (!found && !bs.failed) {
+        printf("The states differ after frame %" PRIu64
+               ", but no compared field did during it\n",
+               checkpoint.frame);
+    }
+    printf("Done in %.2fs\n", (now_ns() - start) / 1e9);
+
+done:
+    engine_close(bs.ls.reference);
+    if (bs.peer != NULL) {
+        client_close(bs.peer);
+    } else {
+        engine_close(bs.ls.engine);
+    }
+    free(checkpoint.peer_state);
+    input_script_free(&inputs);
+    return status;
+}
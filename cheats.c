@@ -0,0 +1,151 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint8_t, uint16_t
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for strlen
+
+#include "cheats.h"
+#include "gb.h"
+
+#define ROM_END (0x8000)
+
+struct cheats {
+    struct cheat list[MAX_CHEATS];
+    size_t count;
+    // For Game Genie codes: whether the compare value matched, so that the
+    // ROM was patched, and what was there before
+    uint1_t patched[MAX_CHEATS];
+    uint8_t originals[MAX_CHEATS];
+};
+
+static int hex_digit(char const c) {
+    if ('0' <= c && c <= '9') {
+        return c - '0';
+    }
+    if ('a' <= c && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if ('A' <= c && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Reads count hex digits from code into digits, skipping a dash after every
+// third. Returns 0 on success, or -1 on anything else.
+static int read_digits(char const *code, int *const digits, size_t const count,
+                       uint1_t const dashed) {
+    for (size_t i = 0; i < count; i++) {
+        if (dashed && i > 0 && i % 3 == 0 && *code++ != '-') {
+            return -1;
+        }
+        digits[i] = hex_digit(*code++);
+        if (digits[i] < 0) {
+            return -1;
+        }
+    }
+    return *code == '\0' ? 0 : -1;
+}
+
+int cheat_parse(char const *const code, struct cheat *const out) {
+    int d[9];
+    size_t const length = strlen(code);
+    if (length == 8 && read_digits(code, d, 8, 0) == 0) {
+        // The type (d[0] and d[1]) picks a cart RAM bank, which only matters
+        // with an MBC.
+        *out = (struct cheat){
+            .kind = CHEAT_GAMESHARK,
+            .value = d[2] << 4 | d[3],
+            .address = d[6] << 12 | d[7] << 8 | d[4] << 4 | d[5],
+        };
+        return 0;
+    }
+    if ((length == 7 && read_digits(code, d, 6, 1) == 0) ||
+        (length == 11 && read_digits(code, d, 9, 1) == 0)) {
+        *out = (struct cheat){
+            .kind = CHEAT_GAME_GENIE,
+            .value = d[0] << 4 | d[1],
+            .address = (d[5] ^ 0xF) << 12 | d[2] << 8 | d[3] << 4 | d[4],
+            .has_compare = length == 11,
+        };
+        if (out->has_compare) {
+            // The middle digit of the last group is unused.
+            uint8_t const c = d[6] << 4 | d[8];
+            out->compare = (uint8_t)(c >> 2 | c << 6) ^ 0xBA;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+struct cheats *cheats_open(void) {
+    return calloc(1, sizeof(struct cheats));
+}
+
+void cheats_close(struct cheats *const cheats, struct gb *const gb) {
+    if (cheats == NULL) {
+        return;
+    }
+    if (gb != NULL) {
+        cheats_unpatch(cheats, gb);
+    }
+    free(cheats);
+}
+
+static void patch(struct cheats *const cheats, struct gb *const gb,
+                  size_t const i) {
+    struct cheat const *const cheat = &cheats->list[i];
+    uint8_t *const byte = &gb->address_space[cheat->address];
+    cheats->patched[i] = !cheat->has_compare || *byte == cheat->compare;
+    if (cheats->patched[i]) {
+        cheats->originals[i] = *byte;
+        *byte = cheat->value;
+    }
+}
+
+int cheats_add(struct cheats *const cheats, struct gb *const gb,
+               struct cheat const *const cheat) {
+    uint1_t const in_rom = cheat->address < ROM_END;
+    if (cheats->count == MAX_CHEATS ||
+        in_rom != (cheat->kind == CHEAT_GAME_GENIE)) {
+        return -1;
+    }
+    size_t const i = cheats->count++;
+    cheats->list[i] = *cheat;
+    cheats->patched[i] = 0;
+    if (cheat->kind == CHEAT_GAME_GENIE) {
+        patch(cheats, gb, i);
+    }
+    return 0;
+}
+
+void cheats_clear(struct cheats *const cheats, struct gb *const gb) {
+    cheats_unpatch(cheats, gb);
+    cheats->count = 0;
+}
+
+void cheats_apply(struct cheats const *const cheats, struct gb *const gb) {
+    for (size_t i = 0; i < cheats->count; i++) {
+        struct cheat const *const cheat = &cheats->list[i];
+        if (cheat->kind == CHEAT_GAMESHARK) {
+            bus_write(gb, cheat->address, cheat->value);
+        }
+    }
+}
+
+void cheats_unpatch(struct cheats const *const cheats, struct gb *const state) {
+    // Newest first, in case two codes patch the same byte
+    for (size_t i = cheats->count; i-- > 0;) {
+        if (cheats->patched[i]) {
+            state->address_space[cheats->list[i].address] =
+                cheats->originals[i];
+        }
+    }
+}
+
+void cheats_repatch(struct cheats *const cheats, struct gb *const gb) {
+    for (size_t i = 0; i < cheats->count; i++) {
+        if (cheats->list[i].kind == CHEAT_GAME_GENIE) {
+            patch(cheats, gb, i);
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t
+
+#include "gb.h"
+
+// GameShark and Game Genie codes, for a gb with a cheat list attached
+// (gb->cheats). Neither costs anything per memory access:
+//
+// - GameShark codes are RAM writes, made through the bus at the start of
+//   every vblank, before the game's vblank handler can run.
+// - Game Genie codes replace a ROM byte, but only if it holds the compare
+//   value (meant to pick out one bank). There's no MBC support, so ROM is
+//   never remapped, and patching the mapped bytes in place, once, is the same
+//   as mapping in patched copies of the pages.
+//
+// Save states never include Game Genie patches: save_state() saves the
+// original ROM bytes, and load_state() patches the loaded ROM again.
+
+#define MAX_CHEATS (256)
+
+enum cheat_kind {
+    CHEAT_GAMESHARK = 0,
+    CHEAT_GAME_GENIE = 1,
+};
+
+struct cheat {
+    enum cheat_kind kind;
+    uint16_t address;
+    uint8_t value;
+    uint1_t has_compare; // Game Genie only; 6-character codes have none
+    uint8_t compare;
+};
+
+// Parses a GameShark code ("01FF34C1", eight hex digits: type, value and
+// address, the address low byte first) or a Game Genie code ("00A-17B-C49",
+// or without the last group). Returns 0 on success, or -1 if code is
+// neither.
+int cheat_parse(char const *code, struct cheat *out);
+
+struct cheats *cheats_open(void);
+
+// Unpatches gb's ROM, unless gb is NULL, and frees the list.
+void cheats_close(struct cheats *cheats, struct gb *gb);
+
+// Adds a cheat, patching gb's ROM straight away for a Game Genie code. The
+// list must be attached to gb. Returns 0 on success, or -1 if there are
+// already MAX_CHEATS, or if a Game Genie code is outside ROM or a GameShark
+// code inside it.
+int cheats_add(struct cheats *cheats, struct gb *gb, struct cheat const *cheat);
+
+// Removes every cheat, unpatching gb's ROM.
+void cheats_clear(struct cheats *cheats, struct gb *gb);
+
+// For gb.c: makes the GameShark writes at the start of vblank.
+void cheats_apply(struct cheats const *cheats, struct gb *gb);
+
+// For gb.c: puts the original ROM bytes back in a save state of a machine
+// with this list attached.
+void cheats_unpatch(struct cheats const *cheats, struct gb *state);
+
+// For gb.c: patches the ROM of a machine that a state was just loaded into.
+void cheats_repatch(struct cheats *cheats, struct gb *gb);
@@ -0,0 +1,217 @@
+#define _GNU_SOURCE     // for MSG_NOSIGNAL
+#include <errno.h>      // for errno, EINTR
+#include <inttypes.h>   // for PRId64
+#include <stddef.h>     // for NULL, size_t
+#include <stdint.h>     // for uint8_t, uint16_t, uint32_t, uint64_t
+#include <stdio.h>      // for fprintf, perror
+#include <stdlib.h>     // for malloc, free
+#include <string.h>     // for memcpy
+#include <sys/socket.h> // for socketpair, send, recv
+#include <unistd.h>     // for close, dup2, execl, fork, _exit, STDIN_FILENO
+
+#include "client.h"
+#include "server.h"
+
+#define HEADER_SIZE (8)
+
+struct client {
+    int fd;
+    char const *name; // For messages
+};
+
+static uint64_t get_u64(uint8_t const *const p) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static void put_u32(uint8_t *const p, uint32_t const value) {
+    for (size_t i = 0; i < 4; i++) {
+        p[i] = value >> (8 * i);
+    }
+}
+
+static int send_all(struct client *const client, uint8_t const *const data,
+                    size_t const size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t const n =
+            send(client->fd, data + done, size - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int recv_all(struct client *const client, uint8_t *const data,
+                    size_t const size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t const n = recv(client->fd, data + done, size - done, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Sends a request and reads its reply's header. Returns the size of the reply's
+// payload, which the caller reads, or -1 (after printing why) on failure.
+static int64_t request(struct client *const client,
+                       enum server_command const code,
+                       uint8_t const *const payload, uint32_t const size) {
+    uint8_t header[HEADER_SIZE] = {code};
+    put_u32(header + 4, size);
+    if (send_all(client, header, sizeof(header)) != 0 ||
+        send_all(client, payload, size) != 0 ||
+        recv_all(client, header, sizeof(header)) != 0) {
+        fprintf(stderr, "Lost the connection to %s!\n", client->name);
+        return -1;
+    }
+    if (header[0] != SERVER_OK) {
+        fprintf(stderr, "%s failed command %u with status %u!\n",
+                client->name, code, header[0]);
+        return -1;
+    }
+    return header[4] | header[5] << 8 | header[6] << 16 |
+           (uint32_t)header[7] << 24;
+}
+
+// Like request(), but reads a reply of exactly size bytes into out.
+static int call(struct client *const client, enum server_command const code,
+                uint8_t const *const payload, uint32_t const payload_size,
+                uint8_t *const out, size_t const size) {
+    int64_t const reply_size = request(client, code, payload, payload_size);
+    if (reply_size < 0) {
+        return -1;
+    }
+    if ((uint64_t)reply_size != size) {
+        fprintf(stderr, "%s sent a %" PRId64 "-byte reply to command %u!\n",
+                client->name, reply_size, code);
+        return -1;
+    }
+    if (recv_all(client, out, size) != 0) {
+        fprintf(stderr, "Lost the connection to %s!\n", client->name);
+        return -1;
+    }
+    return 0;
+}
+
+struct client *client_spawn(char const *const server_path,
+                            char const *const rom_path) {
+    struct client *const client = malloc(sizeof(*client));
+    if (client == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return NULL;
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        free(client);
+        return NULL;
+    }
+    pid_t const pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        if (dup2(fds[1], STDIN_FILENO) < 0) {
+            _exit(127);
+        }
+        execl(server_path, server_path, "-i", "-r", rom_path, (char *)NULL);
+        perror(server_path);
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        free(client);
+        return NULL;
+    }
+    *client = (struct client){.fd = fds[0], .name = server_path};
+    return client;
+}
+
+void client_close(struct client *const client) {
+    close(client->fd);
+    free(client);
+}
+
+int client_set_buttons(struct client *const client, uint8_t const buttons) {
+    return call(client, SERVER_SET_BUTTONS, &buttons, 1, NULL, 0);
+}
+
+int client_run_frames(struct client *const client, uint32_t const count) {
+    uint8_t payload[4];
+    put_u32(payload, count);
+    uint8_t frame_count[8];
+    return call(client, SERVER_RUN_FRAMES, payload, sizeof(payload),
+                frame_count, sizeof(frame_count));
+}
+
+int client_step(struct client *const client, uint32_t const count,
+                struct server_machine *const machine) {
+    uint8_t payload[4];
+    put_u32(payload, count);
+    uint8_t reply[8 * SERVER_MACHINE_FIELDS];
+    if (call(client, SERVER_STEP, payload, sizeof(payload), reply,
+             sizeof(reply)) != 0) {
+        return -1;
+    }
+    uint64_t fields[SERVER_MACHINE_FIELDS];
+    for (size_t i = 0; i < SERVER_MACHINE_FIELDS; i++) {
+        fields[i] = get_u64(reply + 8 * i);
+    }
+    memcpy(machine, fields, sizeof(fields));
+    return 0;
+}
+
+int client_hash_state(struct client *const client, uint64_t *const hash) {
+    uint8_t reply[8];
+    if (call(client, SERVER_HASH_STATE, NULL, 0, reply, sizeof(reply)) != 0) {
+        return -1;
+    }
+    *hash = get_u64(reply);
+    return 0;
+}
+
+int client_get_ram(struct client *const client, uint16_t const start,
+                   uint32_t const size, uint8_t *const out) {
+    uint8_t payload[6] = {start, start >> 8};
+    put_u32(payload + 2, size);
+    return call(client, SERVER_GET_RAM, payload, sizeof(payload), out, size);
+}
+
+int client_save_state(struct client *const client, uint8_t **const state,
+                      size_t *const size) {
+    int64_t const reply_size = request(client, SERVER_SAVE_STATE, NULL, 0);
+    if (reply_size < 0) {
+        return -1;
+    }
+    uint8_t *const buffer = malloc(reply_size);
+    if (buffer == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return -1; // The connection is out of sync now, so it's done for
+    }
+    if (recv_all(client, buffer, reply_size) != 0) {
+        fprintf(stderr, "Lost the connection to %s!\n", client->name);
+        free(buffer);
+        return -1;
+    }
+    *state = buffer;
+    *size = reply_size;
+    return 0;
+}
+
+int client_load_state(struct client *const client, uint8_t const *const state,
+                      size_t const size) {
+    return call(client, SERVER_LOAD_STATE, state, size, NULL, 0);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint32_t, uint64_t
+
+#include "server.h"
+
+// The client side of the gb-server protocol (see server.h), for driving a
+// machine in another process, which may be running a different build.
+
+// Starts server_path (a gb-server binary) serving just this client, over a
+// socket pair, with rom_path loaded. Returns NULL (after printing why) on
+// failure.
+struct client *client_spawn(char const *server_path, char const *rom_path);
+
+// Hangs up, which makes the server exit. It isn't waited for (gb.h's wait()
+// hides wait(2)), so it stays a zombie until the client exits too.
+void client_close(struct client *client);
+
+// Each request waits for its reply, and returns 0 on success, or -1 (after
+// printing why) on failure.
+
+int client_set_buttons(struct client *client, uint8_t buttons);
+
+int client_run_frames(struct client *client, uint32_t count);
+
+// count can be 0, to only describe the machine.
+int client_step(struct client *client, uint32_t count,
+                struct server_machine *machine);
+
+int client_hash_state(struct client *client, uint64_t *hash);
+
+int client_get_ram(struct client *client, uint16_t start, uint32_t size,
+                   uint8_t *out);
+
+// The state is malloc()ed, and in the server's own struct gb layout.
+int client_save_state(struct client *client, uint8_t **state, size_t *size);
+
+int client_load_state(struct client *client, uint8_t const *state,
+                      size_t size);
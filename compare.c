@@ -0,0 +1,189 @@
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint*_t
+#include <stdio.h>    // for printf
+#include <string.h>   // for memcmp
+
+#include "compare.h"
+#include "disasm.h"
+#include "engine.h"
+#include "gb.h"
+#include "hash.h"
+#include "inputs.h"
+#include "trace.h"
+
+#define MAX_REPORTED_BYTES (8)
+
+void window_record(struct window *const w, struct gb const *const gb) {
+    if (gb->halted) {
+        return;
+    }
+    struct trace_entry *const e = &w->entries[w->count++ % w->size];
+    *e = (struct trace_entry){
+        .cycle = gb->cycle_count,
+        .af = gb->af,
+        .bc = gb->bc,
+        .de = gb->de,
+        .hl = gb->hl,
+        .sp = gb->sp,
+        .pc = gb->pc,
+        .ime = gb->ime,
+    };
+    for (size_t i = 0; i < sizeof(e->pcmem); i++) {
+        e->pcmem[i] = gb->address_space[(uint16_t)(gb->pc + i)];
+    }
+}
+
+void window_print(char const *const name, struct window const *const w) {
+    uint64_t const first = w->count > w->size ? w->count - w->size : 0;
+    printf("Last %" PRIu64 " instructions on %s:\n", w->count - first, name);
+    for (uint64_t i = first; i < w->count; i++) {
+        struct trace_entry const *const e = &w->entries[i % w->size];
+        char mnemonic[32];
+        disassemble(e->pcmem, mnemonic, sizeof(mnemonic));
+        printf("  %12" PRIu64 " [0x%04" PRIX16 "]: %-16s A:%02X F:%02X "
+               "B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X\n",
+               e->cycle, e->pc, mnemonic, e->af >> 8, e->af & 0xffu,
+               e->bc >> 8, e->bc & 0xffu, e->de >> 8, e->de & 0xffu,
+               e->hl >> 8, e->hl & 0xffu, e->sp);
+    }
+}
+
+#define COMPARE(field)                                                         \
+    do {                                                                       \
+        if ((uint64_t)a->field != (uint64_t)b->field) {                        \
+            diverged = 1;                                                      \
+            if (print) {                                                       \
+                printf("  %-22s 0x%-16" PRIX64 " 0x%-16" PRIX64 "\n", #field,  \
+                       (uint64_t)a->field, (uint64_t)b->field);                \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+static uint1_t compare_bytes(char const *const name, uint8_t const *const a,
+                             uint8_t const *const b, size_t const size,
+                             uint1_t const print) {
+    if (memcmp(a, b, size) == 0) {
+        return 0;
+    } else if (!print) {
+        return 1;
+    }
+    size_t num_differing = 0;
+    for (size_t i = 0; i < size; i++) {
+        num_differing += a[i] != b[i];
+    }
+    printf("  %-22s 0x%016" PRIX64 " 0x%016" PRIX64 " (%zu bytes differ)\n",
+           name, hash64(a, size, 0), hash64(b, size, 0), num_differing);
+    size_t reported = 0;
+    for (size_t i = 0; i < size && reported < MAX_REPORTED_BYTES; i++) {
+        if (a[i] != b[i]) {
+            printf("    [0x%04zX] 0x%02X 0x%02X\n", i, a[i], b[i]);
+            reported++;
+        }
+    }
+    return 1;
+}
+
+uint1_t compare_machines(struct gb const *const a, struct gb const *const b,
+                         uint1_t const check_memory,
+                         uint1_t const check_screen, uint1_t const print) {
+    uint1_t diverged = 0;
+    COMPARE(af);
+    COMPARE(bc);
+    COMPARE(de);
+    COMPARE(hl);
+    COMPARE(sp);
+    COMPARE(pc);
+    COMPARE(ime);
+    COMPARE(halted);
+    COMPARE(fault);
+    COMPARE(need_to_do_interrupts);
+    COMPARE(cycle_count);
+    COMPARE(cycles_to_wait);
+    COMPARE(dot_count);
+    COMPARE(frame_count);
+    COMPARE(graphics_mode);
+    COMPARE(joypad_mode);
+    if (check_memory) {
+        diverged |= compare_bytes("memory", a->address_space, b->address_space,
+                                  sizeof(a->address_space), print);
+    }
+    if (check_screen) {
+        diverged |= compare_bytes("screen", &a->screen[0][0], &b->screen[0][0],
+                                  sizeof(a->screen), print);
+    }
+    return diverged;
+}
+
+// Runs the reference until it has caught up with the engine under test.
+static void catch_up(struct lockstep *const ls, uint64_t const steps,
+                     struct window *const window) {
+    for (uint64_t done = 0; done < steps;) {
+        if (window != NULL) {
+            window_record(window, ls->a);
+        }
+        done += engine_run(ls->reference);
+    }
+}
+
+void lockstep_run_frame(struct lockstep *const ls) {
+    if (ls->inputs != NULL) {
+        input_script_apply(ls->inputs, ls->a, ls->frame);
+        input_script_apply(ls->inputs, ls->b, ls->frame);
+    }
+    uint64_t const steps = engine_run_frame(ls->engine);
+    catch_up(ls, steps, NULL);
+    ls->steps += steps;
+    ls->frame++;
+}
+
+uint1_t lockstep_compare_frames(struct lockstep *const ls,
+                                uint64_t const num_frames) {
+    static struct window window_a;
+    static struct window window_b;
+    window_a.size = ls->window_size;
+    window_a.count = 0;
+    window_b.size = ls->window_size;
+    window_b.count = 0;
+
+    uint64_t next_memory_check = ls->steps + ls->memory_interval;
+    for (uint64_t i = 0; i < num_frames; i++) {
+        // a and b are identical here, so inputs land at the same point.
+        if (ls->inputs != NULL) {
+            input_script_apply(ls->inputs, ls->a, ls->frame);
+            input_script_apply(ls->inputs, ls->b, ls->frame);
+        }
+
+        // The same frame boundaries as engine_run_frame()
+        uint64_t const start_frame = ls->b->frame_count;
+        uint64_t const start_cycle = ls->b->cycle_count;
+        while (ls->b->frame_count == start_frame &&
+               ls->b->cycle_count - start_cycle < CYCLES_PER_FRAME) {
+            window_record(&window_b, ls->b);
+            uint64_t const steps = engine_run(ls->engine);
+            catch_up(ls, steps, &window_a);
+            ls->steps += steps;
+
+            uint1_t const check_memory = ls->steps >= next_memory_check;
+            if (check_memory) {
+                next_memory_check = ls->steps + ls->memory_interval;
+            }
+            // The screen only changes when a frame is drawn.
+            uint1_t const check_screen = ls->b->frame_count != start_frame;
+            if (compare_machines(ls->a, ls->b, check_memory, check_screen,
+                                 0)) {
+                printf("Divergence after %" PRIu64 " steps (cycle %" PRIu64
+                       ", frame %" PRIu64 "):\n",
+                       ls->steps, ls->a->cycle_count, ls->frame);
+                printf("  %-22s %-18s %-18s\n", "",
+                       ls->reference->engine->name, ls->engine->engine->name);
+                compare_machines(ls->a, ls->b, check_memory, check_screen, 1);
+                window_print(ls->reference->engine->name, &window_a);
+                window_print(ls->engine->engine->name, &window_b);
+                return 1;
+            }
+        }
+        ls->frame++;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include "engine.h"
+#include "gb.h"
+#include "inputs.h"
+#include "trace.h"
+
+// Comparing two machines that should be running identically: a reference
+// engine on one, and an engine under test on the other.
+
+#define MAX_WINDOW (256)
+
+// The last few states a machine was in before executing an instruction.
+struct window {
+    struct trace_entry entries[MAX_WINDOW];
+    size_t size; // At most MAX_WINDOW
+    uint64_t count;
+};
+
+void window_record(struct window *w, struct gb const *gb);
+
+void window_print(char const *name, struct window const *w);
+
+// Returns whether a and b differ, printing the differences if print is set.
+// Memory and the screen are only compared when asked, since they're big.
+uint1_t compare_machines(struct gb const *a, struct gb const *b,
+                         uint1_t check_memory, uint1_t check_screen,
+                         uint1_t print);
+
+struct lockstep {
+    struct engine_instance *reference;
+    struct gb *a; // reference->gb
+    struct engine_instance *engine;
+    struct gb *b; // engine->gb
+    struct input_script const *inputs; // May be NULL
+    uint64_t memory_interval; // Compare memory every this many steps
+    size_t window_size;
+    uint64_t frame; // The frame number, for inputs; advanced as frames run
+    uint64_t steps; // Steps run so far
+};
+
+// Runs one frame on both machines, without comparing them: a frame on the
+// engine under test, then the same number of steps on the reference.
+void lockstep_run_frame(struct lockstep *ls);
+
+// Runs num_frames frames, comparing the machines after every block the engine
+// under test runs. Returns 1, after printing a report, if they diverge.
+uint1_t lockstep_compare_frames(struct lockstep *ls, uint64_t num_frames);
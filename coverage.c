@@ -0,0 +1,122 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint64_t
+#include <stdio.h>  // for fopen, fread, fwrite, fclose
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memcmp, memcpy, memset
+
+#include "coverage.h"
+#include "gb.h"
+
+// Spreads consecutive addresses over the edge map. Odd, so every address gets
+// its own location.
+#define LOCATION_MULTIPLIER (0x9E37u)
+
+struct coverage *coverage_open(void) {
+    return calloc(1, sizeof(struct coverage));
+}
+
+void coverage_close(struct coverage *const coverage) {
+    free(coverage);
+}
+
+void coverage_reset(struct coverage *const coverage) {
+    memset(coverage, 0, sizeof(*coverage));
+}
+
+void coverage_restart(struct coverage *const coverage) {
+    coverage->prev_location = 0;
+}
+
+void coverage_record(struct coverage *const coverage, uint16_t const pc) {
+    uint64_t *const words =
+        pc < COVERAGE_NUM_BANKS * COVERAGE_BANK_SIZE
+            ? coverage->rom[pc / COVERAGE_BANK_SIZE]
+            : coverage->ram;
+    uint16_t const offset =
+        pc < COVERAGE_NUM_BANKS * COVERAGE_BANK_SIZE
+            ? pc % COVERAGE_BANK_SIZE
+            : pc - COVERAGE_NUM_BANKS * COVERAGE_BANK_SIZE;
+    words[offset / 64] |= (uint64_t)1 << (offset % 64);
+
+    uint16_t const location = pc * LOCATION_MULTIPLIER;
+    uint8_t *const counter =
+        &coverage->edges[location ^ coverage->prev_location];
+    *counter += *counter != UINT8_MAX;
+    coverage->prev_location = location >> 1;
+}
+
+void coverage_merge(struct coverage *const into,
+                    struct coverage const *const from) {
+    for (size_t b = 0; b < COVERAGE_NUM_BANKS; b++) {
+        for (size_t i = 0; i < COVERAGE_BANK_SIZE / 64; i++) {
+            into->rom[b][i] |= from->rom[b][i];
+        }
+    }
+    for (size_t i = 0; i < COVERAGE_RAM_SIZE / 64; i++) {
+        into->ram[i] |= from->ram[i];
+    }
+    for (size_t i = 0; i < COVERAGE_EDGE_MAP_SIZE; i++) {
+        unsigned const sum = into->edges[i] + from->edges[i];
+        into->edges[i] = sum > UINT8_MAX ? UINT8_MAX : sum;
+    }
+}
+
+size_t coverage_count_bank(struct coverage const *const coverage,
+                           size_t const bank) {
+    size_t count = 0;
+    for (size_t i = 0; i < COVERAGE_BANK_SIZE / 64; i++) {
+        count += __builtin_popcountll(coverage->rom[bank][i]);
+    }
+    return count;
+}
+
+size_t coverage_count_edges(struct coverage const *const coverage) {
+    size_t count = 0;
+    for (size_t i = 0; i < COVERAGE_EDGE_MAP_SIZE; i++) {
+        count += coverage->edges[i] != 0;
+    }
+    return count;
+}
+
+static struct coverage_file_header make_header(void) {
+    struct coverage_file_header header = {
+        .version = COVERAGE_VERSION,
+        .num_banks = COVERAGE_NUM_BANKS,
+        .bank_size = COVERAGE_BANK_SIZE,
+    };
+    memcpy(header.magic, COVERAGE_MAGIC, sizeof(header.magic));
+    return header;
+}
+
+int coverage_write(struct coverage const *const coverage,
+                   char const *const path) {
+    FILE *const f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    struct coverage_file_header const header = make_header();
+    uint1_t const ok =
+        fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(coverage->rom, sizeof(coverage->rom), 1, f) == 1 &&
+        fwrite(coverage->ram, sizeof(coverage->ram), 1, f) == 1 &&
+        fwrite(coverage->edges, sizeof(coverage->edges), 1, f) == 1;
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+int coverage_read(struct coverage *const coverage, char const *const path) {
+    FILE *const f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    struct coverage_file_header header;
+    struct coverage_file_header const expected = make_header();
+    uint1_t const ok =
+        fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(&header, &expected, sizeof(header)) == 0 &&
+        fread(coverage->rom, sizeof(coverage->rom), 1, f) == 1 &&
+        fread(coverage->ram, sizeof(coverage->ram), 1, f) == 1 &&
+        fread(coverage->edges, sizeof(coverage->edges), 1, f) == 1;
+    fclose(f);
+    coverage->prev_location = 0;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint32_t, uint64_t
+
+#include "gb.h"
+
+// Guest code coverage, recorded by step() before every instruction while a
+// coverage map is attached (gb->coverage). There are two maps:
+//
+// - Which instruction addresses have been executed: a bitmap per ROM bank
+//   (with no MBC support, only the two fixed banks), and one for code run from
+//   RAM at 0x8000 and up. Bit i of word w is offset 64 * w + i.
+// - AFL-style edge coverage: each instruction's address maps to a 16-bit
+//   location, and (previous location >> 1) ^ location indexes an 8-bit hit
+//   counter, so that new transitions between instructions, and new loop
+//   counts, show up as new bytes. Counters stick at 255 rather than wrapping.
+//   The map is the size of AFL's, so it can be copied straight into a
+//   fuzzer's.
+
+#define COVERAGE_BANK_SIZE (0x4000)
+#define COVERAGE_NUM_BANKS (2)
+#define COVERAGE_RAM_SIZE (0x8000)
+#define COVERAGE_EDGE_MAP_SIZE (1 << 16)
+
+#define COVERAGE_MAGIC ("GBCV")
+#define COVERAGE_VERSION (1)
+
+struct coverage {
+    uint64_t rom[COVERAGE_NUM_BANKS][COVERAGE_BANK_SIZE / 64];
+    uint64_t ram[COVERAGE_RAM_SIZE / 64];
+    uint8_t edges[COVERAGE_EDGE_MAP_SIZE];
+    uint16_t prev_location;
+};
+
+// A coverage file is this header followed by rom, ram and edges as above, in
+// host byte order.
+struct coverage_file_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_banks;
+    uint32_t bank_size;
+};
+
+// Returns an empty map, or NULL on allocation failure.
+struct coverage *coverage_open(void);
+
+void coverage_close(struct coverage *coverage);
+
+// Empties the map, e.g., between fuzzing runs.
+void coverage_reset(struct coverage *coverage);
+
+// Starts a new path through the edge map without clearing anything, so that
+// the first instruction of the next run doesn't count as an edge from the
+// last instruction of the previous one.
+void coverage_restart(struct coverage *coverage);
+
+// Records an instruction about to execute at pc. Called by step() for a gb
+// with this map attached; see struct gb.
+void coverage_record(struct coverage *coverage, uint16_t pc);
+
+// Adds everything in from into into: executed addresses are ORed together,
+// and edge counters added (sticking at 255).
+void coverage_merge(struct coverage *into, struct coverage const *from);
+
+// The number of executed instruction addresses in a ROM bank.
+size_t coverage_count_bank(struct coverage const *coverage, size_t bank);
+
+// The number of edge counters that aren't 0.
+size_t coverage_count_edges(struct coverage const *coverage);
+
+// Writes the map to path. Returns 0 on success, or -1 on failure.
+int coverage_write(struct coverage const *coverage, char const *path);
+
+// Reads a map written by coverage_write(). Returns 0 on success, or -1 if the
+// file is missing, truncated or for a different layout.
+int coverage_read(struct coverage *coverage, char const *path);
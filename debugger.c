@@ -0,0 +1,169 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint64_t
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memset
+
+#include "debugger.h"
+#include "gb.h"
+
+#define PAGE_SIZE (DEBUGGER_PAGE_SIZE)
+#define NUM_PAGES (DEBUGGER_NUM_PAGES)
+#define LCD_CONTROL_ADDRESS (0xFF40)
+
+struct debugger *debugger_open(void) {
+    return calloc(1, sizeof(struct debugger));
+}
+
+void debugger_close(struct debugger *const debugger) {
+    free(debugger);
+}
+
+static uint1_t has_breakpoint(struct debugger const *const debugger,
+                              uint16_t const pc) {
+    return (debugger->breakpoints[pc / 64] >> (pc % 64)) & 1;
+}
+
+// Rebuilds the page flags from scratch; breakpoints and watchpoints change
+// rarely enough that this is simpler than counting per page.
+static void update_pages(struct debugger *const debugger) {
+    memset(debugger->pages, 0, sizeof(debugger->pages));
+    for (size_t p = 0; p < NUM_PAGES; p++) {
+        for (size_t w = 0; w < PAGE_SIZE / 64; w++) {
+            if (debugger->breakpoints[p * (PAGE_SIZE / 64) + w] != 0) {
+                debugger->pages[p] |= PAGE_BREAK;
+            }
+        }
+    }
+    for (size_t i = 0; i < debugger->num_watchpoints; i++) {
+        struct watchpoint const *const w = &debugger->watchpoints[i];
+        uint8_t const flags = ((w->kind & WATCH_READ) ? PAGE_READ : 0) |
+                              ((w->kind & WATCH_WRITE) ? PAGE_WRITE : 0);
+        size_t const last = w->address + w->length - 1u;
+        for (size_t p = w->address / PAGE_SIZE; p <= last / PAGE_SIZE; p++) {
+            debugger->pages[p] |= flags;
+        }
+    }
+}
+
+void debugger_add_breakpoint(struct debugger *const debugger,
+                             uint16_t const pc) {
+    debugger->breakpoints[pc / 64] |= (uint64_t)1 << (pc % 64);
+    debugger->pages[pc / PAGE_SIZE] |= PAGE_BREAK;
+}
+
+void debugger_remove_breakpoint(struct debugger *const debugger,
+                                uint16_t const pc) {
+    debugger->breakpoints[pc / 64] &= ~((uint64_t)1 << (pc % 64));
+    update_pages(debugger);
+}
+
+int debugger_add_watchpoint(struct debugger *const debugger,
+                            struct watchpoint const *const watchpoint) {
+    if (debugger->num_watchpoints == MAX_WATCHPOINTS ||
+        watchpoint->length == 0 ||
+        watchpoint->address + watchpoint->length > 0x10000 ||
+        (watchpoint->kind & ~WATCH_ACCESS) != 0 || watchpoint->kind == 0) {
+        return -1;
+    }
+    debugger->watchpoints[debugger->num_watchpoints++] = *watchpoint;
+    update_pages(debugger);
+    return 0;
+}
+
+size_t debugger_remove_watchpoint(struct debugger *const debugger,
+                                  struct watchpoint const *const watchpoint) {
+    size_t kept = 0;
+    for (size_t i = 0; i < debugger->num_watchpoints; i++) {
+        struct watchpoint const *const w = &debugger->watchpoints[i];
+        if (w->address != watchpoint->address ||
+            w->length != watchpoint->length || w->kind != watchpoint->kind) {
+            debugger->watchpoints[kept++] = *w;
+        }
+    }
+    size_t const removed = debugger->num_watchpoints - kept;
+    debugger->num_watchpoints = kept;
+    update_pages(debugger);
+    return removed;
+}
+
+void debugger_resume(struct debugger *const debugger) {
+    debugger->resuming = 1;
+}
+
+void debugger_last_hit(struct debugger const *const debugger,
+                       struct debug_hit *const out) {
+    *out = debugger->hit;
+}
+
+// Records the first watchpoint hit by the current instruction, if any.
+static void check_watchpoints(struct debugger *const debugger,
+                              enum watch_kind const kind,
+                              uint16_t const address, uint8_t const value) {
+    if (debugger->hit.reason != STOP_DONE) {
+        return;
+    }
+    for (size_t i = 0; i < debugger->num_watchpoints; i++) {
+        struct watchpoint const *const w = &debugger->watchpoints[i];
+        if ((w->kind & kind) && w->address <= address &&
+            address - w->address < w->length &&
+            (!w->has_value || w->value == value)) {
+            debugger->hit = (struct debug_hit){
+                .reason = kind == WATCH_READ ? STOP_WATCH_READ
+                                             : STOP_WATCH_WRITE,
+                .pc = debugger->pc,
+                .address = address,
+                .value = value,
+            };
+            return;
+        }
+    }
+}
+
+void debugger_on_read(struct debugger *const debugger, uint16_t const address,
+                      uint8_t const value) {
+    if (debugger->armed) {
+        check_watchpoints(debugger, WATCH_READ, address, value);
+    }
+}
+
+void debugger_on_write(struct debugger *const debugger, uint16_t const address,
+                       uint8_t const value) {
+    if (debugger->armed) {
+        check_watchpoints(debugger, WATCH_WRITE, address, value);
+    }
+}
+
+enum stop_reason debugger_run(struct gb *const gb, uint1_t const whole_frame,
+                              uint64_t const cycles) {
+    struct debugger *const debugger = gb->debugger;
+    uint64_t const start_frame = gb->frame_count;
+    uint64_t const start_cycle = gb->cycle_count;
+    uint1_t const resuming = debugger->resuming;
+    debugger->resuming = 0;
+    debugger->hit.reason = STOP_DONE;
+    for (uint1_t first = 1;; first = 0) {
+        uint64_t const elapsed = gb->cycle_count - start_cycle;
+        uint1_t const lcd_on = gb->address_space[LCD_CONTROL_ADDRESS] >> 7;
+        if (whole_frame ? gb->frame_count != start_frame ||
+                              (!lcd_on && elapsed >= CYCLES_PER_FRAME)
+                        : elapsed >= cycles) {
+            return gb->fault != FAULT_NONE ? STOP_FAULT : STOP_DONE;
+        }
+        if (!(first && resuming) && (debugger->pages[gb->pc / PAGE_SIZE] & PAGE_BREAK) &&
+            has_breakpoint(debugger, gb->pc)) {
+            debugger->hit = (struct debug_hit){
+                .reason = STOP_BREAKPOINT,
+                .pc = gb->pc,
+            };
+            return STOP_BREAKPOINT;
+        }
+        debugger->pc = gb->pc;
+        debugger->armed = 1;
+        step(gb);
+        debugger->armed = 0;
+        wait(gb);
+        if (debugger->hit.reason != STOP_DONE) {
+            return debugger->hit.reason;
+        }
+    }
+}
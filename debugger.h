@@ -0,0 +1,103 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint64_t
+
+#include "gb.h"
+
+// Breakpoints and watchpoints. A machine only pays for them while a debugger
+// is attached (gb->debugger), and even then each memory access only costs a
+// lookup in a table of 256-byte pages unless its page has a watchpoint. While
+// one is attached, run_frame() and run_cycles() check for breakpoints before
+// every instruction (again by page first) and stop early on a hit, returning
+// why.
+//
+// Only the data accesses of the CPU's instructions count: fetching opcodes
+// and operands doesn't trigger watchpoints, and neither do the PPU and timers
+// reading and writing their registers. A watchpoint stops execution after the
+// instruction that made the access.
+
+#define MAX_WATCHPOINTS (32)
+
+#define DEBUGGER_PAGE_SIZE (0x100)
+#define DEBUGGER_NUM_PAGES (0x10000 / DEBUGGER_PAGE_SIZE)
+
+enum page_flag {
+    PAGE_BREAK = 1, // A breakpoint is somewhere in the page
+    PAGE_READ = 2,  // A read watchpoint overlaps the page
+    PAGE_WRITE = 4, // A write watchpoint overlaps the page
+};
+
+enum watch_kind {
+    WATCH_READ = 1,
+    WATCH_WRITE = 2,
+    WATCH_ACCESS = 3, // Either
+};
+
+struct watchpoint {
+    uint16_t address;
+    uint16_t length; // Bytes from address; at least 1
+    enum watch_kind kind;
+    uint1_t has_value; // If set, only accesses of this value count
+    uint8_t value;
+};
+
+struct debug_hit {
+    enum stop_reason reason;
+    uint16_t pc;      // Of the instruction that hit
+    uint16_t address; // For watchpoints, the address accessed
+    uint8_t value;    // For watchpoints, the value read or written
+};
+
+// Defined here so that gb.c can check the page flags without a call. Only
+// change it through the functions below.
+struct debugger {
+    uint8_t pages[DEBUGGER_NUM_PAGES]; // enum page_flag bits
+    uint64_t breakpoints[0x10000 / 64];
+    struct watchpoint watchpoints[MAX_WATCHPOINTS];
+    size_t num_watchpoints;
+    uint1_t armed;    // Set while the CPU is executing an instruction
+    uint1_t resuming; // See debugger_resume()
+    uint16_t pc;      // Of that instruction
+    struct debug_hit hit;
+};
+
+struct debugger *debugger_open(void);
+
+void debugger_close(struct debugger *debugger);
+
+void debugger_add_breakpoint(struct debugger *debugger, uint16_t pc);
+
+void debugger_remove_breakpoint(struct debugger *debugger, uint16_t pc);
+
+// Returns 0 on success, or -1 if the watchpoint is invalid or there are
+// already MAX_WATCHPOINTS.
+int debugger_add_watchpoint(struct debugger *debugger,
+                            struct watchpoint const *watchpoint);
+
+// Removes every watchpoint with the same address, length and kind. Returns
+// the number removed.
+size_t debugger_remove_watchpoint(struct debugger *debugger,
+                                  struct watchpoint const *watchpoint);
+
+// Makes the next run_frame() or run_cycles() ignore a breakpoint at the
+// instruction it starts on, so that execution can continue from one. Every
+// other run stops at a breakpoint even before its first instruction.
+void debugger_resume(struct debugger *debugger);
+
+// Why the last run_frame() or run_cycles() stopped, and where. Only reason is
+// set if it ran to the end (STOP_DONE).
+void debugger_last_hit(struct debugger const *debugger, struct debug_hit *out);
+
+// For gb.c: the run loop used while a debugger is attached. It runs until
+// vblank (or a frame's worth of cycles with the LCD off) if whole_frame is
+// set, and for at least cycles M-cycles otherwise.
+enum stop_reason debugger_run(struct gb *gb, uint1_t whole_frame,
+                              uint64_t cycles);
+
+// For gb.c: reports a bus access to a page flagged PAGE_READ or PAGE_WRITE,
+// made while gb->debugger is attached.
+void debugger_on_read(struct debugger *debugger, uint16_t address,
+                      uint8_t value);
+
+void debugger_on_write(struct debugger *debugger, uint16_t address,
+                       uint8_t value);
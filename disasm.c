@@ -0,0 +1,341 @@
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint8_t, uint16_t, int8_t
+#include <stdio.h>    // for snprintf
+
+#include "disasm.h"
+
+// One entry per opcode, spelled the way step() spells it.
+struct opcode_info const OPCODE_INFO[0x100] = {
+    [0x00] = {"NOP", OPERAND_NONE, "", 1},
+    [0x01] = {"LD BC, 0x", OPERAND_HEX16, "", 3},
+    [0x02] = {"LD (BC), A", OPERAND_NONE, "", 1},
+    [0x03] = {"INC BC", OPERAND_NONE, "", 1},
+    [0x04] = {"INC B", OPERAND_NONE, "", 1},
+    [0x05] = {"DEC B", OPERAND_NONE, "", 1},
+    [0x06] = {"LD B, ", OPERAND_U8, "", 2},
+    [0x07] = {"RLCA", OPERAND_NONE, "", 1},
+    [0x08] = {"LD (0x", OPERAND_HEX16_SHORT, "), SP", 3},
+    [0x09] = {"ADD HL, BC", OPERAND_NONE, "", 1},
+    [0x0A] = {"LD A, (BC)", OPERAND_NONE, "", 1},
+    [0x0B] = {"DEC BC", OPERAND_NONE, "", 1},
+    [0x0C] = {"INC C", OPERAND_NONE, "", 1},
+    [0x0D] = {"DEC C", OPERAND_NONE, "", 1},
+    [0x0E] = {"LD C, ", OPERAND_U8, "", 2},
+    [0x0F] = {"RRCA", OPERAND_NONE, "", 1},
+    [0x10] = {"STOP", OPERAND_NONE, "", 2},
+    [0x11] = {"LD DE, 0x", OPERAND_HEX16, "", 3},
+    [0x12] = {"LD (DE), A", OPERAND_NONE, "", 1},
+    [0x13] = {"INC DE", OPERAND_NONE, "", 1},
+    [0x14] = {"INC D", OPERAND_NONE, "", 1},
+    [0x15] = {"DEC D", OPERAND_NONE, "", 1},
+    [0x16] = {"LD D, ", OPERAND_U8, "", 2},
+    [0x17] = {"RLA", OPERAND_NONE, "", 1},
+    [0x18] = {"JR ", OPERAND_REL8, "", 2},
+    [0x19] = {"ADD HL, DE", OPERAND_NONE, "", 1},
+    [0x1A] = {"LD A, (DE)", OPERAND_NONE, "", 1},
+    [0x1B] = {"DEC DE", OPERAND_NONE, "", 1},
+    [0x1C] = {"INC E", OPERAND_NONE, "", 1},
+    [0x1D] = {"DEC E", OPERAND_NONE, "", 1},
+    [0x1E] = {"LD E, ", OPERAND_U8, "", 2},
+    [0x1F] = {"RRA", OPERAND_NONE, "", 1},
+    [0x20] = {"JR NZ, ", OPERAND_REL8, "", 2},
+    [0x21] = {"LD HL, 0x", OPERAND_HEX16, "", 3},
+    [0x22] = {"LD (HLI), A", OPERAND_NONE, "", 1},
+    [0x23] = {"INC HL", OPERAND_NONE, "", 1},
+    [0x24] = {"INC H", OPERAND_NONE, "", 1},
+    [0x25] = {"DEC H", OPERAND_NONE, "", 1},
+    [0x26] = {"LD H, ", OPERAND_U8, "", 2},
+    [0x27] = {"DAA", OPERAND_NONE, "", 1},
+    [0x28] = {"JR Z, ", OPERAND_REL8, "", 2},
+    [0x29] = {"ADD HL, HL", OPERAND_NONE, "", 1},
+    [0x2A] = {"LD A, (HLI)", OPERAND_NONE, "", 1},
+    [0x2B] = {"DEC HL", OPERAND_NONE, "", 1},
+    [0x2C] = {"INC L", OPERAND_NONE, "", 1},
+    [0x2D] = {"DEC L", OPERAND_NONE, "", 1},
+    [0x2E] = {"LD L, ", OPERAND_U8, "", 2},
+    [0x2F] = {"CPL", OPERAND_NONE, "", 1},
+    [0x30] = {"JR NC, ", OPERAND_REL8, "", 2},
+    [0x31] = {"LD SP, 0x", OPERAND_HEX16, "", 3},
+    [0x32] = {"LD (HLD), A", OPERAND_NONE, "", 1},
+    [0x33] = {"INC SP", OPERAND_NONE, "", 1},
+    [0x34] = {"INC (HL)", OPERAND_NONE, "", 1},
+    [0x35] = {"DEC (HL)", OPERAND_NONE, "", 1},
+    [0x36] = {"LD (HL), ", OPERAND_U8, "", 2},
+    [0x37] = {"SCF", OPERAND_NONE, "", 1},
+    [0x38] = {"JR C, ", OPERAND_REL8, "", 2},
+    [0x39] = {"ADD HL, SP", OPERAND_NONE, "", 1},
+    [0x3A] = {"LD A, (HLD)", OPERAND_NONE, "", 1},
+    [0x3B] = {"DEC SP", OPERAND_NONE, "", 1},
+    [0x3C] = {"INC A", OPERAND_NONE, "", 1},
+    [0x3D] = {"DEC A", OPERAND_NONE, "", 1},
+    [0x3E] = {"LD A, ", OPERAND_U8, "", 2},
+    [0x3F] = {"CCF", OPERAND_NONE, "", 1},
+    [0x40] = {"LD B, B", OPERAND_NONE, "", 1},
+    [0x41] = {"LD B, C", OPERAND_NONE, "", 1},
+    [0x42] = {"LD B, D", OPERAND_NONE, "", 1},
+    [0x43] = {"LD B, E", OPERAND_NONE, "", 1},
+    [0x44] = {"LD B, H", OPERAND_NONE, "", 1},
+    [0x45] = {"LD B, L", OPERAND_NONE, "", 1},
+    [0x46] = {"LD B, (HL)", OPERAND_NONE, "", 1},
+    [0x47] = {"LD B, A", OPERAND_NONE, "", 1},
+    [0x48] = {"LD C, B", OPERAND_NONE, "", 1},
+    [0x49] = {"LD C, C", OPERAND_NONE, "", 1},
+    [0x4A] = {"LD C, D", OPERAND_NONE, "", 1},
+    [0x4B] = {"LD C, E", OPERAND_NONE, "", 1},
+    [0x4C] = {"LD C, H", OPERAND_NONE, "", 1},
+    [0x4D] = {"LD C, L", OPERAND_NONE, "", 1},
+    [0x4E] = {"LD C, (HL)", OPERAND_NONE, "", 1},
+    [0x4F] = {"LD C, A", OPERAND_NONE, "", 1},
+    [0x50] = {"LD D, B", OPERAND_NONE, "", 1},
+    [0x51] = {"LD D, C", OPERAND_NONE, "", 1},
+    [0x52] = {"LD D, D", OPERAND_NONE, "", 1},
+    [0x53] = {"LD D, E", OPERAND_NONE, "", 1},
+    [0x54] = {"LD D, H", OPERAND_NONE, "", 1},
+    [0x55] = {"LD D, L", OPERAND_NONE, "", 1},
+    [0x56] = {"LD D, (HL)", OPERAND_NONE, "", 1},
+    [0x57] = {"LD D, A", OPERAND_NONE, "", 1},
+    [0x58] = {"LD E, B", OPERAND_NONE, "", 1},
+    [0x59] = {"LD E, C", OPERAND_NONE, "", 1},
+    [0x5A] = {"LD E, D", OPERAND_NONE, "", 1},
+    [0x5B] = {"LD E, E", OPERAND_NONE, "", 1},
+    [0x5C] = {"LD E, H", OPERAND_NONE, "", 1},
+    [0x5D] = {"LD E, L", OPERAND_NONE, "", 1},
+    [0x5E] = {"LD E, (HL)", OPERAND_NONE, "", 1},
+    [0x5F] = {"LD E, A", OPERAND_NONE, "", 1},
+    [0x60] = {"LD H, B", OPERAND_NONE, "", 1},
+    [0x61] = {"LD H, C", OPERAND_NONE, "", 1},
+    [0x62] = {"LD H, D", OPERAND_NONE, "", 1},
+    [0x63] = {"LD H, E", OPERAND_NONE, "", 1},
+    [0x64] = {"LD H, H", OPERAND_NONE, "", 1},
+    [0x65] = {"LD H, L", OPERAND_NONE, "", 1},
+    [0x66] = {"LD H, (HL)", OPERAND_NONE, "", 1},
+    [0x67] = {"LD H, A", OPERAND_NONE, "", 1},
+    [0x68] = {"LD L, B", OPERAND_NONE, "", 1},
+    [0x69] = {"LD L, C", OPERAND_NONE, "", 1},
+    [0x6A] = {"LD L, D", OPERAND_NONE, "", 1},
+    [0x6B] = {"LD L, E", OPERAND_NONE, "", 1},
+    [0x6C] = {"LD L, H", OPERAND_NONE, "", 1},
+    [0x6D] = {"LD L, L", OPERAND_NONE, "", 1},
+    [0x6E] = {"LD L, (HL)", OPERAND_NONE, "", 1},
+    [0x6F] = {"LD L, A", OPERAND_NONE, "", 1},
+    [0x70] = {"LD (HL), B", OPERAND_NONE, "", 1},
+    [0x71] = {"LD (HL), C", OPERAND_NONE, "", 1},
+    [0x72] = {"LD (HL), D", OPERAND_NONE, "", 1},
+    [0x73] = {"LD (HL), E", OPERAND_NONE, "", 1},
+    [0x74] = {"LD (HL), H", OPERAND_NONE, "", 1},
+    [0x75] = {"LD (HL), L", OPERAND_NONE, "", 1},
+    [0x76] = {"HALT", OPERAND_NONE, "", 1},
+    [0x77] = {"LD (HL), A", OPERAND_NONE, "", 1},
+    [0x78] = {"LD A, B", OPERAND_NONE, "", 1},
+    [0x79] = {"LD A, C", OPERAND_NONE, "", 1},
+    [0x7A] = {"LD A, D", OPERAND_NONE, "", 1},
+    [0x7B] = {"LD A, E", OPERAND_NONE, "", 1},
+    [0x7C] = {"LD A, H", OPERAND_NONE, "", 1},
+    [0x7D] = {"LD A, L", OPERAND_NONE, "", 1},
+    [0x7E] = {"LD A, (HL)", OPERAND_NONE, "", 1},
+    [0x7F] = {"LD A, A", OPERAND_NONE, "", 1},
+    [0x80] = {"ADD A, B", OPERAND_NONE, "", 1},
+    [0x81] = {"ADD A, C", OPERAND_NONE, "", 1},
+    [0x82] = {"ADD A, D", OPERAND_NONE, "", 1},
+    [0x83] = {"ADD A, E", OPERAND_NONE, "", 1},
+    [0x84] = {"ADD A, H", OPERAND_NONE, "", 1},
+    [0x85] = {"ADD A, L", OPERAND_NONE, "", 1},
+    [0x86] = {"ADD A, (HL)", OPERAND_NONE, "", 1},
+    [0x87] = {"ADD A, A", OPERAND_NONE, "", 1},
+    [0x88] = {"ADC A, B", OPERAND_NONE, "", 1},
+    [0x89] = {"ADC A, C", OPERAND_NONE, "", 1},
+    [0x8A] = {"ADC A, D", OPERAND_NONE, "", 1},
+    [0x8B] = {"ADC A, E", OPERAND_NONE, "", 1},
+    [0x8C] = {"ADC A, H", OPERAND_NONE, "", 1},
+    [0x8D] = {"ADC A, L", OPERAND_NONE, "", 1},
+    [0x8E] = {"ADC A, (HL)", OPERAND_NONE, "", 1},
+    [0x8F] = {"ADC A, A", OPERAND_NONE, "", 1},
+    [0x90] = {"SUB A, B", OPERAND_NONE, "", 1},
+    [0x91] = {"SUB A, C", OPERAND_NONE, "", 1},
+    [0x92] = {"SUB A, D", OPERAND_NONE, "", 1},
+    [0x93] = {"SUB A, E", OPERAND_NONE, "", 1},
+    [0x94] = {"SUB A, H", OPERAND_NONE, "", 1},
+    [0x95] = {"SUB A, L", OPERAND_NONE, "", 1},
+    [0x96] = {"SUB A, (HL)", OPERAND_NONE, "", 1},
+    [0x97] = {"SUB A, A", OPERAND_NONE, "", 1},
+    [0x98] = {"SBC A, B", OPERAND_NONE, "", 1},
+    [0x99] = {"SBC A, C", OPERAND_NONE, "", 1},
+    [0x9A] = {"SBC A, D", OPERAND_NONE, "", 1},
+    [0x9B] = {"SBC A, E", OPERAND_NONE, "", 1},
+    [0x9C] = {"SBC A, H", OPERAND_NONE, "", 1},
+    [0x9D] = {"SBC A, L", OPERAND_NONE, "", 1},
+    [0x9E] = {"SBC A, (HL)", OPERAND_NONE, "", 1},
+    [0x9F] = {"SBC A, A", OPERAND_NONE, "", 1},
+    [0xA0] = {"AND A, B", OPERAND_NONE, "", 1},
+    [0xA1] = {"AND A, C", OPERAND_NONE, "", 1},
+    [0xA2] = {"AND A, D", OPERAND_NONE, "", 1},
+    [0xA3] = {"AND A, E", OPERAND_NONE, "", 1},
+    [0xA4] = {"AND A, H", OPERAND_NONE, "", 1},
+    [0xA5] = {"AND A, L", OPERAND_NONE, "", 1},
+    [0xA6] = {"AND A, (HL)", OPERAND_NONE, "", 1},
+    [0xA7] = {"AND A, A", OPERAND_NONE, "", 1},
+    [0xA8] = {"XOR A, B", OPERAND_NONE, "", 1},
+    [0xA9] = {"XOR A, C", OPERAND_NONE, "", 1},
+    [0xAA] = {"XOR A, D", OPERAND_NONE, "", 1},
+    [0xAB] = {"XOR A, E", OPERAND_NONE, "", 1},
+    [0xAC] = {"XOR A, H", OPERAND_NONE, "", 1},
+    [0xAD] = {"XOR A, L", OPERAND_NONE, "", 1},
+    [0xAE] = {"XOR A, (HL)", OPERAND_NONE, "", 1},
+    [0xAF] = {"XOR A, A", OPERAND_NONE, "", 1},
+    [0xB0] = {"OR A, B", OPERAND_NONE, "", 1},
+    [0xB1] = {"OR A, C", OPERAND_NONE, "", 1},
+    [0xB2] = {"OR A, D", OPERAND_NONE, "", 1},
+    [0xB3] = {"OR A, E", OPERAND_NONE, "", 1},
+    [0xB4] = {"OR A, H", OPERAND_NONE, "", 1},
+    [0xB5] = {"OR A, L", OPERAND_NONE, "", 1},
+    [0xB6] = {"OR A, (HL)", OPERAND_NONE, "", 1},
+    [0xB7] = {"OR A, A", OPERAND_NONE, "", 1},
+    [0xB8] = {"CP A, B", OPERAND_NONE, "", 1},
+    [0xB9] = {"CP A, C", OPERAND_NONE, "", 1},
+    [0xBA] = {"CP A, D", OPERAND_NONE, "", 1},
+    [0xBB] = {"CP A, E", OPERAND_NONE, "", 1},
+    [0xBC] = {"CP A, H", OPERAND_NONE, "", 1},
+    [0xBD] = {"CP A, L", OPERAND_NONE, "", 1},
+    [0xBE] = {"CP A, (HL)", OPERAND_NONE, "", 1},
+    [0xBF] = {"CP A, A", OPERAND_NONE, "", 1},
+    [0xC0] = {"RET NZ", OPERAND_NONE, "", 1},
+    [0xC1] = {"POP BC", OPERAND_NONE, "", 1},
+    [0xC2] = {"JP NZ, 0x", OPERAND_HEX16, "", 3},
+    [0xC3] = {"JP 0x", OPERAND_HEX16, "", 3},
+    [0xC4] = {"CALL NZ, 0x", OPERAND_HEX16, "", 3},
+    [0xC5] = {"PUSH BC", OPERAND_NONE, "", 1},
+    [0xC6] = {"ADD A, ", OPERAND_U8, "", 2},
+    [0xC7] = {"RST 0", OPERAND_NONE, "", 1},
+    [0xC8] = {"RET Z", OPERAND_NONE, "", 1},
+    [0xC9] = {"RET", OPERAND_NONE, "", 1},
+    [0xCA] = {"JP Z, 0x", OPERAND_HEX16, "", 3},
+    [0xCB] = {"", OPERAND_CB, "", 2},
+    [0xCC] = {"CALL Z, 0x", OPERAND_HEX16, "", 3},
+    [0xCD] = {"CALL 0x", OPERAND_HEX16, "", 3},
+    [0xCE] = {"ADC A, ", OPERAND_U8, "", 2},
+    [0xCF] = {"RST 1", OPERAND_NONE, "", 1},
+    [0xD0] = {"RET NC", OPERAND_NONE, "", 1},
+    [0xD1] = {"POP DE", OPERAND_NONE, "", 1},
+    [0xD2] = {"JP NC, 0x", OPERAND_HEX16, "", 3},
+    [0xD3] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xD4] = {"CALL NC, 0x", OPERAND_HEX16, "", 3},
+    [0xD5] = {"PUSH DE", OPERAND_NONE, "", 1},
+    [0xD6] = {"SUB A, ", OPERAND_U8, "", 2},
+    [0xD7] = {"RST 2", OPERAND_NONE, "", 1},
+    [0xD8] = {"RET C", OPERAND_NONE, "", 1},
+    [0xD9] = {"RETI", OPERAND_NONE, "", 1},
+    [0xDA] = {"JP C, 0x", OPERAND_HEX16, "", 3},
+    [0xDB] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xDC] = {"CALL C, 0x", OPERAND_HEX16, "", 3},
+    [0xDD] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xDE] = {"SBC A, ", OPERAND_U8, "", 2},
+    [0xDF] = {"RST 3", OPERAND_NONE, "", 1},
+    [0xE0] = {"LD (0xFF", OPERAND_HEX8, "), A", 2},
+    [0xE1] = {"POP HL", OPERAND_NONE, "", 1},
+    [0xE2] = {"LD (C), A", OPERAND_NONE, "", 1},
+    [0xE3] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xE4] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xE5] = {"PUSH HL", OPERAND_NONE, "", 1},
+    [0xE6] = {"AND A, ", OPERAND_U8, "", 2},
+    [0xE7] = {"RST 4", OPERAND_NONE, "", 1},
+    [0xE8] = {"ADD SP, ", OPERAND_S8, "", 2},
+    [0xE9] = {"JP (HL)", OPERAND_NONE, "", 1},
+    [0xEA] = {"LD (0x", OPERAND_HEX16, "), A", 3},
+    [0xEB] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xEC] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xED] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xEE] = {"XOR A, ", OPERAND_U8, "", 2},
+    [0xEF] = {"RST 5", OPERAND_NONE, "", 1},
+    [0xF0] = {"LD A, (0xFF", OPERAND_HEX8, ")", 2},
+    [0xF1] = {"POP AF", OPERAND_NONE, "", 1},
+    [0xF2] = {"LD A, (C)", OPERAND_NONE, "", 1},
+    [0xF3] = {"DI", OPERAND_NONE, "", 1},
+    [0xF4] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xF5] = {"PUSH AF", OPERAND_NONE, "", 1},
+    [0xF6] = {"OR A, ", OPERAND_U8, "", 2},
+    [0xF7] = {"RST 6", OPERAND_NONE, "", 1},
+    [0xF8] = {"LDHL SP, ", OPERAND_S8, "", 2},
+    [0xF9] = {"LD SP, HL", OPERAND_NONE, "", 1},
+    [0xFA] = {"LD A, (0x", OPERAND_HEX16, ")", 3},
+    [0xFB] = {"EI", OPERAND_NONE, "", 1},
+    [0xFC] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xFD] = {NULL, OPERAND_NONE, NULL, 1},
+    [0xFE] = {"CP A, ", OPERAND_U8, "", 2},
+    [0xFF] = {"RST 7", OPERAND_NONE, "", 1},
+};
+
+static char const *const CB_OPS[8] = {"RLC", "RRC", "RL",   "RR",
+                                      "SLA", "SRA", "SWAP", "SRL"};
+
+static char const *const CB_REGS[8] = {"B", "C", "D",    "E",
+                                       "H", "L", "(HL)", "A"};
+
+static void disassemble_cb(uint8_t const cb_opcode, char *const buf,
+                           size_t const buf_size) {
+    char const *const reg = CB_REGS[cb_opcode & 0b111];
+    unsigned int const b = (cb_opcode >> 3) & 0b111;
+    switch (cb_opcode >> 6) {
+    case 0b00:
+        snprintf(buf, buf_size, "%s %s", CB_OPS[b], reg);
+        break;
+    case 0b01:
+        snprintf(buf, buf_size, "BIT %u, %s", b, reg);
+        break;
+    case 0b10:
+        snprintf(buf, buf_size, "RES %u, %s", b, reg);
+        break;
+    default:
+        snprintf(buf, buf_size, "SET %u, %s", b, reg);
+        break;
+    }
+}
+
+uint8_t disassemble(uint8_t const bytes[3], char *const buf,
+                    size_t const buf_size) {
+    struct opcode_info const *const info = &OPCODE_INFO[bytes[0]];
+    uint8_t const imm8 = bytes[1];
+    uint16_t const imm16 = (bytes[2] << 8) | bytes[1];
+
+    if (info->prefix == NULL) {
+        snprintf(buf, buf_size, "DB 0x%02" PRIX8, bytes[0]);
+        return info->length;
+    }
+
+    switch (info->operand) {
+    case OPERAND_NONE:
+        snprintf(buf, buf_size, "%s", info->prefix);
+        break;
+    case OPERAND_U8:
+        snprintf(buf, buf_size, "%s%" PRIu8 "%s", info->prefix, imm8,
+                 info->suffix);
+        break;
+    case OPERAND_HEX8:
+        snprintf(buf, buf_size, "%s%02" PRIX8 "%s", info->prefix, imm8,
+                 info->suffix);
+        break;
+    case OPERAND_HEX16:
+        snprintf(buf, buf_size, "%s%04" PRIX16 "%s", info->prefix, imm16,
+                 info->suffix);
+        break;
+    case OPERAND_HEX16_SHORT:
+        snprintf(buf, buf_size, "%s%" PRIX16 "%s", info->prefix, imm16,
+                 info->suffix);
+        break;
+    case OPERAND_S8:
+        snprintf(buf, buf_size, "%s%d%s", info->prefix, (int)(int8_t)imm8,
+                 info->suffix);
+        break;
+    case OPERAND_REL8:
+        snprintf(buf, buf_size, "%s%d%s", info->prefix, (int8_t)imm8 + 2,
+                 info->suffix);
+        break;
+    case OPERAND_CB:
+        disassemble_cb(imm8, buf, buf_size);
+        break;
+    default:
+        snprintf(buf, buf_size, "???");
+        break;
+    }
+    return info->length;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t
+
+enum operand {
+    OPERAND_NONE = 0,
+    OPERAND_U8,          // Unsigned decimal immediate (LD r, n)
+    OPERAND_HEX8,        // Two hex digits (LD A, (0xFFnn))
+    OPERAND_HEX16,       // Four hex digits (JP 0xnnnn)
+    OPERAND_HEX16_SHORT, // Unpadded hex (LD (0xnn), SP)
+    OPERAND_S8,          // Signed decimal immediate (ADD SP, e)
+    OPERAND_REL8,        // Signed decimal jump distance, relative to PC
+    OPERAND_CB,          // Second byte selects a CB-prefixed instruction
+};
+
+struct opcode_info {
+    char const *prefix; // NULL if the opcode is invalid
+    enum operand operand;
+    char const *suffix;
+    uint8_t length; // Bytes, including the opcode itself
+};
+
+extern struct opcode_info const OPCODE_INFO[0x100];
+
+// Writes the mnemonic for the instruction starting at bytes[0] into buf, in
+// the same format that step() prints, and returns the instruction's length.
+uint8_t disassemble(uint8_t const bytes[3], char *buf, size_t buf_size);
@@ -0,0 +1,93 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint64_t
+#include <stdlib.h> // for malloc, free
+#include <string.h> // for strcmp
+
+#include "batch.h"
+#include "engine.h"
+#include "gb.h"
+
+static uint64_t run_reference(struct gb *const gb, void *const state) {
+    (void)state;
+    step(gb);
+    wait(gb);
+    return 1;
+}
+
+// A one-lane batch, so the vector path can be checked against the reference
+static void *open_batch(struct gb *const gb) {
+    struct gb *lanes[] = {gb};
+    return batch_open(lanes, 1);
+}
+
+static void close_batch(void *const state) {
+    batch_close(state);
+}
+
+static uint64_t run_batch(struct gb *const gb, void *const state) {
+    (void)gb;
+    batch_step(state);
+    batch_sync(state);
+    return 1;
+}
+
+struct engine const ENGINES[] = {
+    {"reference", "step() then wait(), one instruction at a time", NULL, NULL,
+     run_reference},
+    {"batch", "batch.c with one lane: register-only instructions vectorised",
+     open_batch, close_batch, run_batch},
+};
+
+size_t const NUM_ENGINES = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
+struct engine_instance *engine_open(struct engine const *const engine,
+                                    struct gb *const gb) {
+    struct engine_instance *const instance = malloc(sizeof(*instance));
+    if (instance == NULL) {
+        return NULL;
+    }
+    *instance = (struct engine_instance){.engine = engine, .gb = gb};
+    if (engine->open != NULL) {
+        instance->state = engine->open(gb);
+        if (instance->state == NULL) {
+            free(instance);
+            return NULL;
+        }
+    }
+    return instance;
+}
+
+void engine_close(struct engine_instance *const instance) {
+    if (instance == NULL) {
+        return;
+    }
+    if (instance->engine->close != NULL) {
+        instance->engine->close(instance->state);
+    }
+    free(instance);
+}
+
+uint64_t engine_run(struct engine_instance *const instance) {
+    return instance->engine->run(instance->gb, instance->state);
+}
+
+uint64_t engine_run_frame(struct engine_instance *const instance) {
+    struct gb const *const gb = instance->gb;
+    uint64_t const start_frame = gb->frame_count;
+    uint64_t const start_cycle = gb->cycle_count;
+    uint64_t steps = 0;
+    while (gb->frame_count == start_frame &&
+           gb->cycle_count - start_cycle < CYCLES_PER_FRAME) {
+        steps += engine_run(instance);
+    }
+    return steps;
+}
+
+struct engine const *find_engine(char const *const name) {
+    for (size_t i = 0; i < NUM_ENGINES; i++) {
+        if (strcmp(ENGINES[i].name, name) == 0) {
+            return &ENGINES[i];
+        }
+    }
+    return NULL;
+}
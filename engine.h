@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include "gb.h"
+
+// An engine is one way of running the emulator. Every engine must behave
+// exactly like the reference, step() followed by wait(); gb-lockstep checks
+// that by running two engines side by side.
+struct engine {
+    char const *name;
+    char const *description;
+    // Sets up whatever the engine keeps per machine, or NULL for nothing.
+    // open returns NULL on failure.
+    void *(*open)(struct gb *gb);
+    void (*close)(void *state);
+    // Runs at least one step (an instruction, or a cycle spent halted),
+    // stopping on a step boundary, and returns how many steps were run.
+    uint64_t (*run)(struct gb *gb, void *state);
+};
+
+// An engine running one machine, with whatever state it keeps for it
+struct engine_instance {
+    struct engine const *engine;
+    struct gb *gb;
+    void *state;
+};
+
+extern struct engine const ENGINES[];
+extern size_t const NUM_ENGINES;
+
+// Returns NULL on failure. gb must stay alive until engine_close(), and only
+// be changed between calls to the run functions.
+struct engine_instance *engine_open(struct engine const *engine,
+                                    struct gb *gb);
+
+void engine_close(struct engine_instance *instance);
+
+// See struct engine.
+uint64_t engine_run(struct engine_instance *instance);
+
+// Runs until the next vblank, or for a frame's worth of cycles if none comes
+// (when the LCD is off), like run_frame(). Returns the number of steps run.
+uint64_t engine_run_frame(struct engine_instance *instance);
+
+// Returns NULL if there is no engine called name.
+struct engine const *find_engine(char const *name);
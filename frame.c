@@ -0,0 +1,64 @@
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t
+
+#include "frame.h"
+#include "gb.h"
+
+// The loops below are kept free of branches and lookups so that the compiler
+// can vectorise them.
+
+// The rounded mean gray level of count pixels whose color numbers sum to sum
+static uint8_t gray(uint16_t const sum, uint16_t const count) {
+    return (255 * count - 85 * sum + count / 2) / count;
+}
+
+void frame_downsample_half(
+    uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+    uint8_t out[FRAME_HALF_HEIGHT][FRAME_HALF_WIDTH]) {
+    for (size_t y = 0; y < FRAME_HALF_HEIGHT; y++) {
+        uint8_t const *const top = frame[2 * y];
+        uint8_t const *const bottom = frame[2 * y + 1];
+        for (size_t x = 0; x < FRAME_HALF_WIDTH; x++) {
+            uint16_t const sum = top[2 * x] + top[2 * x + 1] +
+                                 bottom[2 * x] + bottom[2 * x + 1];
+            out[y][x] = gray(sum, 4);
+        }
+    }
+}
+
+void frame_resize_square(
+    uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+    uint8_t out[FRAME_SQUARE_SIZE][FRAME_SQUARE_SIZE]) {
+    // Each output pixel covers one or two rows and one or two columns.
+    for (size_t y = 0; y < FRAME_SQUARE_SIZE; y++) {
+        size_t const r0 = y * GB_SCREEN_HEIGHT / FRAME_SQUARE_SIZE;
+        size_t const r1 = (y + 1) * GB_SCREEN_HEIGHT / FRAME_SQUARE_SIZE;
+        uint16_t columns[GB_SCREEN_WIDTH];
+        for (size_t c = 0; c < GB_SCREEN_WIDTH; c++) {
+            columns[c] = 0;
+            for (size_t r = r0; r < r1; r++) {
+                columns[c] += frame[r][c];
+            }
+        }
+        for (size_t x = 0; x < FRAME_SQUARE_SIZE; x++) {
+            size_t const c0 = x * GB_SCREEN_WIDTH / FRAME_SQUARE_SIZE;
+            size_t const c1 = (x + 1) * GB_SCREEN_WIDTH / FRAME_SQUARE_SIZE;
+            uint16_t sum = 0;
+            for (size_t c = c0; c < c1; c++) {
+                sum += columns[c];
+            }
+            out[y][x] = gray(sum, (r1 - r0) * (c1 - c0));
+        }
+    }
+}
+
+void frame_pack_2bpp(uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                     uint8_t out[GB_SCREEN_HEIGHT][FRAME_PACKED_ROW_SIZE]) {
+    for (size_t y = 0; y < GB_SCREEN_HEIGHT; y++) {
+        for (size_t x = 0; x < FRAME_PACKED_ROW_SIZE; x++) {
+            uint8_t const *const p = &frame[y][4 * x];
+            out[y][x] = (p[0] & 3) << 6 | (p[1] & 3) << 4 | (p[2] & 3) << 2 |
+                        (p[3] & 3);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h> // for uint8_t
+
+#include "gb.h"
+
+// Smaller forms of a frame of color numbers (0-3), as get_frame() returns it,
+// for consumers such as learners that don't need the full 160x144 bytes.
+// Grayscale output maps color number 0 (white) to 255 and 3 (black) to 0.
+
+#define FRAME_HALF_WIDTH (GB_SCREEN_WIDTH / 2)
+#define FRAME_HALF_HEIGHT (GB_SCREEN_HEIGHT / 2)
+#define FRAME_SQUARE_SIZE (84)
+#define FRAME_PACKED_ROW_SIZE (GB_SCREEN_WIDTH / 4)
+
+// 80x72 grayscale, each pixel the mean of a 2x2 block.
+void frame_downsample_half(
+    uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+    uint8_t out[FRAME_HALF_HEIGHT][FRAME_HALF_WIDTH]);
+
+// 84x84 grayscale, each pixel the mean of the block of source pixels whose
+// top-left corners fall inside it (an area resize, squashing the aspect ratio).
+void frame_resize_square(
+    uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+    uint8_t out[FRAME_SQUARE_SIZE][FRAME_SQUARE_SIZE]);
+
+// 160x144 color numbers packed four to a byte, leftmost pixel in the top two
+// bits, as in a 2-bit PNG.
+void frame_pack_2bpp(uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                     uint8_t out[GB_SCREEN_HEIGHT][FRAME_PACKED_ROW_SIZE]);
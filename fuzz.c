@@ -0,0 +1,87 @@
+#include <stddef.h> // for NULL, size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint64_t
+#include <stdio.h>  // for fprintf
+#include <stdlib.h> // for malloc, free
+
+#include "coverage.h"
+#include "fuzz.h"
+#include "gb.h"
+
+struct fuzz {
+    struct gb gb;
+    struct gb start; // What every run starts from
+    struct coverage *coverage;
+    uint64_t max_frames;
+    uint1_t allow_patches;
+};
+
+struct fuzz *fuzz_open(struct fuzz_options const *const options) {
+    struct fuzz *const fuzz = malloc(sizeof(*fuzz));
+    if (fuzz == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return NULL;
+    }
+    fuzz->coverage = coverage_open();
+    if (fuzz->coverage == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        free(fuzz);
+        return NULL;
+    }
+    initialize_from_buffer(&fuzz->gb, options->rom, options->rom_size);
+    if (options->state_path != NULL &&
+        read_state(&fuzz->gb, options->state_path) != 0) {
+        fprintf(stderr, "Couldn't load state from %s!\n", options->state_path);
+        fuzz_close(fuzz);
+        return NULL;
+    }
+    for (uint64_t f = 0; f < options->boot_frames; f++) {
+        run_frame(&fuzz->gb);
+    }
+    fuzz->gb.skip_render = 1;
+    fuzz->gb.coverage = fuzz->coverage;
+    save_state(&fuzz->gb, &fuzz->start);
+    fuzz->max_frames = options->max_frames;
+    fuzz->allow_patches = options->allow_patches;
+    return fuzz;
+}
+
+void fuzz_close(struct fuzz *const fuzz) {
+    if (fuzz == NULL) {
+        return;
+    }
+    coverage_close(fuzz->coverage);
+    free(fuzz);
+}
+
+enum stop_reason fuzz_run(struct fuzz *const fuzz, uint8_t const *data,
+                          size_t size) {
+    struct gb *const gb = &fuzz->gb;
+    load_state(gb, &fuzz->start); // Also undoes the last run's patches
+    coverage_reset(fuzz->coverage);
+    if (fuzz->allow_patches && size > 0) {
+        size_t const count = data[0];
+        data++;
+        size--;
+        for (size_t i = 0; i < count && size >= FUZZ_PATCH_SIZE; i++) {
+            uint16_t const address = (data[0] | data[1] << 8) % FUZZ_ROM_SIZE;
+            gb->address_space[address] = data[2];
+            data += FUZZ_PATCH_SIZE;
+            size -= FUZZ_PATCH_SIZE;
+        }
+    }
+    for (size_t f = 0; f < size && f < fuzz->max_frames; f++) {
+        set_buttons(gb, data[f]);
+        if (run_frame(gb) == STOP_FAULT) {
+            return STOP_FAULT;
+        }
+    }
+    return STOP_DONE;
+}
+
+struct coverage const *fuzz_coverage(struct fuzz const *const fuzz) {
+    return fuzz->coverage;
+}
+
+struct gb const *fuzz_machine(struct fuzz const *const fuzz) {
+    return &fuzz->gb;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint64_t
+
+#include "coverage.h"
+#include "gb.h"
+
+// Runs fuzz inputs against a ROM in-process, fast enough for a fuzzer's
+// persistent mode. The machine is set up once (powered on, then optionally
+// loaded from a save state and run for some frames) and snapshotted, and each
+// input starts by restoring that snapshot instead of calling initialize().
+// The screen isn't drawn, since only coverage matters.
+//
+// An input is a button script: byte n holds the buttons held during frame n
+// (bit b for enum joypad_button b). With patches allowed, it starts with a
+// count byte and that many FUZZ_PATCH_SIZE-byte ROM patches (a little-endian
+// address, taken modulo the ROM's 32K, then the value), applied after the
+// snapshot is restored. A run ends at the end of the script, after max_frames
+// frames, or as soon as the CPU locks up, whichever comes first.
+
+#define FUZZ_PATCH_SIZE (3)
+#define FUZZ_ROM_SIZE (0x8000)
+
+struct fuzz_options {
+    uint8_t const *rom;
+    size_t rom_size;
+    char const *state_path; // If non-NULL, loaded after powering on
+    uint64_t boot_frames;   // Run before the snapshot, with no buttons held
+    uint64_t max_frames;    // Per input
+    uint1_t allow_patches;
+};
+
+// Returns NULL on failure, after printing why.
+struct fuzz *fuzz_open(struct fuzz_options const *options);
+
+void fuzz_close(struct fuzz *fuzz);
+
+// Runs one input from the snapshot. Returns STOP_FAULT if the CPU locked up
+// (see gb->fault), or STOP_DONE otherwise.
+enum stop_reason fuzz_run(struct fuzz *fuzz, uint8_t const *data, size_t size);
+
+// The coverage of the last run alone.
+struct coverage const *fuzz_coverage(struct fuzz const *fuzz);
+
+// The machine as the last run left it.
+struct gb const *fuzz_machine(struct fuzz const *fuzz);
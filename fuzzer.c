@@ -0,0 +1,164 @@
+#define _GNU_SOURCE   // for clock_gettime(2), getopt(3)
+#include <inttypes.h> // for PRIu64
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint8_t, uint32_t, uint64_t
+#include <stdio.h>    // for fprintf, fopen, fread, fclose
+#include <stdlib.h>   // for EXIT_*, abort, exit, getenv, strtoull
+#include <string.h>   // for memcpy
+#include <time.h>     // for clock_gettime
+#include <unistd.h>   // for getopt
+
+#include "coverage.h"
+#include "fuzz.h"
+#include "gb.h"
+
+// A fuzz target (see fuzz.h) for libFuzzer, or, built with FUZZ_MAIN, for
+// AFL++'s persistent mode or for running inputs by hand. It's configured
+// through the environment, since the fuzzers own the command line:
+//
+//     GB_FUZZ_ROM          The ROM (required)
+//     GB_FUZZ_STATE        A save state to start from
+//     GB_FUZZ_BOOT_FRAMES  Frames to run before the snapshot (default 0)
+//     GB_FUZZ_FRAMES       Frames per input at most (default 600)
+//     GB_FUZZ_PATCHES      If 1, inputs start with ROM patches
+//     GB_FUZZ_CRASH        If 1, a locked-up CPU is reported as a crash
+//
+// Guest edge coverage goes to libFuzzer as extra counters, and is folded
+// into AFL++'s map, alongside the coverage of the emulator itself.
+
+#define DEFAULT_FRAMES (600)
+
+static struct fuzz *fuzz;
+static uint1_t crash_on_fault;
+
+// libFuzzer adds everything in this section to its coverage.
+__attribute__((used, section("__libfuzzer_extra_counters"))) static uint8_t
+    extra_counters[COVERAGE_EDGE_MAP_SIZE];
+
+// AFL++'s coverage map, if this was built with afl-clang-fast.
+extern uint8_t *__afl_area_ptr __attribute__((weak));
+extern uint32_t __afl_map_size __attribute__((weak));
+
+static uint64_t env_u64(char const *const name, uint64_t const fallback) {
+    char const *const value = getenv(name);
+    return value != NULL ? strtoull(value, NULL, 0) : fallback;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size);
+
+int LLVMFuzzerInitialize(int *const argc, char ***const argv) {
+    (void)argc;
+    (void)argv;
+    char const *const rom_path = getenv("GB_FUZZ_ROM");
+    if (rom_path == NULL) {
+        fprintf(stderr, "Set GB_FUZZ_ROM to the ROM to fuzz!\n");
+        exit(EXIT_FAILURE);
+    }
+    static uint8_t rom[ADDRESS_SPACE_SIZE];
+    FILE *const f = fopen(rom_path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Couldn't open %s!\n", rom_path);
+        exit(EXIT_FAILURE);
+    }
+    size_t const rom_size = fread(rom, 1, sizeof(rom), f);
+    fclose(f);
+    struct fuzz_options const options = {
+        .rom = rom,
+        .rom_size = rom_size,
+        .state_path = getenv("GB_FUZZ_STATE"),
+        .boot_frames = env_u64("GB_FUZZ_BOOT_FRAMES", 0),
+        .max_frames = env_u64("GB_FUZZ_FRAMES", DEFAULT_FRAMES),
+        .allow_patches = env_u64("GB_FUZZ_PATCHES", 0) != 0,
+    };
+    crash_on_fault = env_u64("GB_FUZZ_CRASH", 0) != 0;
+    fuzz = fuzz_open(&options);
+    if (fuzz == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(uint8_t const *const data, size_t const size) {
+    enum stop_reason const reason = fuzz_run(fuzz, data, size);
+    uint8_t const *const edges = fuzz_coverage(fuzz)->edges;
+    memcpy(extra_counters, edges, sizeof(extra_counters));
+    if (&__afl_area_ptr != NULL && __afl_area_ptr != NULL) {
+        uint32_t const map_size =
+            &__afl_map_size != NULL ? __afl_map_size : COVERAGE_EDGE_MAP_SIZE;
+        for (size_t i = 0; i < COVERAGE_EDGE_MAP_SIZE; i++) {
+            __afl_area_ptr[i % map_size] += edges[i];
+        }
+    }
+    if (reason == STOP_FAULT && crash_on_fault) {
+        struct gb const *const gb = fuzz_machine(fuzz);
+        fprintf(stderr, "The CPU locked up on opcode 0x%02X at 0x%04X!\n",
+                gb->address_space[gb->pc], gb->pc);
+        abort();
+    }
+    return 0;
+}
+
+#ifdef FUZZ_MAIN
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Under AFL++, loops over its inputs in one process. Otherwise, runs each
+// input file named on the command line (repeatedly, with -r) and reports the
+// rate, e.g., to reproduce a crash or check executions per second.
+int main(int argc, char **argv) {
+    LLVMFuzzerInitialize(&argc, &argv);
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    __AFL_INIT();
+    uint8_t const *const buf = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(10000)) {
+        LLVMFuzzerTestOneInput(buf, __AFL_FUZZ_TESTCASE_LEN);
+    }
+#else
+    uint64_t repeats = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+        case 'r':
+            repeats = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-r repeats] <input_file>...\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-r repeats] <input_file>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    static uint8_t input[1 << 20];
+    uint64_t runs = 0;
+    uint64_t const start = now_ns();
+    for (int i = optind; i < argc; i++) {
+        FILE *const f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Couldn't open %s!\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        size_t const size = fread(input, 1, sizeof(input), f);
+        fclose(f);
+        for (uint64_t r = 0; r < repeats; r++) {
+            LLVMFuzzerTestOneInput(input, size);
+            runs++;
+        }
+    }
+    uint64_t const elapsed = now_ns() - start;
+    fprintf(stderr, "%" PRIu64 " runs, %.0f per second\n", runs,
+            runs * 1e9 / (elapsed > 0 ? elapsed : 1));
+#endif
+    return EXIT_SUCCESS;
+}
+#endif
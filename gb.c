@@ -1,15 +1,34 @@
 #define _GNU_SOURCE   // for nanosleep(2)
 #include <inttypes.h> // for PRI*
-#include <stddef.h>   // for NULL
+#include <stddef.h>   // for NULL, size_t
 #include <stdint.h>   // for int*_t, uint*_t
-#include <stdio.h>    // for printf, fprintf, stderr, fopen, fread, fclose
-#include <stdlib.h>   // for exit, EXIT_FAILURE
-#include <string.h>   // for memset
-#include <time.h>     // for nanosleep
-
+#include <stdio.h>    // for printf, fprintf, stderr, fopen, fread, fwrite
+#include <stdlib.h>   // for exit, malloc, free, EXIT_FAILURE
+#include <string.h>   // for memcmp, memcpy, memset
+#include <time.h>     // for nanosleep, clock_gettime
+
+#include "cheats.h"
+#include "coverage.h"
+#include "debugger.h"
 #include "gb.h"
-
+#include "hash.h"
+#include "share.h"
+#include "timeline.h"
+#include "trace.h"
+#include "watch.h"
+
+// Define VERBOSE to print every instruction as it executes. This is slow; for
+// anything longer than a few frames, use the binary trace instead.
+#ifdef VERBOSE
 #define DEBUG(...) fprintf(stderr, __VA_ARGS__)
+#else
+#define DEBUG(...)                                                             \
+    do {                                                                       \
+        if (0) {                                                               \
+            fprintf(stderr, __VA_ARGS__);                                      \
+        }                                                                      \
+    } while (0)
+#endif
 
 #define DIE(...)                                                               \
     do {                                                                       \
@@ -92,6 +111,63 @@ uint16_t const TAC = 0xFF07;
 // 16 ms/frame gets us a little over 60 fps
 #define MS_PER_CYCLE (100)
 
+// Define COUNTERS to accumulate the counters in struct gb. Without it, these
+// all expand to nothing.
+#ifdef COUNTERS
+static enum bus_region region_of(uint16_t const addr) {
+    if (addr < UNSIGNED_TILE_DATA_BASE) {
+        return REGION_ROM;
+    } else if (addr < CARTRIDGE_RAM) {
+        return REGION_VRAM;
+    } else if (addr < WRAM) {
+        return REGION_CART_RAM;
+    } else if (addr < ECHO_RAM) {
+        return REGION_WRAM;
+    } else if (addr < OAM) {
+        return REGION_ECHO_RAM;
+    } else if (addr < UNUSED_ADDRESSES) {
+        return REGION_OAM;
+    } else if (addr < IO_REGS) {
+        return REGION_UNUSED;
+    } else if (addr < FAST_RAM) {
+        return REGION_IO;
+    } else if (addr < INTERRUPT_ENABLE) {
+        return REGION_HRAM;
+    } else {
+        return REGION_IE;
+    }
+}
+
+static void count_access(uint64_t *const by_region, uint64_t *const by_io_reg,
+                         uint16_t const addr) {
+    by_region[region_of(addr)]++;
+    if (IO_REGS <= addr && addr < FAST_RAM) {
+        by_io_reg[addr - IO_REGS]++;
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define COUNT(gb, counter) ((gb)->counters.counter++)
+#define COUNT_READ(gb, addr)                                                   \
+    count_access((gb)->counters.reads, (gb)->counters.io_reads, (addr))
+#define COUNT_WRITE(gb, addr)                                                  \
+    count_access((gb)->counters.writes, (gb)->counters.io_writes, (addr))
+#define TIMER_START(name) uint64_t const name = now_ns()
+#define TIMER_STOP(gb, counter, name)                                          \
+    ((gb)->counters.counter += now_ns() - (name))
+#else
+#define COUNT(gb, counter) ((void)0)
+#define COUNT_READ(gb, addr) ((void)0)
+#define COUNT_WRITE(gb, addr) ((void)0)
+#define TIMER_START(name) ((void)0)
+#define TIMER_STOP(gb, counter, name) ((void)0)
+#endif
+
 enum cc_cond { CC_NZ = 0b00, CC_Z = 0b01, CC_NC = 0b10, CC_C = 0b11 };
 
 static char const *cc_to_str(enum cc_cond const cc) {
@@ -157,7 +233,13 @@ static uint1_t check_cc(struct gb const *const gb, enum cc_cond const cc) {
     }
 }
 
-static uint8_t read_mem8(struct gb *const gb, uint16_t addr) {
+// A read that watchpoints don't see, for instruction fetches. Everything else
+// goes through read_mem8().
+static uint8_t fetch_mem8(struct gb *const gb, uint16_t addr) {
+    COUNT_READ(gb, addr);
+    if (gb->flat_bus) {
+        return gb->address_space[addr];
+    }
     if (ECHO_RAM < addr && addr < OAM) {
         addr -= 0x2000;
     }
@@ -186,23 +268,95 @@ static uint8_t read_mem8(struct gb *const gb, uint16_t addr) {
     return gb->address_space[addr];
 }
 
+// The slow path of read_mem8() for a page with a read watchpoint, kept out of
+// line so that the usual path stays as it was.
+__attribute__((noinline)) static uint8_t
+debugged_read_mem8(struct gb *const gb, uint16_t const addr) {
+    uint8_t const val = fetch_mem8(gb, addr);
+    debugger_on_read(gb->debugger, addr, val);
+    return val;
+}
+
+static uint8_t read_mem8(struct gb *const gb, uint16_t const addr) {
+    if (gb->debugger != NULL &&
+        (gb->debugger->pages[addr / DEBUGGER_PAGE_SIZE] & PAGE_READ)) {
+        return debugged_read_mem8(gb, addr);
+    }
+    return fetch_mem8(gb, addr);
+}
+
 struct point get_origin(struct gb *gb) {
     return (struct point){.r = read_mem8(gb, SCY), .c = read_mem8(gb, SCX)};
 }
 
+void get_frame(struct gb *const gb,
+               uint8_t out[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]) {
+    struct point const origin = get_origin(gb);
+    for (size_t r = 0; r < GB_SCREEN_HEIGHT; r++) {
+        for (size_t c = 0; c < GB_SCREEN_WIDTH; c++) {
+            out[r][c] =
+                gb->screen[(origin.r + r) % (TILE_MAP_HEIGHT * TILE_HEIGHT)]
+                          [(origin.c + c) % (TILE_MAP_WIDTH * TILE_WIDTH)];
+        }
+    }
+}
+
+// out[i] = max(out[i], in[i]) over a plain run of bytes, which the compiler
+// turns into SIMD max instructions (e.g., pmaxub)
+static void max_run(uint8_t *const out, uint8_t const *const in,
+                    size_t const size) {
+    for (size_t i = 0; i < size; i++) {
+        out[i] = in[i] > out[i] ? in[i] : out[i];
+    }
+}
+
+void max_frame(struct gb *const gb,
+               uint8_t out[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]) {
+    struct point const origin = get_origin(gb);
+    // Each row is at most two runs: up to the right edge of the tile map,
+    // then from its left edge.
+    size_t const width = TILE_MAP_WIDTH * TILE_WIDTH;
+    size_t const first =
+        width - origin.c < GB_SCREEN_WIDTH ? width - origin.c : GB_SCREEN_WIDTH;
+    for (size_t r = 0; r < GB_SCREEN_HEIGHT; r++) {
+        uint8_t const *const row =
+            gb->screen[(origin.r + r) % (TILE_MAP_HEIGHT * TILE_HEIGHT)];
+        max_run(out[r], row + origin.c, first);
+        max_run(out[r] + first, row, GB_SCREEN_WIDTH - first);
+    }
+}
+
+uint8_t const *get_wram(struct gb const *const gb) {
+    return gb->address_space + WRAM;
+}
+
+uint8_t const *get_hram(struct gb const *const gb) {
+    return gb->address_space + FAST_RAM;
+}
+
+uint64_t hash_frame(struct gb *const gb) {
+    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    get_frame(gb, frame);
+    return hash64(frame, sizeof(frame), 0);
+}
+
 void dump(struct gb *const gb) {
     printf("A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X "
            "PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
            gb->af >> 8, gb->af & 0xffu, gb->bc >> 8, gb->bc & 0xffu,
            gb->de >> 8, gb->de & 0xffu, gb->hl >> 8, gb->hl & 0xffu, gb->sp,
-           gb->pc, read_mem8(gb, gb->pc), read_mem8(gb, gb->pc + 1),
-           read_mem8(gb, gb->pc + 2), read_mem8(gb, gb->pc + 3));
+           gb->pc, fetch_mem8(gb, gb->pc), fetch_mem8(gb, gb->pc + 1),
+           fetch_mem8(gb, gb->pc + 2), fetch_mem8(gb, gb->pc + 3));
 }
 
 static uint16_t read_mem16(struct gb *const gb, uint16_t const addr) {
     return (read_mem8(gb, addr + 1) << 8) | read_mem8(gb, addr);
 }
 
+static uint16_t fetch_mem16(struct gb *const gb, uint16_t const addr) {
+    return (fetch_mem8(gb, addr + 1) << 8) | fetch_mem8(gb, addr);
+}
+
 static uint1_t is_writable(uint16_t addr) {
     // XXX: OAM+VRAM should not be writable at all times.
     return (UNSIGNED_TILE_DATA_BASE <= addr && addr < ECHO_RAM) ||
@@ -210,6 +364,7 @@ static uint1_t is_writable(uint16_t addr) {
 }
 
 static void do_dma(struct gb *const gb, uint8_t const src) {
+    COUNT(gb, dma_transfers);
     gb->cycles_to_wait += 160;
     for (uint16_t i = 0; i < 0xa0; i++) {
         // Avoid write_mem8 here to avoid recursion
@@ -217,8 +372,80 @@ static void do_dma(struct gb *const gb, uint8_t const src) {
     }
 }
 
+// The bit for addr in ram_hash_excluded, or -1 if addr isn't hashed at all
+static int32_t ram_hash_index(uint16_t const addr) {
+    if (WRAM <= addr && addr < ECHO_RAM) {
+        return addr - WRAM;
+    }
+    if (FAST_RAM <= addr && addr < INTERRUPT_ENABLE) {
+        return GB_WRAM_SIZE + addr - FAST_RAM;
+    }
+    return -1;
+}
+
+static uint1_t is_excluded(struct gb const *const gb, int32_t const index) {
+    return (gb->ram_hash_excluded[index / 64] >> (index % 64)) & 1;
+}
+
+// One address's contribution to ram_hash (the splitmix64 finalizer)
+static uint64_t ram_hash_term(uint16_t const addr, uint8_t const val) {
+    uint64_t z = ((uint64_t)addr << 8 | val) + 0x9E3779B97F4A7C15;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+static void update_ram_hash(struct gb *const gb, uint16_t const addr,
+                            uint8_t const val) {
+    int32_t const index = ram_hash_index(addr);
+    if (index >= 0 && !is_excluded(gb, index)) {
+        gb->ram_hash ^= ram_hash_term(addr, gb->address_space[addr]) ^
+                        ram_hash_term(addr, val);
+    }
+}
+
+uint64_t compute_ram_hash(struct gb const *const gb) {
+    uint64_t hash = 0;
+    for (uint32_t addr = WRAM; addr < INTERRUPT_ENABLE; addr++) {
+        int32_t const index = ram_hash_index(addr);
+        if (index >= 0 && !is_excluded(gb, index)) {
+            hash ^= ram_hash_term(addr, gb->address_space[addr]);
+        }
+    }
+    return hash;
+}
+
+void enable_ram_hash(struct gb *const gb) {
+    gb->ram_hash = compute_ram_hash(gb);
+    gb->hash_ram = 1;
+}
+
+void exclude_from_ram_hash(struct gb *const gb, uint16_t const address) {
+    int32_t const index = ram_hash_index(address);
+    if (index < 0 || is_excluded(gb, index)) {
+        return;
+    }
+    if (gb->hash_ram) {
+        gb->ram_hash ^= ram_hash_term(address, gb->address_space[address]);
+    }
+    gb->ram_hash_excluded[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
 static void write_mem8(struct gb *const gb, uint16_t const addr,
                        uint8_t const val) {
+    COUNT_WRITE(gb, addr);
+    if (gb->debugger != NULL &&
+        (gb->debugger->pages[addr / DEBUGGER_PAGE_SIZE] & PAGE_WRITE)) {
+        debugger_on_write(gb->debugger, addr, val);
+    }
+    if (gb->hash_ram) {
+        // Everything hashed is plain RAM, so val is what gets stored.
+        update_ram_hash(gb, addr, val);
+    }
+    if (gb->flat_bus) {
+        gb->address_space[addr] = val;
+        return;
+    }
     switch (addr) {
     case DIVIDER_REGISTER: {
         gb->address_space[addr] =
@@ -226,6 +453,9 @@ static void write_mem8(struct gb *const gb, uint16_t const addr,
         break;
     }
     case SERIAL_DATA: {
+        // Only with VERBOSE, since games (and fuzz inputs) can write here
+        // often enough that a syscall per byte matters. The same goes for the
+        // messages below.
         DEBUG("[SERIAL]: '%c'\n", val);
         break;
     }
@@ -248,19 +478,26 @@ static void write_mem8(struct gb *const gb, uint16_t const addr,
         if (is_writable(addr)) {
             gb->address_space[addr] = val;
         } else if (HEADER_OFFSET <= addr && addr < UNSIGNED_TILE_DATA_BASE) {
-            fprintf(stderr,
-                    "Attempted bank switch, which is not implemented.\n");
+            DEBUG("Attempted bank switch, which is not implemented.\n");
         } else {
-            fprintf(stderr,
-                    "Attempted potentially illegal write of 0x%02" PRIX8
-                    " to 0x%04" PRIX16 "!\n",
-                    val, addr);
+            DEBUG("Attempted potentially illegal write of 0x%02" PRIX8
+                  " to 0x%04" PRIX16 "!\n",
+                  val, addr);
         }
         break;
     }
     }
 }
 
+uint8_t bus_read(struct gb *const gb, uint16_t const address) {
+    return read_mem8(gb, address);
+}
+
+void bus_write(struct gb *const gb, uint16_t const address,
+               uint8_t const value) {
+    write_mem8(gb, address, value);
+}
+
 enum interrupt {
     INT_VBLANK = 0b1,
     INT_STAT = 0b10,
@@ -284,6 +521,18 @@ void release_button(struct gb *const gb, enum joypad_button const btn) {
     gb->buttons_pressed[btn] = 1;
 }
 
+void set_buttons(struct gb *const gb, uint8_t const buttons) {
+    for (size_t b = 0; b < NUM_BUTTONS; b++) {
+        uint1_t const want = (buttons >> b) & 1;
+        uint1_t const pressed = !gb->buttons_pressed[b]; // Active low
+        if (want && !pressed) {
+            press_button(gb, b);
+        } else if (!want && pressed) {
+            release_button(gb, b);
+        }
+    }
+}
+
 static void enter_hblank(struct gb *const gb) {
     gb->address_space[LCD_STATUS] =
         (read_mem8(gb, LCD_STATUS) & 0b11111100) | 0b00;
@@ -361,18 +610,23 @@ static void handle_interrupts(struct gb *const gb) {
     if (vblank_requested && vblank_enabled) {
         new_pc = VBLANK_INTERRUPT_ADDRESS;
         gb->address_space[INTERRUPT_FLAGS] = interrupts_requested & ~INT_VBLANK;
+        COUNT(gb, interrupts[0]);
     } else if (lcd_stat_requested && lcd_stat_enabled) {
         new_pc = LCD_STAT_INTERRUPT_ADDRESS;
         gb->address_space[INTERRUPT_FLAGS] = interrupts_requested & ~INT_STAT;
+        COUNT(gb, interrupts[1]);
     } else if (timer_requested && timer_enabled) {
         new_pc = TIMER_INTERRUPT_ADDRESS;
         gb->address_space[INTERRUPT_FLAGS] = interrupts_requested & ~INT_TIMER;
+        COUNT(gb, interrupts[2]);
     } else if (serial_requested && serial_enabled) {
         new_pc = SERIAL_INTERRUPT_ADDRESS;
         gb->address_space[INTERRUPT_FLAGS] = interrupts_requested & ~INT_SERIAL;
+        COUNT(gb, interrupts[3]);
     } else if (joypad_requested && joypad_enabled) {
         new_pc = JOYPAD_INTERRUPT_ADDRESS;
         gb->address_space[INTERRUPT_FLAGS] = interrupts_requested & ~INT_JOYPAD;
+        COUNT(gb, interrupts[4]);
     }
 
     if (new_pc != 0xFFFF) {
@@ -386,14 +640,8 @@ static void handle_interrupts(struct gb *const gb) {
     gb->need_to_do_interrupts = 0;
 }
 
-void initialize(struct gb *const gb, char const *const path) {
-    FILE *f = fopen(path, "r");
-    if (f == NULL) {
-        DIE("Couldn't load rom from %s!\n", path);
-    }
-    fread(gb->address_space, sizeof(char), ADDRESS_SPACE_SIZE, f);
-    fclose(f);
-
+// Puts everything but the ROM into its power-on state.
+static void reset(struct gb *const gb) {
     gb->address_space[DIVIDER_REGISTER] = 0x18;
     gb->address_space[TIMA] = 0x00;
     gb->address_space[TMA] = 0x00;
@@ -425,14 +673,172 @@ void initialize(struct gb *const gb, char const *const path) {
     gb->ime = 0;
     gb->cycles_to_wait = 0;
     gb->cycle_count = 0;
+    gb->dot_count = 0;
+    gb->frame_count = 0;
+    gb->hash_frames = 0;
+    gb->frame_hash = 0;
+    gb->skip_render = 0;
+    gb->hash_ram = 0;
+    gb->ram_hash = 0;
+    memset(gb->ram_hash_excluded, 0, sizeof(gb->ram_hash_excluded));
     gb->need_to_do_interrupts = 1;
     gb->graphics_mode = SEARCHING;
     gb->joypad_mode = BOTH; // This might be unitialized in reality
     gb->halted = 0;
+    gb->fault = FAULT_NONE;
+    gb->flat_bus = 0;
+    gb->trace = NULL;
+    gb->timeline = NULL;
+    gb->share = NULL;
+    gb->debugger = NULL;
+    gb->coverage = NULL;
+    gb->cheats = NULL;
+#ifdef COUNTERS
+    memset(&gb->counters, 0, sizeof(gb->counters));
+#endif
     memset(gb->screen, 0, sizeof(gb->screen));
     memset(gb->buttons_pressed, 1, sizeof(gb->buttons_pressed));
 }
 
+void initialize(struct gb *const gb, char const *const path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        DIE("Couldn't load rom from %s!\n", path);
+    }
+    memset(gb->address_space, 0, sizeof(gb->address_space));
+    fread(gb->address_space, sizeof(char), ADDRESS_SPACE_SIZE, f);
+    fclose(f);
+    reset(gb);
+}
+
+void initialize_from_buffer(struct gb *const gb, uint8_t const *const rom,
+                            size_t const size) {
+    memset(gb->address_space, 0, sizeof(gb->address_space));
+    memcpy(gb->address_space, rom,
+           size < ADDRESS_SPACE_SIZE ? size : ADDRESS_SPACE_SIZE);
+    reset(gb);
+}
+
+void initialize_flat(struct gb *const gb) {
+    reset(gb);
+    memset(gb->address_space, 0, sizeof(gb->address_space));
+    gb->flat_bus = 1;
+}
+
+void save_state(struct gb const *const gb, struct gb *const state) {
+    *state = *gb;
+    if (gb->cheats != NULL) {
+        cheats_unpatch(gb->cheats, state);
+    }
+    state->trace = NULL;
+    state->timeline = NULL;
+    state->share = NULL;
+    state->debugger = NULL;
+    state->coverage = NULL;
+    state->cheats = NULL;
+}
+
+void load_state(struct gb *const gb, struct gb const *const state) {
+    struct trace *const trace = gb->trace;
+    struct timeline *const timeline = gb->timeline;
+    struct share *const share = gb->share;
+    struct debugger *const debugger = gb->debugger;
+    struct coverage *const coverage = gb->coverage;
+    struct cheats *const cheats = gb->cheats;
+    *gb = *state;
+    gb->trace = trace;
+    gb->timeline = timeline;
+    gb->share = share;
+    gb->debugger = debugger;
+    gb->coverage = coverage;
+    gb->cheats = cheats;
+    if (cheats != NULL) {
+        cheats_repatch(cheats, gb);
+    }
+}
+
+uint64_t hash_state(struct gb const *const gb) {
+    // Field by field, since the struct has padding.
+    uint64_t const scalars[] = {
+        gb->af,
+        gb->bc,
+        gb->de,
+        gb->hl,
+        gb->pc,
+        gb->sp,
+        gb->ime,
+        gb->cycles_to_wait,
+        gb->cycle_count,
+        gb->need_to_do_interrupts,
+        gb->dot_count,
+        gb->frame_count,
+        gb->graphics_mode,
+        gb->halted,
+        gb->fault,
+        gb->joypad_mode,
+        gb->flat_bus,
+    };
+    uint8_t buttons[NUM_BUTTONS];
+    for (size_t i = 0; i < NUM_BUTTONS; i++) {
+        buttons[i] = gb->buttons_pressed[i];
+    }
+    uint64_t hash = hash64(scalars, sizeof(scalars), 0);
+    hash = hash64(buttons, sizeof(buttons), hash);
+    hash = hash64(gb->address_space, sizeof(gb->address_space), hash);
+    return hash64(gb->screen, sizeof(gb->screen), hash);
+}
+
+#define STATE_MAGIC ("GBSS")
+#define STATE_VERSION (1)
+
+struct state_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t size; // sizeof(struct gb), to catch layout changes
+};
+
+int write_state(struct gb const *const gb, char const *const path) {
+    FILE *const f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    struct state_header header = {
+        .version = STATE_VERSION,
+        .size = sizeof(*gb),
+    };
+    memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    // On the heap rather than static, so that threads can save at once
+    struct gb *const state = malloc(sizeof(*state));
+    if (state != NULL) {
+        save_state(gb, state);
+    }
+    uint1_t const ok = state != NULL &&
+                       fwrite(&header, sizeof(header), 1, f) == 1 &&
+                       fwrite(state, sizeof(*state), 1, f) == 1;
+    free(state);
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+int read_state(struct gb *const gb, char const *const path) {
+    FILE *const f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    struct state_header header;
+    struct gb *const state = malloc(sizeof(*state)); // As in write_state()
+    uint1_t const ok =
+        state != NULL && fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == STATE_VERSION && header.size == sizeof(*state) &&
+        fread(state, sizeof(*state), 1, f) == 1;
+    fclose(f);
+    if (ok) {
+        load_state(gb, state);
+    }
+    free(state);
+    return ok ? 0 : -1;
+}
+
 static uint8_t *r_reg(struct gb *const gb, enum r_reg const r) {
     // Assumes little-endian
     switch (r) {
@@ -662,8 +1068,16 @@ static void render_sprites(struct gb *const gb) {
 static void update_screen(struct gb *const gb) {
     // Called once per M-cycle, if the LCD is enabled.
 
-    gb->dot_count += 16;    // Dot clock = 4 * real clock = 4 * 4 * our clock
-    gb->dot_count %= 70224; // It takes 70224 dots to do one frame
+    // Dot clock = 4 * real clock = 4 * 4 * our clock
+    gb->dot_count += DOTS_PER_CYCLE;
+    gb->dot_count %= DOTS_PER_FRAME; // It takes 70224 dots to do one frame
+
+    if (gb->timeline != NULL &&
+        gb->dot_count % DOTS_PER_LINE < DOTS_PER_CYCLE) { // New scanline
+        timeline_end(gb->timeline, TL_SCANLINE);
+        timeline_begin(gb->timeline, TL_SCANLINE,
+                       gb->dot_count / DOTS_PER_LINE);
+    }
 
     // Update the current line number
     write_mem8(gb, LY, gb->dot_count / 456); // To LY stub, comment me out.
@@ -681,21 +1095,44 @@ static void update_screen(struct gb *const gb) {
     if (gb->dot_count >= 65664) { // vblank
         if (gb->graphics_mode != VBLANK) {
             enter_vblank(gb);
+            gb->frame_count++;
+            if (gb->cheats != NULL) {
+                cheats_apply(gb->cheats, gb);
+            }
+            if (gb->timeline != NULL) {
+                timeline_end(gb->timeline, TL_FRAME);
+                timeline_begin(gb->timeline, TL_FRAME, gb->frame_count);
+                timeline_begin(gb->timeline, TL_VBLANK_RENDER,
+                               gb->frame_count);
+            }
             // Draw the whole background at once upon entering vblank
             // The real thing does it line by line as it goes, but this is
             // easier
-            uint8_t const lcdc = read_mem8(gb, LCD_CONTROL);
-            uint1_t const window_and_bg_enabled = lcdc;
-            uint1_t const window_enabled = lcdc >> 5;
-            uint1_t const obj_enabled = lcdc >> 1;
-            if (window_and_bg_enabled) {
-                render_background(gb);
-                if (window_enabled) {
-                    render_window(gb);
+            if (!gb->skip_render) {
+                TIMER_START(render_start);
+                uint8_t const lcdc = read_mem8(gb, LCD_CONTROL);
+                uint1_t const window_and_bg_enabled = lcdc;
+                uint1_t const window_enabled = lcdc >> 5;
+                uint1_t const obj_enabled = lcdc >> 1;
+                if (window_and_bg_enabled) {
+                    render_background(gb);
+                    if (window_enabled) {
+                        render_window(gb);
+                    }
+                }
+                if (obj_enabled) {
+                    render_sprites(gb);
+                }
+                TIMER_STOP(gb, render_ns, render_start);
+                if (gb->hash_frames) {
+                    gb->frame_hash = hash_frame(gb);
+                }
+                if (gb->share != NULL) {
+                    share_publish(gb->share, gb);
                 }
             }
-            if (obj_enabled) {
-                render_sprites(gb);
+            if (gb->timeline != NULL) {
+                timeline_end(gb->timeline, TL_VBLANK_RENDER);
             }
         }
     } else if (gb->dot_count % 456 >=
@@ -719,6 +1156,7 @@ void wait(struct gb *const gb) {
     uint1_t const timer_enabled = read_mem8(gb, TAC) >> 2;
 
     while (gb->cycles_to_wait > 0) {
+        COUNT(gb, cycles);
         gb->cycle_count += 1;
         gb->cycles_to_wait -= 1;
         if (gb->cycle_count % CLOCKS_PER_DIVIDER_INCREMENT == 0) {
@@ -751,9 +1189,81 @@ void wait(struct gb *const gb) {
         }
 
         if (read_mem8(gb, LCD_CONTROL) >> 7) { // If the LCD is enabled (LCDC.7)
+            TIMER_START(update_screen_start);
             update_screen(gb);
+            TIMER_STOP(gb, update_screen_ns, update_screen_start);
+        }
+    }
+}
+
+enum stop_reason run_frame(struct gb *const gb) {
+    if (gb->debugger != NULL) {
+        return debugger_run(gb, 1, 0);
+    }
+    uint64_t const start_frame = gb->frame_count;
+    uint64_t const start_cycle = gb->cycle_count;
+    while (gb->frame_count == start_frame) {
+        step(gb);
+        wait(gb);
+        if (!(read_mem8(gb, LCD_CONTROL) >> 7) &&
+            gb->cycle_count - start_cycle >= CYCLES_PER_FRAME) {
+            break;
         }
     }
+    return gb->fault != FAULT_NONE ? STOP_FAULT : STOP_DONE;
+}
+
+enum stop_reason run_cycles(struct gb *const gb, uint64_t const cycles) {
+    if (gb->debugger != NULL) {
+        return debugger_run(gb, 0, cycles);
+    }
+    uint64_t const start_cycle = gb->cycle_count;
+    while (gb->cycle_count - start_cycle < cycles) {
+        step(gb);
+        wait(gb);
+    }
+    return gb->fault != FAULT_NONE ? STOP_FAULT : STOP_DONE;
+}
+
+enum stop_reason run_frames(struct gb *const gb, uint64_t const k,
+                            uint8_t const buttons,
+                            uint8_t out[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                            struct watch_var const *const vars,
+                            size_t const num_vars, uint32_t *const values) {
+    uint1_t const skip_render = gb->skip_render;
+    set_buttons(gb, buttons);
+    gb->skip_render = 1;
+    enum stop_reason reason = STOP_DONE;
+    for (uint64_t f = 2; f < k && reason == STOP_DONE; f++) {
+        reason = run_frame(gb);
+    }
+    gb->skip_render = skip_render;
+    if (reason == STOP_DONE && k >= 2) {
+        reason = run_frame(gb);
+        get_frame(gb, out);
+    }
+    if (reason == STOP_DONE) {
+        reason = run_frame(gb);
+        if (k >= 2) {
+            max_frame(gb, out);
+        } else {
+            get_frame(gb, out);
+        }
+    }
+    watch_read(gb, vars, num_vars, values);
+    return reason;
+}
+
+uint1_t get_counters(struct gb const *const gb, struct counters *const out) {
+#ifdef COUNTERS
+    *out = gb->counters;
+    out->frames = gb->frame_count;
+    return 1;
+#else
+    (void)gb;
+    memset(out, 0, sizeof(*out));
+    return 0;
+#endif
 }
 
 static void add_a(struct gb *const gb, uint8_t const operand) {
@@ -867,9 +1377,9 @@ static uint8_t dec8(struct gb *const gb, uint8_t const operand) {
 }
 
 void step(struct gb *const gb) {
-    uint8_t const opcode = read_mem8(gb, gb->pc);
-    uint8_t const imm8 = read_mem8(gb, gb->pc + 1);
-    uint16_t const imm16 = read_mem16(gb, gb->pc + 1);
+    uint8_t const opcode = fetch_mem8(gb, gb->pc);
+    uint8_t const imm8 = fetch_mem8(gb, gb->pc + 1);
+    uint16_t const imm16 = fetch_mem16(gb, gb->pc + 1);
     enum r_reg const upper_r = (uint3_t)(opcode >> 3);
     enum r_reg const lower_r = (uint3_t)opcode;
     enum dd_reg const dd = (uint2_t)(opcode >> 4); // Same as ss
@@ -881,14 +1391,27 @@ void step(struct gb *const gb) {
         if (gb->cycles_to_wait == 0) {
             gb->cycles_to_wait += 1;
         }
-        if (gb->need_to_do_interrupts) {
+        // A locked-up CPU never wakes.
+        if (gb->need_to_do_interrupts && gb->fault == FAULT_NONE) {
             handle_interrupts(gb);
         }
         return;
     }
 
+    if (gb->trace != NULL) {
+        trace_record(gb->trace, gb,
+                     opcode | (imm16 << 8) |
+                         ((uint32_t)fetch_mem8(gb, gb->pc + 3) << 24));
+    }
+    if (gb->coverage != NULL) {
+        coverage_record(gb->coverage, gb->pc);
+    }
+
+#ifdef VERBOSE
     dump(gb);
+#endif
 
+    COUNT(gb, instructions);
     DEBUG("[0x%04" PRIX16 "]: 0x%02" PRIX8 "\t", gb->pc, opcode);
     switch (opcode) {
     case 0b01000000:
@@ -2236,7 +2759,11 @@ void step(struct gb *const gb) {
         break;
     }
     default: {
-        DIE("Unrecognized opcode 0x%02" PRIX8 "!\n", opcode);
+        // The 11 unused opcodes lock up the CPU, leaving PC on the opcode.
+        gb->fault = FAULT_ILLEGAL_OPCODE;
+        gb->halted = 1;
+        gb->cycles_to_wait += 1;
+        return;
     }
     }
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h> // for size_t
 #include <stdint.h> // for uint8_t, uint16_t, uint64_t
 
 #define ADDRESS_SPACE_SIZE (0x10000)
@@ -11,6 +12,11 @@
 #define TILE_WIDTH (8) // Pixels
 #define TILE_HEIGHT (8) // Pixels
 
+#define DOTS_PER_FRAME (70224)
+#define DOTS_PER_LINE (456)
+#define DOTS_PER_CYCLE (16) // Dots per one of our M-cycles
+#define CYCLES_PER_FRAME (DOTS_PER_FRAME / DOTS_PER_CYCLE)
+
 typedef unsigned _BitInt(1) uint1_t;
 
 enum joypad_button {
@@ -34,6 +40,62 @@ enum joypad_mode {
 
 enum graphics_mode { HBLANK = 0, VBLANK = 1, SEARCHING = 2, TRANSFERRING = 3 };
 
+enum bus_region {
+    REGION_ROM = 0,      // 0x0000-0x7FFF
+    REGION_VRAM = 1,     // 0x8000-0x9FFF
+    REGION_CART_RAM = 2, // 0xA000-0xBFFF
+    REGION_WRAM = 3,     // 0xC000-0xDFFF
+    REGION_ECHO_RAM = 4, // 0xE000-0xFDFF
+    REGION_OAM = 5,      // 0xFE00-0xFE9F
+    REGION_UNUSED = 6,   // 0xFEA0-0xFEFF
+    REGION_IO = 7,       // 0xFF00-0xFF7F
+    REGION_HRAM = 8,     // 0xFF80-0xFFFE
+    REGION_IE = 9,       // 0xFFFF
+    NUM_REGIONS = 10,
+};
+
+#define GB_WRAM_SIZE (0x2000) // 0xC000-0xDFFF
+#define GB_HRAM_SIZE (0x7F)   // 0xFF80-0xFFFE
+
+// One bit per WRAM and HRAM byte, for addresses left out of ram_hash
+#define RAM_HASH_MASK_WORDS ((GB_WRAM_SIZE + GB_HRAM_SIZE + 63) / 64)
+
+#define NUM_IO_REGS (0x80)
+#define NUM_INTERRUPTS (5)
+
+// Host-side performance counters. These are only accumulated when built with
+// -DCOUNTERS; otherwise they cost nothing and get_counters() reports zeros.
+// Bus accesses include the emulator's own (the PPU and timers read their
+// registers through the bus too).
+struct counters {
+    uint64_t instructions;
+    uint64_t cycles; // M-cycles
+    uint64_t frames;
+    uint64_t reads[NUM_REGIONS];
+    uint64_t writes[NUM_REGIONS];
+    uint64_t io_reads[NUM_IO_REGS];
+    uint64_t io_writes[NUM_IO_REGS];
+    uint64_t interrupts[NUM_INTERRUPTS]; // Dispatched, by IF bit
+    uint64_t dma_transfers;
+    uint64_t update_screen_ns;
+    uint64_t render_ns; // Drawing the frame at the start of vblank
+};
+
+struct trace;    // See trace.h
+struct timeline; // See timeline.h
+struct share;    // See share.h
+struct debugger; // See debugger.h
+struct coverage; // See coverage.h
+struct cheats;   // See cheats.h
+struct watch_var; // See watch.h
+
+// Why the CPU locked up, if it has. A locked-up CPU stays halted for good,
+// while the PPU and timers keep running, as on hardware.
+enum fault {
+    FAULT_NONE = 0,
+    FAULT_ILLEGAL_OPCODE = 1, // One of the 11 unused opcodes, at PC
+};
+
 struct point {
     uint8_t r;
     uint8_t c;
@@ -53,22 +115,140 @@ struct gb {
     uint64_t cycle_count;
     uint1_t need_to_do_interrupts;
     uint64_t dot_count;
+    uint64_t frame_count;
+    uint1_t hash_frames; // If set, frame_hash is updated at every vblank
+    uint64_t frame_hash; // Hash of the last frame drawn, as get_frame() sees it
+    uint1_t skip_render; // If set, vblank doesn't draw the screen
+    uint1_t hash_ram;    // If set, ram_hash is updated on every store
+    uint64_t ram_hash;   // See enable_ram_hash()
+    uint64_t ram_hash_excluded[RAM_HASH_MASK_WORDS];
     enum graphics_mode graphics_mode;
     uint1_t halted;
+    enum fault fault;
     uint1_t buttons_pressed[NUM_BUTTONS];
     enum joypad_mode joypad_mode;
+    uint1_t flat_bus; // If set, memory is 64K of plain RAM, with no I/O or ROM
+    struct trace *trace; // If non-NULL, every executed instruction is recorded
+    struct timeline *timeline; // If non-NULL, frames and scanlines are timed
+    struct share *share; // If non-NULL, every drawn frame is published
+    struct debugger *debugger; // If non-NULL, breakpoints can stop runs
+    struct coverage *coverage; // If non-NULL, executed code is recorded
+    struct cheats *cheats;     // If non-NULL, cheat codes are applied
+#ifdef COUNTERS
+    struct counters counters;
+#endif
 };
 
 void press_button(struct gb *gb, enum joypad_button btn);
 
 void release_button(struct gb *gb, enum joypad_button btn);
 
+// Holds down the buttons set in buttons (bit n for enum joypad_button n) and
+// releases the rest.
+void set_buttons(struct gb *gb, uint8_t buttons);
+
 void step(struct gb *gb);
 
 void wait(struct gb *gb);
 
+// Why run_frame() or run_cycles() returned. Only a machine with a debugger
+// attached stops early; see debugger.h. A locked-up CPU (see gb->fault)
+// doesn't stop a run, but is reported at the end of it.
+enum stop_reason {
+    STOP_DONE = 0,        // Ran as far as asked
+    STOP_BREAKPOINT = 1,  // Before the instruction at a breakpoint
+    STOP_WATCH_READ = 2,  // After an instruction read a watched address
+    STOP_WATCH_WRITE = 3, // After an instruction wrote a watched address
+    STOP_FAULT = 4,       // Ran as far as asked, but the CPU has locked up
+};
+
+// Runs until the PPU enters vblank, or for a frame's worth of cycles if the
+// LCD is off.
+enum stop_reason run_frame(struct gb *gb);
+
+// Runs whole instructions until at least cycles M-cycles have passed.
+enum stop_reason run_cycles(struct gb *gb, uint64_t cycles);
+
+// Holds buttons (as in set_buttons()) for k frames and writes the element-wise
+// max of the last two into out, so that sprites that flicker on alternate
+// frames show up. A k of 0 runs one frame, as 1 does. The screen isn't drawn
+// for the first k - 2 frames, so until the next drawn frame, gb->screen and
+// frame_hash differ from what k calls to run_frame() would leave. The last two
+// are drawn unless gb->skip_render was already set, which is left as it was.
+//
+// Returns the first reason a frame stopped other than STOP_DONE (see
+// run_frame()), without running the rest, in which case out may be
+// incomplete. Otherwise returns STOP_DONE.
+//
+// Either way, it then packs the values of num_vars watched variables into
+// values, as watch_read() does. vars and values can be NULL if num_vars is 0.
+enum stop_reason run_frames(struct gb *gb, uint64_t k, uint8_t buttons,
+                            uint8_t out[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                            struct watch_var const *vars, size_t num_vars,
+                            uint32_t *values);
+
+// Reads or writes memory as the CPU would, side effects and all (e.g., a
+// write to DIV clears it). For debuggers; they never trigger watchpoints.
+uint8_t bus_read(struct gb *gb, uint16_t address);
+
+void bus_write(struct gb *gb, uint16_t address, uint8_t value);
+
+uint1_t get_counters(struct gb const *gb, struct counters *out);
+
 struct point get_origin(struct gb *gb);
 
+// Copies out the visible part of the screen, as scrolled by SCX and SCY. Each
+// pixel is a color number from 0 (white) to 3 (black).
+void get_frame(struct gb *gb, uint8_t out[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]);
+
+// Like get_frame(), but keeps the larger of each pixel and what's in out.
+void max_frame(struct gb *gb, uint8_t out[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]);
+
+// Work RAM (GB_WRAM_SIZE bytes) and high RAM (GB_HRAM_SIZE bytes), read in
+// place. The pointers stay valid, and see every write, for as long as gb does.
+uint8_t const *get_wram(struct gb const *gb);
+
+uint8_t const *get_hram(struct gb const *gb);
+
+// ram_hash is a hash of WRAM and HRAM that write_mem8() keeps up to date in
+// constant time per store: the XOR, over every included address, of a mix of
+// the address and its value. This computes it and sets hash_ram.
+void enable_ram_hash(struct gb *gb);
+
+// Leaves address (in WRAM or HRAM; others are ignored) out of ram_hash from
+// now on, e.g., for frame counters and RNG state.
+void exclude_from_ram_hash(struct gb *gb, uint16_t address);
+
+// ram_hash from scratch, whether or not hash_ram is set.
+uint64_t compute_ram_hash(struct gb const *gb);
+
+// The hash of the visible part of the screen, as stored in frame_hash.
+uint64_t hash_frame(struct gb *gb);
+
 void dump(struct gb *gb);
 
 void initialize(struct gb *gb, char const *path);
+
+void initialize_from_buffer(struct gb *gb, uint8_t const *rom, size_t size);
+
+// A save state is a copy of struct gb. Loading one keeps the machine's own
+// host-side attachments (trace, timeline, share, debugger, coverage and
+// cheats), and Game Genie patches stay out of the state; see cheats.h.
+void save_state(struct gb const *gb, struct gb *state);
+
+void load_state(struct gb *gb, struct gb const *state);
+
+// Hashes everything that affects emulation: registers, timing, memory and the
+// screen. Host-side fields (attachments, counters, frame hashing) are left out,
+// so two machines hash the same iff they'll behave the same.
+uint64_t hash_state(struct gb const *gb);
+
+// Save state files only load into builds with the same struct gb layout.
+// Both return 0 on success, or -1 on failure.
+int write_state(struct gb const *gb, char const *path);
+
+int read_state(struct gb *gb, char const *path);
+
+// Sets gb up with a flat bus: all 64K of memory zeroed plain RAM, for
+// running the CPU on its own.
+void initialize_flat(struct gb *gb);
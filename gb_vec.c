@@ -0,0 +1,469 @@
+#define _GNU_SOURCE  // for pthread_barrier_*, sysconf(3)
+#include <pthread.h> // for pthread_*
+#include <stddef.h>  // for NULL, size_t
+#include <stdint.h>  // for uint8_t, uint64_t
+#include <stdlib.h>  // for calloc, malloc, free
+#include <string.h>  // for memcpy
+#include <unistd.h>  // for sysconf
+
+#include "batch.h"
+#include "frame.h"
+#include "gb_vec.h"
+#include "watch.h"
+
+// The calling thread is worker 0, so a step costs two barrier waits and no
+// thread wakeups beyond those. Each worker owns a fixed, contiguous range of
+// instances.
+
+enum job {
+    JOB_STEP = 0,
+    JOB_RESET = 1,
+    JOB_QUIT = 2,
+};
+
+struct worker {
+    struct gb_vec *vec;
+    size_t first; // Instances [first, last)
+    size_t last;
+    struct batch **batches; // If batched, BATCH_LANES instances each
+    size_t num_batches;
+    uint8_t (*frames)[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]; // Batched max_pool
+    pthread_t thread;
+};
+
+struct gb_vec {
+    struct gb_vec_config config;
+    size_t observation_size;
+    struct gb *envs;
+    struct gb *initial; // The power-on state, for resets
+    struct watch_var *vars; // config.vars points here
+    uint32_t *values;       // num_vars per instance
+    uint64_t *ram_hashes;   // One per instance, if config.hash_ram
+
+    struct worker *workers;
+    size_t num_workers;
+    pthread_mutex_t lock; // Only used to hold workers back until set up
+    pthread_cond_t cond;
+    uint1_t ready;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+
+    // The current job, set before the start barrier
+    enum job job;
+    uint8_t const *buttons;
+    uint8_t *observations;
+};
+
+// Writes a frame into an observation of a frame kind
+static void convert(struct gb_vec const *const vec,
+                    uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                    uint8_t *const out) {
+    switch (vec->config.observation) {
+    case GB_VEC_FRAME:
+        memcpy(out, frame, GB_SCREEN_HEIGHT * GB_SCREEN_WIDTH);
+        break;
+    case GB_VEC_FRAME_HALF:
+        frame_downsample_half(frame, (uint8_t (*)[FRAME_HALF_WIDTH])out);
+        break;
+    case GB_VEC_FRAME_SQUARE:
+        frame_resize_square(frame, (uint8_t (*)[FRAME_SQUARE_SIZE])out);
+        break;
+    case GB_VEC_FRAME_PACKED:
+        frame_pack_2bpp(frame, (uint8_t (*)[FRAME_PACKED_ROW_SIZE])out);
+        break;
+    case GB_VEC_RAM:
+    default:
+        break;
+    }
+}
+
+static void observe(struct gb_vec const *const vec, size_t const i,
+                    uint8_t *const out) {
+    struct gb *const gb = &vec->envs[i];
+    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    switch (vec->config.observation) {
+    case GB_VEC_FRAME:
+        get_frame(gb, (uint8_t (*)[GB_SCREEN_WIDTH])out);
+        break;
+    case GB_VEC_RAM:
+        memcpy(out, gb->address_space + vec->config.ram_start,
+               vec->config.ram_size);
+        break;
+    case GB_VEC_FRAME_HALF:
+    case GB_VEC_FRAME_SQUARE:
+    case GB_VEC_FRAME_PACKED:
+    default:
+        get_frame(gb, frame);
+        convert(vec, frame, out);
+        break;
+    }
+}
+
+// A step with max_pool set, on one instance
+static void run_pooled_step(struct gb_vec const *const vec, size_t const i) {
+    uint8_t *const observation =
+        vec->observations == NULL
+            ? NULL
+            : vec->observations + i * vec->observation_size;
+    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    if (observation != NULL && vec->config.observation == GB_VEC_FRAME) {
+        // Pool straight into the observation
+        run_frames(&vec->envs[i], vec->config.frames_per_step,
+                   vec->buttons[i], (uint8_t (*)[GB_SCREEN_WIDTH])observation,
+                   NULL, 0, NULL);
+        return;
+    }
+    run_frames(&vec->envs[i], vec->config.frames_per_step, vec->buttons[i],
+               frame, NULL, 0, NULL); // run_job() reads the variables
+    if (observation != NULL) {
+        convert(vec, frame, observation);
+    }
+}
+
+static void run_batches(struct worker const *const w) {
+    for (size_t b = 0; b < w->num_batches; b++) {
+        batch_run_frame(w->batches[b]);
+    }
+}
+
+// The batched equivalent of run_frame() or run_frames() on each instance
+static void run_batched_step(struct worker const *const w) {
+    struct gb_vec const *const vec = w->vec;
+    uint64_t const k = vec->config.frames_per_step;
+    for (size_t i = w->first; i < w->last; i++) {
+        set_buttons(&vec->envs[i], vec->buttons[i]);
+    }
+    if (!vec->config.max_pool) {
+        for (uint64_t f = 0; f < k; f++) {
+            run_batches(w);
+        }
+        if (vec->observations != NULL) {
+            for (size_t i = w->first; i < w->last; i++) {
+                observe(vec, i, vec->observations + i * vec->observation_size);
+            }
+        }
+        return;
+    }
+
+    for (size_t i = w->first; i < w->last; i++) {
+        vec->envs[i].skip_render = 1;
+    }
+    for (uint64_t f = 2; f < k; f++) {
+        run_batches(w);
+    }
+    for (size_t i = w->first; i < w->last; i++) {
+        vec->envs[i].skip_render = 0;
+    }
+    if (k >= 2) {
+        run_batches(w);
+        for (size_t i = w->first; i < w->last; i++) {
+            get_frame(&vec->envs[i], w->frames[i - w->first]);
+        }
+    }
+    run_batches(w);
+    for (size_t i = w->first; i < w->last; i++) {
+        if (k >= 2) {
+            max_frame(&vec->envs[i], w->frames[i - w->first]);
+        } else {
+            get_frame(&vec->envs[i], w->frames[i - w->first]);
+        }
+        if (vec->observations != NULL) {
+            convert(vec, w->frames[i - w->first],
+                    vec->observations + i * vec->observation_size);
+        }
+    }
+}
+
+static void run_instances(struct worker const *const w) {
+    struct gb_vec const *const vec = w->vec;
+    if (vec->job == JOB_STEP && w->batches != NULL) {
+        run_batched_step(w);
+        return;
+    }
+    for (size_t i = w->first; i < w->last; i++) {
+        struct gb *const gb = &vec->envs[i];
+        switch (vec->job) {
+        case JOB_STEP:
+            if (vec->config.max_pool) {
+                run_pooled_step(vec, i);
+                continue;
+            }
+            set_buttons(gb, vec->buttons[i]);
+            for (uint64_t f = 0; f < vec->config.frames_per_step; f++) {
+                run_frame(gb);
+            }
+            break;
+        case JOB_RESET:
+            load_state(gb, vec->initial);
+            break;
+        case JOB_QUIT:
+        default:
+            return;
+        }
+        if (vec->observations != NULL) {
+            observe(vec, i, vec->observations + i * vec->observation_size);
+        }
+    }
+}
+
+static void run_job(struct worker const *const w) {
+    struct gb_vec const *const vec = w->vec;
+    run_instances(w);
+    size_t const n = vec->config.num_vars;
+    for (size_t i = w->first; n > 0 && i < w->last; i++) {
+        watch_read(&vec->envs[i], vec->vars, n, vec->values + i * n);
+    }
+    for (size_t i = w->first; vec->config.hash_ram && i < w->last; i++) {
+        vec->ram_hashes[i] = vec->envs[i].ram_hash;
+    }
+}
+
+static void *worker_main(void *const arg) {
+    struct worker const *const w = arg;
+    struct gb_vec *const vec = w->vec;
+    pthread_mutex_lock(&vec->lock);
+    while (!vec->ready) {
+        pthread_cond_wait(&vec->cond, &vec->lock);
+    }
+    pthread_mutex_unlock(&vec->lock);
+    while (1) {
+        pthread_barrier_wait(&vec->start);
+        if (vec->job == JOB_QUIT) {
+            break;
+        }
+        run_job(w);
+        pthread_barrier_wait(&vec->done);
+    }
+    return NULL;
+}
+
+static void close_batches(struct worker *const w) {
+    for (size_t b = 0; b < w->num_batches; b++) {
+        batch_close(w->batches[b]);
+    }
+    free(w->batches);
+    free(w->frames);
+    w->batches = NULL;
+    w->frames = NULL;
+    w->num_batches = 0;
+}
+
+// Splits a worker's instances into batches. If that fails, the worker runs
+// them one at a time instead.
+static void open_batches(struct worker *const w) {
+    size_t const count = w->last - w->first;
+    size_t const num_batches = (count + BATCH_LANES - 1) / BATCH_LANES;
+    w->batches = calloc(num_batches, sizeof(*w->batches));
+    if (w->batches == NULL) {
+        return;
+    }
+    if (w->vec->config.max_pool) {
+        w->frames = malloc(count * sizeof(*w->frames));
+        if (w->frames == NULL) {
+            close_batches(w);
+            return;
+        }
+    }
+    for (size_t b = 0; b < num_batches; b++) {
+        size_t const first = w->first + b * BATCH_LANES;
+        size_t const lanes =
+            w->last - first < BATCH_LANES ? w->last - first : BATCH_LANES;
+        struct gb *envs[BATCH_LANES];
+        for (size_t i = 0; i < lanes; i++) {
+            envs[i] = &w->vec->envs[first + i];
+        }
+        w->batches[b] = batch_open(envs, lanes);
+        if (w->batches[b] == NULL) {
+            close_batches(w);
+            return;
+        }
+        w->num_batches++;
+    }
+}
+
+// Runs a job on every instance, with the calling thread doing its share
+static void dispatch(struct gb_vec *const vec, enum job const job,
+                     uint8_t const *const buttons,
+                     uint8_t *const observations) {
+    vec->job = job;
+    vec->buttons = buttons;
+    vec->observations = observations;
+    pthread_barrier_wait(&vec->start);
+    run_job(&vec->workers[0]);
+    pthread_barrier_wait(&vec->done);
+}
+
+struct gb_vec *gb_vec_open(uint8_t const *const rom, size_t const rom_size,
+                           struct gb_vec_config const *const config) {
+    if (config->num_envs == 0) {
+        return NULL;
+    }
+    size_t observation_size;
+    switch (config->observation) {
+    case GB_VEC_FRAME:
+        observation_size = GB_SCREEN_HEIGHT * GB_SCREEN_WIDTH;
+        break;
+    case GB_VEC_RAM:
+        if (config->ram_size == 0 ||
+            config->ram_start + config->ram_size > ADDRESS_SPACE_SIZE) {
+            return NULL;
+        }
+        observation_size = config->ram_size;
+        break;
+    case GB_VEC_FRAME_HALF:
+        observation_size = FRAME_HALF_HEIGHT * FRAME_HALF_WIDTH;
+        break;
+    case GB_VEC_FRAME_SQUARE:
+        observation_size = FRAME_SQUARE_SIZE * FRAME_SQUARE_SIZE;
+        break;
+    case GB_VEC_FRAME_PACKED:
+        observation_size = GB_SCREEN_HEIGHT * FRAME_PACKED_ROW_SIZE;
+        break;
+    default:
+        return NULL;
+    }
+    if (!watch_vars_valid(config->vars, config->num_vars)) {
+        return NULL;
+    }
+
+    struct gb_vec *const vec = calloc(1, sizeof(*vec));
+    if (vec == NULL) {
+        return NULL;
+    }
+    vec->config = *config;
+    if (vec->config.frames_per_step == 0) {
+        vec->config.frames_per_step = 1;
+    }
+    if (vec->config.observation == GB_VEC_RAM) {
+        vec->config.max_pool = 0; // Nothing to pool
+    }
+    vec->observation_size = observation_size;
+
+    size_t num_workers = config->num_threads;
+    if (num_workers == 0) {
+        long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (num_workers > config->num_envs) {
+        num_workers = config->num_envs;
+    }
+
+    vec->envs = calloc(config->num_envs, sizeof(*vec->envs));
+    vec->initial = calloc(1, sizeof(*vec->initial));
+    vec->workers = calloc(num_workers, sizeof(*vec->workers));
+    vec->vars = calloc(config->num_vars + 1, sizeof(*vec->vars));
+    vec->values =
+        calloc(config->num_envs * config->num_vars + 1, sizeof(*vec->values));
+    vec->ram_hashes = calloc(config->num_envs, sizeof(*vec->ram_hashes));
+    if (vec->envs == NULL || vec->initial == NULL || vec->workers == NULL ||
+        vec->vars == NULL || vec->values == NULL || vec->ram_hashes == NULL) {
+        free(vec->envs);
+        free(vec->initial);
+        free(vec->workers);
+        free(vec->vars);
+        free(vec->values);
+        free(vec->ram_hashes);
+        free(vec);
+        return NULL;
+    }
+    if (config->num_vars > 0) {
+        memcpy(vec->vars, config->vars, config->num_vars * sizeof(*vec->vars));
+    }
+    vec->config.vars = vec->vars;
+    initialize_from_buffer(vec->initial, rom, rom_size);
+    if (config->hash_ram) {
+        for (size_t i = 0; i < config->num_ram_hash_excluded; i++) {
+            exclude_from_ram_hash(vec->initial, config->ram_hash_excluded[i]);
+        }
+        enable_ram_hash(vec->initial);
+    }
+    for (size_t i = 0; i < config->num_envs; i++) {
+        save_state(vec->initial, &vec->envs[i]);
+    }
+
+    // Worker 0 is the calling thread. If a thread can't be started, the
+    // instances are split among the workers that did start.
+    pthread_mutex_init(&vec->lock, NULL);
+    pthread_cond_init(&vec->cond, NULL);
+    vec->num_workers = 1;
+    for (size_t t = 0; t < num_workers; t++) {
+        vec->workers[t].vec = vec;
+    }
+    for (size_t t = 1; t < num_workers; t++) {
+        if (pthread_create(&vec->workers[t].thread, NULL, worker_main,
+                           &vec->workers[t]) != 0) {
+            break;
+        }
+        vec->num_workers++;
+    }
+    for (size_t t = 0; t < vec->num_workers; t++) {
+        struct worker *const w = &vec->workers[t];
+        w->first = config->num_envs * t / vec->num_workers;
+        w->last = config->num_envs * (t + 1) / vec->num_workers;
+        if (config->batched) {
+            open_batches(w);
+        }
+    }
+    pthread_barrier_init(&vec->start, NULL, vec->num_workers);
+    pthread_barrier_init(&vec->done, NULL, vec->num_workers);
+
+    pthread_mutex_lock(&vec->lock);
+    vec->ready = 1;
+    pthread_cond_broadcast(&vec->cond);
+    pthread_mutex_unlock(&vec->lock);
+    return vec;
+}
+
+size_t gb_vec_num_envs(struct gb_vec const *const vec) {
+    return vec->config.num_envs;
+}
+
+size_t gb_vec_observation_size(struct gb_vec const *const vec) {
+    return vec->observation_size;
+}
+
+void gb_vec_reset(struct gb_vec *const vec, uint8_t *const observations) {
+    dispatch(vec, JOB_RESET, NULL, observations);
+}
+
+void gb_vec_step(struct gb_vec *const vec, uint8_t const *const buttons,
+                 uint8_t *const observations) {
+    dispatch(vec, JOB_STEP, buttons, observations);
+}
+
+uint32_t const *gb_vec_values(struct gb_vec const *const vec) {
+    return vec->config.num_vars > 0 ? vec->values : NULL;
+}
+
+uint64_t const *gb_vec_ram_hashes(struct gb_vec const *const vec) {
+    return vec->config.hash_ram ? vec->ram_hashes : NULL;
+}
+
+struct gb *gb_vec_instance(struct gb_vec *const vec, size_t const i) {
+    return i < vec->config.num_envs ? &vec->envs[i] : NULL;
+}
+
+void gb_vec_close(struct gb_vec *const vec) {
+    if (vec == NULL) {
+        return;
+    }
+    vec->job = JOB_QUIT;
+    pthread_barrier_wait(&vec->start);
+    for (size_t t = 1; t < vec->num_workers; t++) {
+        pthread_join(vec->workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&vec->start);
+    pthread_barrier_destroy(&vec->done);
+    pthread_cond_destroy(&vec->cond);
+    pthread_mutex_destroy(&vec->lock);
+    for (size_t t = 0; t < vec->num_workers; t++) {
+        close_batches(&vec->workers[t]);
+    }
+    free(vec->envs);
+    free(vec->initial);
+    free(vec->workers);
+    free(vec->vars);
+    free(vec->values);
+    free(vec->ram_hashes);
+    free(vec);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint32_t, uint64_t
+
+#include "gb.h"
+#include "watch.h"
+
+// A vectorised environment: many instances of one ROM, stepped together. Each
+// step takes one button bitmask per instance, runs every instance for the same
+// number of frames across a pool of worker threads, and writes one observation
+// per instance into a single contiguous buffer, instance-major.
+
+enum gb_vec_observation {
+    GB_VEC_FRAME = 0,        // The visible screen, one color number per byte
+    GB_VEC_RAM = 1,          // ram_size bytes of memory from ram_start
+    GB_VEC_FRAME_HALF = 2,   // 80x72 grayscale; see frame.h
+    GB_VEC_FRAME_SQUARE = 3, // 84x84 grayscale
+    GB_VEC_FRAME_PACKED = 4, // The visible screen, four pixels per byte
+};
+
+struct gb_vec_config {
+    size_t num_envs;
+    size_t num_threads;       // 0 for one per online CPU
+    uint64_t frames_per_step; // Action repeat; 0 is treated as 1
+    uint1_t batched;          // Run instances in batches; see batch.h
+    uint1_t max_pool;         // Pool the last two frames; see run_frames()
+    enum gb_vec_observation observation;
+    uint16_t ram_start; // GB_VEC_RAM only
+    size_t ram_size;    // GB_VEC_RAM only
+    // Variables to read after every reset and step; gb_vec_open() copies them
+    struct watch_var const *vars;
+    size_t num_vars;
+    // Keep each instance's ram_hash (see enable_ram_hash()), leaving out the
+    // listed addresses
+    uint1_t hash_ram;
+    uint16_t const *ram_hash_excluded;
+    size_t num_ram_hash_excluded;
+};
+
+// Creates num_envs instances of rom, all in the power-on state. Returns NULL if
+// the config is invalid or something couldn't be allocated.
+struct gb_vec *gb_vec_open(uint8_t const *rom, size_t rom_size,
+                           struct gb_vec_config const *config);
+
+size_t gb_vec_num_envs(struct gb_vec const *vec);
+
+// Bytes of one instance's observation. The buffers passed to gb_vec_reset()
+// and gb_vec_step() hold num_envs of these.
+size_t gb_vec_observation_size(struct gb_vec const *vec);
+
+// Puts every instance back in the power-on state. If observations isn't NULL,
+// the initial observations are written to it.
+void gb_vec_reset(struct gb_vec *vec, uint8_t *observations);
+
+// Holds down the buttons set in buttons[i] (bit n for enum joypad_button n) on
+// instance i, releasing the rest, then runs every instance for
+// frames_per_step frames and writes the observations.
+void gb_vec_step(struct gb_vec *vec, uint8_t const *buttons,
+                 uint8_t *observations);
+
+// The watched variables' values as of the last reset or step, num_vars per
+// instance, instance-major; see watch_read(). NULL if no variables are
+// watched. The buffer is the same for the life of vec.
+uint32_t const *gb_vec_values(struct gb_vec const *vec);
+
+// Each instance's ram_hash as of the last reset or step, or NULL if hash_ram
+// isn't set. The buffer is the same for the life of vec.
+uint64_t const *gb_vec_ram_hashes(struct gb_vec const *vec);
+
+// Direct access to one instance, e.g., for reading game state in place with
+// get_wram() and get_hram(). Don't call this while a step is running.
+struct gb *gb_vec_instance(struct gb_vec *vec, size_t i);
+
+void gb_vec_close(struct gb_vec *vec);
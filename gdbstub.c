@@ -0,0 +1,592 @@
+#define _GNU_SOURCE       // for accept4(2), MSG_NOSIGNAL, SOCK_NONBLOCK
+#include <arpa/inet.h>    // for htons, htonl
+#include <errno.h>        // for errno, EINTR, EAGAIN
+#include <netinet/in.h>   // for sockaddr_in, INADDR_LOOPBACK
+#include <stddef.h>       // for NULL, size_t
+#include <stdint.h>       // for uint8_t, uint16_t, uint32_t
+#include <stdio.h>        // for perror, snprintf
+#include <stdlib.h>       // for malloc, free, strtoul
+#include <string.h>       // for memcpy, memmove, strcmp, strlen, strncmp
+#include <sys/socket.h>   // for socket, bind, listen, accept4, recv, send
+#include <sys/un.h>       // for sockaddr_un
+#include <unistd.h>       // for close, unlink
+
+#include "debugger.h"
+#include "gb.h"
+#include "gdbstub.h"
+
+#define MAX_PACKET (0x1000)
+#define NUM_REGISTERS (13) // As gdb's z80 target has them
+#define SIGNAL_INT (2u)
+#define SIGNAL_ILL (4u)
+#define SIGNAL_TRAP (5u)
+
+struct gdbstub {
+    int listener;
+    int fd;          // The connection to gdb, or -1
+    char *unix_path; // To unlink on close, or NULL for TCP
+    uint1_t no_ack;  // Set once gdb asks for QStartNoAckMode
+    uint1_t faulted; // Set once gdb has been told that the CPU locked up
+    uint8_t in[MAX_PACKET];
+    size_t in_start;
+    size_t in_end;
+    char packet[MAX_PACKET + 1]; // The last packet received, NUL-terminated
+    char out[MAX_PACKET + 1];
+};
+
+struct gdbstub *gdbstub_open(char const *const address) {
+    struct gdbstub *const stub = malloc(sizeof(*stub));
+    if (stub == NULL) {
+        return NULL;
+    }
+    stub->fd = -1;
+    stub->unix_path = NULL;
+    stub->no_ack = 0;
+    stub->faulted = 0;
+    stub->in_start = 0;
+    stub->in_end = 0;
+    int rc;
+    if (address[0] != '\0' &&
+        strspn(address, "0123456789") == strlen(address)) {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(strtoul(address, NULL, 10)),
+            .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)},
+        };
+        stub->listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int const one = 1;
+        rc = stub->listener < 0 ||
+             setsockopt(stub->listener, SOL_SOCKET, SO_REUSEADDR, &one,
+                        sizeof(one)) != 0 ||
+             bind(stub->listener, (struct sockaddr const *)&addr,
+                  sizeof(addr)) != 0;
+    } else {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (strlen(address) >= sizeof(addr.sun_path)) {
+            free(stub);
+            return NULL;
+        }
+        memcpy(addr.sun_path, address, strlen(address) + 1);
+        stub->unix_path = malloc(strlen(address) + 1);
+        if (stub->unix_path == NULL) {
+            free(stub);
+            return NULL;
+        }
+        memcpy(stub->unix_path, address, strlen(address) + 1);
+        stub->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        unlink(address);
+        rc = stub->listener < 0 ||
+             bind(stub->listener, (struct sockaddr const *)&addr,
+                  sizeof(addr)) != 0;
+    }
+    if (rc != 0 || listen(stub->listener, 1) != 0) {
+        perror("gdbstub");
+        if (stub->listener >= 0) {
+            close(stub->listener);
+        }
+        free(stub->unix_path);
+        free(stub);
+        return NULL;
+    }
+    return stub;
+}
+
+static void detach(struct gdbstub *const stub, struct gb *const gb) {
+    close(stub->fd);
+    stub->fd = -1;
+    stub->no_ack = 0;
+    stub->faulted = 0;
+    stub->in_start = 0;
+    stub->in_end = 0;
+    debugger_close(gb->debugger);
+    gb->debugger = NULL;
+}
+
+void gdbstub_close(struct gdbstub *const stub, struct gb *const gb) {
+    if (stub == NULL) {
+        return;
+    }
+    if (stub->fd >= 0) {
+        detach(stub, gb);
+    }
+    close(stub->listener);
+    if (stub->unix_path != NULL) {
+        unlink(stub->unix_path);
+        free(stub->unix_path);
+    }
+    free(stub);
+}
+
+// Returns the next byte from gdb, or -1 if it has gone.
+static int get_byte(struct gdbstub *const stub) {
+    while (stub->in_start == stub->in_end) {
+        ssize_t const n = recv(stub->fd, stub->in, sizeof(stub->in), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        stub->in_start = 0;
+        stub->in_end = n;
+    }
+    return stub->in[stub->in_start++];
+}
+
+static int send_all(struct gdbstub *const stub, char const *const data,
+                    size_t const size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t const n =
+            send(stub->fd, data + done, size - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static char const HEX[] = "0123456789abcdef";
+
+// Returns the value of a hex digit, either case, or -1 if c isn't one.
+static int hex_digit(int const c) {
+    for (int i = 0; i < 16; i++) {
+        if (c == HEX[i] || c == "0123456789ABCDEF"[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Sends data as a packet and waits for gdb to acknowledge it. Returns 0 on
+// success, or -1 if gdb has gone.
+static int send_packet(struct gdbstub *const stub, char const *const data) {
+    size_t const size = strlen(data);
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < size; i++) {
+        checksum += (uint8_t)data[i];
+    }
+    char const trailer[3] = {'#', HEX[checksum >> 4], HEX[checksum & 0xF]};
+    while (1) {
+        if (send_all(stub, "$", 1) != 0 || send_all(stub, data, size) != 0 ||
+            send_all(stub, trailer, sizeof(trailer)) != 0) {
+            return -1;
+        }
+        if (stub->no_ack) {
+            return 0;
+        }
+        int const ack = get_byte(stub);
+        if (ack == '+') {
+            return 0;
+        }
+        if (ack != '-') {
+            return -1;
+        }
+    }
+}
+
+// Reads the next packet into stub->packet. Returns 0 on success, or -1 if gdb
+// has gone. Interrupts (^C) between packets are dropped, since the machine is
+// already stopped.
+static int get_packet(struct gdbstub *const stub) {
+    while (1) {
+        int c;
+        do {
+            c = get_byte(stub);
+        } while (c >= 0 && c != '$');
+        if (c < 0) {
+            return -1;
+        }
+        size_t size = 0;
+        uint8_t checksum = 0;
+        while ((c = get_byte(stub)) >= 0 && c != '#') {
+            if (size < MAX_PACKET) {
+                stub->packet[size++] = c;
+            }
+            checksum += c;
+        }
+        int const high = get_byte(stub);
+        int const low = get_byte(stub);
+        if (c < 0 || high < 0 || low < 0) {
+            return -1;
+        }
+        stub->packet[size] = '\0';
+        if (stub->no_ack) {
+            return 0;
+        }
+        if (hex_digit(high) * 16 + hex_digit(low) == checksum) {
+            return send_all(stub, "+", 1);
+        }
+        if (send_all(stub, "-", 1) != 0) {
+            return -1;
+        }
+    }
+}
+
+// Parses hex digits at *p, advancing past them.
+static uint32_t parse_hex(char const **const p) {
+    uint32_t value = 0;
+    for (int digit; (digit = hex_digit(**p)) >= 0; (*p)++) {
+        value = value << 4 | digit;
+    }
+    return value;
+}
+
+// Steps past c if it comes next, without ever stepping past the end. Returns
+// whether it did.
+static uint1_t skip(char const **const p, char const c) {
+    if (**p != c) {
+        return 0;
+    }
+    (*p)++;
+    return 1;
+}
+
+// Whether in starts with count hex digits
+static uint1_t is_hex(char const *const in, size_t const count) {
+    for (size_t i = 0; i < count; i++) {
+        if (hex_digit(in[i]) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void put_hex8(char *const out, uint8_t const value) {
+    out[0] = HEX[value >> 4];
+    out[1] = HEX[value & 0xF];
+}
+
+// Registers go over the wire in target (little-endian) byte order.
+static void put_register(char *const out, uint16_t const value) {
+    put_hex8(out, value & 0xFF);
+    put_hex8(out + 2, value >> 8);
+}
+
+static uint16_t get_register(char const *const in) {
+    return (hex_digit(in[0]) << 4 | hex_digit(in[1])) |
+           (hex_digit(in[2]) << 12 | hex_digit(in[3]) << 8);
+}
+
+static uint1_t is_register(char const *const in) {
+    return is_hex(in, 4);
+}
+
+static uint16_t *register_at(struct gb *const gb, uint32_t const n) {
+    switch (n) {
+    case 0:
+        return &gb->af;
+    case 1:
+        return &gb->bc;
+    case 2:
+        return &gb->de;
+    case 3:
+        return &gb->hl;
+    case 4:
+        return &gb->sp;
+    case 5:
+        return &gb->pc;
+    default:
+        return NULL;
+    }
+}
+
+static void write_register(struct gb *const gb, uint32_t const n,
+                           uint16_t const value) {
+    uint16_t *const r = register_at(gb, n);
+    if (r == NULL) {
+        return;
+    }
+    // The low nibble of F always reads as 0.
+    *r = n == 0 ? value & 0xFFF0 : value;
+}
+
+static int send_stop(struct gdbstub *const stub, struct gb const *const gb,
+                     enum stop_reason const reason) {
+    struct debug_hit hit;
+    debugger_last_hit(gb->debugger, &hit);
+    switch (reason) {
+    case STOP_WATCH_READ:
+    case STOP_WATCH_WRITE:
+        snprintf(stub->out, sizeof(stub->out), "T%02x%s:%04x;", SIGNAL_TRAP,
+                 reason == STOP_WATCH_READ ? "rwatch" : "watch", hit.address);
+        break;
+    case STOP_DONE:
+        snprintf(stub->out, sizeof(stub->out), "S%02x", SIGNAL_INT);
+        break;
+    case STOP_FAULT:
+        snprintf(stub->out, sizeof(stub->out), "S%02x", SIGNAL_ILL);
+        break;
+    case STOP_BREAKPOINT:
+    default:
+        snprintf(stub->out, sizeof(stub->out), "S%02x", SIGNAL_TRAP);
+        break;
+    }
+    return send_packet(stub, stub->out);
+}
+
+// Handles Z and z packets. Returns the reply.
+static char const *set_point(struct gb *const gb, char const *p,
+                             uint1_t const insert) {
+    char const type = *p++;
+    if (*p++ != ',') {
+        return "E01";
+    }
+    uint32_t const address = parse_hex(&p);
+    if (*p++ != ',' || address > 0xFFFF) {
+        return "E01";
+    }
+    uint32_t const length = parse_hex(&p);
+    struct watchpoint const watchpoint = {
+        .address = address,
+        .length = length,
+        .kind = type == '2' ? WATCH_WRITE
+                : type == '3' ? WATCH_READ
+                              : WATCH_ACCESS,
+    };
+    switch (type) {
+    case '0':
+    case '1':
+        if (insert) {
+            debugger_add_breakpoint(gb->debugger, address);
+        } else {
+            debugger_remove_breakpoint(gb->debugger, address);
+        }
+        return "OK";
+    case '2':
+    case '3':
+    case '4':
+        if (length > 0xFFFF) {
+            return "E01";
+        }
+        if (!insert) {
+            debugger_remove_watchpoint(gb->debugger, &watchpoint);
+            return "OK";
+        }
+        return debugger_add_watchpoint(gb->debugger, &watchpoint) == 0 ? "OK"
+                                                                       : "E02";
+    default:
+        return "";
+    }
+}
+
+enum serve_result {
+    SERVE_CONTINUE = 0, // Let the machine run
+    SERVE_DETACHED = 1, // gdb has gone, one way or another
+    SERVE_KILL = 2,
+};
+
+// Answers packets until gdb lets the machine run again. If announce is set,
+// first tells gdb that the machine stopped, which gdb is waiting to hear
+// after it continued; on a new connection, gdb asks instead.
+static enum serve_result serve(struct gdbstub *const stub, struct gb *const gb,
+                               enum stop_reason reason, uint1_t const announce) {
+    if (announce && send_stop(stub, gb, reason) != 0) {
+        return SERVE_DETACHED;
+    }
+    while (get_packet(stub) == 0) {
+        char const *p = stub->packet;
+        char *const out = stub->out;
+        char const *reply = out;
+        out[0] = '\0';
+        switch (*p++) {
+        case '?':
+            if (send_stop(stub, gb, reason) != 0) {
+                return SERVE_DETACHED;
+            }
+            continue;
+        case 'g':
+            for (uint32_t n = 0; n < NUM_REGISTERS; n++) {
+                uint16_t const *const r = register_at(gb, n);
+                put_register(out + 4 * n, r == NULL ? 0 : *r);
+            }
+            out[4 * NUM_REGISTERS] = '\0';
+            break;
+        case 'G':
+            for (uint32_t n = 0; n < NUM_REGISTERS && is_register(p); n++) {
+                write_register(gb, n, get_register(p));
+                p += 4;
+            }
+            reply = "OK";
+            break;
+        case 'p': {
+            uint32_t const n = parse_hex(&p);
+            uint16_t const *const r = register_at(gb, n);
+            if (n >= NUM_REGISTERS) {
+                reply = "E01";
+                break;
+            }
+            put_register(out, r == NULL ? 0 : *r);
+            out[4] = '\0';
+            break;
+        }
+        case 'P': {
+            uint32_t const n = parse_hex(&p);
+            if (*p++ != '=' || n >= NUM_REGISTERS || !is_register(p)) {
+                reply = "E01";
+                break;
+            }
+            write_register(gb, n, get_register(p));
+            reply = "OK";
+            break;
+        }
+        case 'm': {
+            uint32_t const address = parse_hex(&p);
+            uint1_t const has_length = skip(&p, ',');
+            uint32_t const length = parse_hex(&p);
+            if (!has_length ||
+                address + (uint64_t)length > ADDRESS_SPACE_SIZE ||
+                2 * length > MAX_PACKET) {
+                reply = "E01";
+                break;
+            }
+            for (uint32_t i = 0; i < length; i++) {
+                put_hex8(out + 2 * i, bus_read(gb, address + i));
+            }
+            out[2 * length] = '\0';
+            break;
+        }
+        case 'M': {
+            uint32_t const address = parse_hex(&p);
+            uint1_t const has_length = skip(&p, ',');
+            uint32_t const length = parse_hex(&p);
+            // Checked in full first, so that a bad packet writes nothing
+            if (!has_length || !skip(&p, ':') ||
+                address + (uint64_t)length > ADDRESS_SPACE_SIZE ||
+                strlen(p) != 2 * length || !is_hex(p, 2 * length)) {
+                reply = "E01";
+                break;
+            }
+            for (uint32_t i = 0; i < length; i++) {
+                bus_write(gb, address + i,
+                          hex_digit(p[2 * i]) << 4 | hex_digit(p[2 * i + 1]));
+            }
+            reply = "OK";
+            break;
+        }
+        case 'c':
+            if (*p != '\0') {
+                gb->pc = parse_hex(&p);
+            }
+            debugger_resume(gb->debugger);
+            return SERVE_CONTINUE;
+        case 's':
+            if (*p != '\0') {
+                gb->pc = parse_hex(&p);
+            }
+            // One whole instruction, however many cycles it takes
+            debugger_resume(gb->debugger);
+            reason = run_cycles(gb, 1);
+            if (reason == STOP_DONE) {
+                reason = STOP_BREAKPOINT; // Reported as SIGTRAP all the same
+            }
+            if (send_stop(stub, gb, reason) != 0) {
+                return SERVE_DETACHED;
+            }
+            continue;
+        case 'Z':
+        case 'z':
+            reply = set_point(gb, p, p[-1] == 'Z');
+            break;
+        case 'D':
+            send_packet(stub, "OK");
+            return SERVE_DETACHED;
+        case 'k':
+            return SERVE_KILL;
+        case 'H':
+            reply = "OK"; // There's only one thread
+            break;
+        case 'q':
+            if (strncmp(p, "Supported", strlen("Supported")) == 0) {
+                snprintf(out, MAX_PACKET, "PacketSize=%x;QStartNoAckMode+",
+                         (unsigned)MAX_PACKET);
+            } else if (strcmp(p, "Attached") == 0) {
+                reply = "1";
+            } else if (strcmp(p, "C") == 0) {
+                reply = "QC1";
+            }
+            break;
+        case 'Q':
+            if (strcmp(p, "StartNoAckMode") == 0) {
+                if (send_packet(stub, "OK") != 0) {
+                    return SERVE_DETACHED;
+                }
+                stub->no_ack = 1;
+                continue;
+            }
+            break;
+        default:
+            break; // An empty reply means "unsupported"
+        }
+        if (send_packet(stub, reply) != 0) {
+            return SERVE_DETACHED;
+        }
+    }
+    return SERVE_DETACHED;
+}
+
+// Checks, without blocking, whether gdb has sent an interrupt. Anything else
+// it sent while the machine ran is kept for serve().
+static uint1_t interrupted(struct gdbstub *const stub) {
+    if (stub->in_start == stub->in_end) {
+        ssize_t const n =
+            recv(stub->fd, stub->in, sizeof(stub->in), MSG_DONTWAIT);
+        if (n == 0) {
+            return 1; // gdb has gone; serve() will notice
+        }
+        if (n < 0) {
+            return errno != EAGAIN && errno != EINTR;
+        }
+        stub->in_start = 0;
+        stub->in_end = n;
+    }
+    for (size_t i = stub->in_start; i < stub->in_end; i++) {
+        if (stub->in[i] == 0x03) {
+            memmove(stub->in + i, stub->in + i + 1, stub->in_end - i - 1);
+            stub->in_end--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int gdbstub_poll(struct gdbstub *const stub, struct gb *const gb,
+                 enum stop_reason const reason) {
+    uint1_t const connecting = stub->fd < 0;
+    if (connecting) {
+        stub->fd = accept4(stub->listener, NULL, NULL, SOCK_CLOEXEC);
+        if (stub->fd < 0) {
+            return 0;
+        }
+        gb->debugger = debugger_open();
+        if (gb->debugger == NULL) {
+            close(stub->fd);
+            stub->fd = -1;
+            return 0;
+        }
+    } else if ((reason == STOP_DONE ||
+                (reason == STOP_FAULT && stub->faulted)) &&
+               !interrupted(stub)) {
+        return 0;
+    }
+    // Every run from now on ends in STOP_FAULT; gdb only hears about it once.
+    stub->faulted |= reason == STOP_FAULT;
+    // A new connection finds the machine stopped as if at a breakpoint.
+    switch (serve(stub, gb, connecting ? STOP_BREAKPOINT : reason,
+                  !connecting)) {
+    case SERVE_CONTINUE:
+        return 0;
+    case SERVE_DETACHED:
+        detach(stub, gb);
+        return 0;
+    case SERVE_KILL:
+        detach(stub, gb);
+        return -1;
+    default:
+        return 0;
+    }
+}
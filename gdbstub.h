@@ -0,0 +1,33 @@
+#pragma once
+#include "gb.h"
+
+// A GDB remote serial protocol stub, so that gdb (or anything else that
+// speaks the protocol) can attach to a running frontend. It listens on a
+// loopback TCP port or a Unix domain socket, and only attaches a debugger
+// (see debugger.h) to the machine while gdb is connected, so a frontend run
+// with a stub but no gdb costs nothing per instruction.
+//
+// gdb has no SM83 target, so registers are laid out as for z80: af, bc, de,
+// hl, sp, pc, then ix, iy, af', bc', de', hl' and ir, which read as 0 and
+// ignore writes, all 16 bits wide. In gdb:
+//
+//     set architecture z80
+//     target remote :1234
+//
+// Memory is read and written through the bus, as the CPU would. Software and
+// hardware breakpoints are both breakpoints, and write, read and access
+// watchpoints are watchpoints, all through the debugger's page flags.
+
+// Listens on address: a port number for 127.0.0.1, or else the path of a Unix
+// domain socket. Returns NULL on failure.
+struct gdbstub *gdbstub_open(char const *address);
+
+// Detaches from gb, if gdb is connected, and stops listening.
+void gdbstub_close(struct gdbstub *stub, struct gb *gb);
+
+// Called by a frontend between runs, with why the last run_frame() or
+// run_cycles() stopped. Accepts a new connection from gdb, and checks for an
+// interrupt (^C) from a connected one, without blocking. If gdb connected,
+// interrupted or the run stopped at a breakpoint or watchpoint, it serves gdb
+// until gdb continues or detaches. Returns 0, or -1 if gdb killed the program.
+int gdbstub_poll(struct gdbstub *stub, struct gb *gb, enum stop_reason reason);
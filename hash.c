@@ -0,0 +1,86 @@
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint64_t
+#include <string.h> // for memcpy
+
+#include "hash.h"
+
+#define PRIME1 (0x9E3779B185EBCA87ull)
+#define PRIME2 (0xC2B2AE3D27D4EB4Full)
+#define PRIME3 (0x165667B19E3779F9ull)
+#define PRIME4 (0x85EBCA77C2B2AE63ull)
+#define PRIME5 (0x27D4EB2F165667C5ull)
+
+static uint64_t rotl(uint64_t const x, int const r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Assumes little-endian
+static uint64_t read64(uint8_t const *const p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static uint32_t read32(uint8_t const *const p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t const input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static uint64_t merge_round(uint64_t acc, uint64_t const val) {
+    acc ^= round64(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t hash64(void const *const data, size_t const size,
+                uint64_t const seed) {
+    uint8_t const *p = data;
+    uint8_t const *const end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        // Four independent lanes, which the compiler can keep in vector
+        // registers.
+        uint64_t v[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed,
+                         seed - PRIME1};
+        for (; end - p >= 32; p += 32) {
+            for (int i = 0; i < 4; i++) {
+                v[i] = round64(v[i], read64(p + 8 * i));
+            }
+        }
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = merge_round(h, v[i]);
+        }
+    } else {
+        h = seed + PRIME5;
+    }
+    h += size;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4) {
+        h ^= read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
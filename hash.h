@@ -0,0 +1,6 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+// XXH64, so hashes can be checked against the reference xxhsum tool.
+uint64_t hash64(void const *data, size_t size, uint64_t seed);
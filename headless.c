@@ -0,0 +1,394 @@
+#define _GNU_SOURCE   // for clock_gettime(2), getopt(3)
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint64_t
+#include <stdio.h>    // for fprintf, fopen, fclose, FILE, stdout
+#include <stdlib.h>   // for EXIT_FAILURE, EXIT_SUCCESS, strtoull
+#include <string.h>   // for strcmp, strlen
+#include <time.h>     // for clock_gettime
+#include <unistd.h>   // for getopt, getpid
+
+#include "cheats.h"
+#include "coverage.h"
+#include "gb.h"
+#include "gdbstub.h"
+#include "share.h"
+#include "timeline.h"
+#include "trace.h"
+#include "video.h"
+
+static char const *const REGION_NAMES[NUM_REGIONS] = {
+    [REGION_ROM] = "rom",
+    [REGION_VRAM] = "vram",
+    [REGION_CART_RAM] = "cart_ram",
+    [REGION_WRAM] = "wram",
+    [REGION_ECHO_RAM] = "echo_ram",
+    [REGION_OAM] = "oam",
+    [REGION_UNUSED] = "unused",
+    [REGION_IO] = "io",
+    [REGION_HRAM] = "hram",
+    [REGION_IE] = "ie",
+};
+
+static char const *const INTERRUPT_NAMES[NUM_INTERRUPTS] = {
+    "vblank", "stat", "timer", "serial", "joypad",
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void print_region_counts(FILE *const f, char const *const name,
+                                uint64_t const *const counts) {
+    fprintf(f, "  \"%s\": {", name);
+    for (size_t i = 0; i < NUM_REGIONS; i++) {
+        fprintf(f, "%s\"%s\": %" PRIu64, i == 0 ? "" : ", ", REGION_NAMES[i],
+                counts[i]);
+    }
+    fprintf(f, "},\n");
+}
+
+static void print_io_counts(FILE *const f, char const *const name,
+                            uint64_t const *const counts) {
+    // Only the registers that were touched, keyed by address
+    fprintf(f, "  \"%s\": {", name);
+    char const *sep = "";
+    for (size_t i = 0; i < NUM_IO_REGS; i++) {
+        if (counts[i] != 0) {
+            fprintf(f, "%s\"0x%04zX\": %" PRIu64, sep, 0xFF00 + i, counts[i]);
+            sep = ", ";
+        }
+    }
+    fprintf(f, "},\n");
+}
+
+static void print_counters_json(FILE *const f, struct gb const *const gb,
+                                uint64_t const wall_ns) {
+    struct counters c;
+    uint1_t const enabled = get_counters(gb, &c);
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"counters_enabled\": %s,\n", enabled ? "true" : "false");
+    fprintf(f, "  \"wall_ns\": %" PRIu64 ",\n", wall_ns);
+    fprintf(f, "  \"frames\": %" PRIu64 ",\n", gb->frame_count);
+    fprintf(f, "  \"instructions\": %" PRIu64 ",\n", c.instructions);
+    fprintf(f, "  \"cycles\": %" PRIu64 ",\n", c.cycles);
+    print_region_counts(f, "reads", c.reads);
+    print_region_counts(f, "writes", c.writes);
+    print_io_counts(f, "io_reads", c.io_reads);
+    print_io_counts(f, "io_writes", c.io_writes);
+    fprintf(f, "  \"interrupts\": {");
+    for (size_t i = 0; i < NUM_INTERRUPTS; i++) {
+        fprintf(f, "%s\"%s\": %" PRIu64, i == 0 ? "" : ", ",
+                INTERRUPT_NAMES[i], c.interrupts[i]);
+    }
+    fprintf(f, "},\n");
+    fprintf(f, "  \"dma_transfers\": %" PRIu64 ",\n", c.dma_transfers);
+    fprintf(f, "  \"update_screen_ns\": %" PRIu64 ",\n", c.update_screen_ns);
+    fprintf(f, "  \"render_ns\": %" PRIu64 "\n", c.render_ns);
+    fprintf(f, "}\n");
+}
+
+static void usage(char const *const argv0) {
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-c counters.json] [-H hashes.txt] "
+            "[-t trace_file] [-T timeline.json] [-l state_in] "
+            "[-s state_out] [-p png_prefix [-z]] [-v video.rgb|video.y4m|-] "
+            "[-d] [-S screenshot.png] [-m shared_file|-] [-g port|socket] "
+            "[-C coverage.bin] [-G cheat_code]... <rom_file>\n",
+            argv0);
+}
+
+int main(int argc, char *const *const argv) {
+    uint64_t num_frames = 600;
+    char const *counters_path = NULL;
+    char const *hashes_path = NULL;
+    char const *trace_path = NULL;
+    char const *timeline_path = NULL;
+    char const *state_in_path = NULL;
+    char const *state_out_path = NULL;
+    char const *png_prefix = NULL;
+    uint1_t png_stored = 0;
+    char const *video_path = NULL;
+    uint1_t dedup = 0;
+    char const *screenshot_path = NULL;
+    char const *share_path = NULL;
+    char const *gdb_address = NULL;
+    char const *coverage_path = NULL;
+    char const *cheat_codes[MAX_CHEATS];
+    size_t num_cheat_codes = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:H:t:T:l:s:p:zv:dS:m:g:C:G:")) != -1) {
+        switch (opt) {
+        case 'n':
+            num_frames = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            counters_path = optarg;
+            break;
+        case 'H':
+            hashes_path = optarg;
+            break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'T':
+            timeline_path = optarg;
+            break;
+        case 'l':
+            state_in_path = optarg;
+            break;
+        case 's':
+            state_out_path = optarg;
+            break;
+        case 'p':
+            png_prefix = optarg;
+            break;
+        case 'z':
+            png_stored = 1;
+            break;
+        case 'v':
+            video_path = optarg;
+            break;
+        case 'd':
+            dedup = 1;
+            break;
+        case 'S':
+            screenshot_path = optarg;
+            break;
+        case 'm':
+            share_path = optarg;
+            break;
+        case 'g':
+            gdb_address = optarg;
+            break;
+        case 'C':
+            coverage_path = optarg;
+            break;
+        case 'G':
+            if (num_cheat_codes == MAX_CHEATS) {
+                fprintf(stderr, "Too many cheat codes!\n");
+                return EXIT_FAILURE;
+            }
+            cheat_codes[num_cheat_codes++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static struct gb gb;
+    initialize(&gb, argv[optind]);
+    if (state_in_path != NULL && read_state(&gb, state_in_path) != 0) {
+        fprintf(stderr, "Couldn't load state from %s!\n", state_in_path);
+        return EXIT_FAILURE;
+    }
+    if (trace_path != NULL) {
+        gb.trace = trace_open(trace_path, TRACE_DEFAULT_CHUNKS);
+        if (gb.trace == NULL) {
+            fprintf(stderr, "Couldn't open trace file %s!\n", trace_path);
+            return EXIT_FAILURE;
+        }
+    }
+    if (timeline_path != NULL) {
+        gb.timeline = timeline_open();
+        if (gb.timeline == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // With -, the region is an anonymous memfd, mapped via /proc
+    if (share_path != NULL) {
+        uint1_t const anonymous = strcmp(share_path, "-") == 0;
+        gb.share = share_open(anonymous ? NULL : share_path);
+        if (gb.share == NULL) {
+            fprintf(stderr, "Couldn't share frames through %s!\n", share_path);
+            return EXIT_FAILURE;
+        }
+        if (anonymous) {
+            fprintf(stderr, "Sharing frames through /proc/%ld/fd/%d\n",
+                    (long)getpid(), share_fd(gb.share));
+        }
+    }
+
+    if (num_cheat_codes > 0) {
+        gb.cheats = cheats_open();
+        if (gb.cheats == NULL) {
+            fprintf(stderr, "Out of memory!\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for (size_t i = 0; i < num_cheat_codes; i++) {
+        struct cheat cheat;
+        if (cheat_parse(cheat_codes[i], &cheat) != 0 ||
+            cheats_add(gb.cheats, &gb, &cheat) != 0) {
+            fprintf(stderr, "Bad cheat code %s!\n", cheat_codes[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (coverage_path != NULL) {
+        gb.coverage = coverage_open();
+        if (gb.coverage == NULL) {
+            fprintf(stderr, "Out of memory!\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // gdb can attach at any point; until it does, this costs one accept()
+    // per frame
+    struct gdbstub *stub = NULL;
+    if (gdb_address != NULL) {
+        stub = gdbstub_open(gdb_address);
+        if (stub == NULL) {
+            fprintf(stderr, "Couldn't listen for gdb on %s!\n", gdb_address);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // One line per completed frame: the frame number and its hash
+    FILE *hashes = NULL;
+    if (hashes_path != NULL) {
+        hashes = strcmp(hashes_path, "-") == 0 ? stdout
+                                               : fopen(hashes_path, "w");
+        if (hashes == NULL) {
+            fprintf(stderr, "Couldn't open %s!\n", hashes_path);
+            return EXIT_FAILURE;
+        }
+        gb.hash_frames = 1;
+    }
+
+    // Frames are encoded and written on other threads
+    struct video *pngs = NULL;
+    if (png_prefix != NULL) {
+        pngs = video_open(png_prefix,
+                          png_stored ? VIDEO_PNG_STORED : VIDEO_PNG, dedup);
+        if (pngs == NULL) {
+            fprintf(stderr, "Couldn't start writing PNGs to %s!\n",
+                    png_prefix);
+            return EXIT_FAILURE;
+        }
+    }
+    struct video *stream = NULL;
+    if (video_path != NULL) {
+        size_t const len = strlen(video_path);
+        uint1_t const y4m =
+            len >= 4 && strcmp(video_path + len - 4, ".y4m") == 0;
+        stream = video_open(video_path, y4m ? VIDEO_Y4M : VIDEO_RGB, dedup);
+        if (stream == NULL) {
+            fprintf(stderr, "Couldn't open %s!\n", video_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t const start = now_ns();
+    for (uint64_t i = 0; i < num_frames;) {
+        uint64_t const frame = gb.frame_count;
+        enum stop_reason const reason = run_frame(&gb);
+        if (stub != NULL && gdbstub_poll(stub, &gb, reason) != 0) {
+            break;
+        }
+        if (reason != STOP_DONE && reason != STOP_FAULT) {
+            continue; // The next run_frame() finishes this frame
+        }
+        i++;
+        if (gb.frame_count == frame) {
+            continue;
+        }
+        if (hashes != NULL) {
+            fprintf(hashes, "%" PRIu64 " %016" PRIx64 "\n", gb.frame_count,
+                    gb.frame_hash);
+        }
+        if (pngs != NULL) {
+            video_push(pngs, &gb);
+        }
+        if (stream != NULL) {
+            video_push(stream, &gb);
+        }
+    }
+    uint64_t const wall_ns = now_ns() - start;
+    if (gb.fault != FAULT_NONE) {
+        fprintf(stderr, "The CPU locked up on opcode 0x%02" PRIX8
+                        " at 0x%04" PRIX16 "!\n",
+                gb.address_space[gb.pc], gb.pc);
+    }
+    gdbstub_close(stub, &gb);
+    if (hashes != NULL && hashes != stdout) {
+        fclose(hashes);
+    }
+    struct video *const sinks[] = {pngs, stream};
+    char const *const sink_names[] = {png_prefix, video_path};
+    for (size_t i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+        if (sinks[i] == NULL) {
+            continue;
+        }
+        struct video_stats stats;
+        if (video_close(sinks[i], &stats) != 0) {
+            fprintf(stderr, "Couldn't write %s!\n", sink_names[i]);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr,
+                "%s: %" PRIu64 " frames, %" PRIu64 " duplicates, %" PRIu64
+                " written\n",
+                sink_names[i], stats.frames,
+                stats.duplicates, stats.written);
+    }
+    if (screenshot_path != NULL &&
+        write_screenshot(&gb, screenshot_path) != 0) {
+        fprintf(stderr, "Couldn't write %s!\n", screenshot_path);
+        return EXIT_FAILURE;
+    }
+    if (state_out_path != NULL && write_state(&gb, state_out_path) != 0) {
+        fprintf(stderr, "Couldn't save state to %s!\n", state_out_path);
+        return EXIT_FAILURE;
+    }
+
+    if (gb.coverage != NULL) {
+        if (coverage_write(gb.coverage, coverage_path) != 0) {
+            fprintf(stderr, "Couldn't write coverage to %s!\n", coverage_path);
+            return EXIT_FAILURE;
+        }
+        for (size_t b = 0; b < COVERAGE_NUM_BANKS; b++) {
+            fprintf(stderr, "ROM bank %zu: %zu of %d addresses executed\n", b,
+                    coverage_count_bank(gb.coverage, b), COVERAGE_BANK_SIZE);
+        }
+        fprintf(stderr, "%zu edges\n", coverage_count_edges(gb.coverage));
+        coverage_close(gb.coverage);
+        gb.coverage = NULL;
+    }
+    cheats_close(gb.cheats, &gb);
+    gb.cheats = NULL;
+    trace_close(gb.trace);
+    gb.trace = NULL;
+    share_close(gb.share);
+    gb.share = NULL;
+    if (gb.timeline != NULL) {
+        if (timeline_write(gb.timeline, timeline_path) != 0) {
+            fprintf(stderr, "Couldn't write timeline to %s!\n", timeline_path);
+            return EXIT_FAILURE;
+        }
+        timeline_close(gb.timeline);
+        gb.timeline = NULL;
+    }
+
+    if (counters_path != NULL) {
+        FILE *const f = strcmp(counters_path, "-") == 0
+                            ? stdout
+                            : fopen(counters_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "Couldn't open %s!\n", counters_path);
+            return EXIT_FAILURE;
+        }
+        print_counters_json(f, &gb, wall_ns);
+        if (f != stdout) {
+            fclose(f);
+        }
+    }
+    return EXIT_SUCCESS;
+}
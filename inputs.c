@@ -0,0 +1,93 @@
+#include <inttypes.h> // for SCNu64
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint64_t
+#include <stdio.h>    // for fprintf, fopen, fgets, sscanf, fclose, FILE
+#include <stdlib.h>   // for realloc, free
+#include <string.h>   // for strcmp
+
+#include "gb.h"
+#include "inputs.h"
+
+static char const *const BUTTON_NAMES[NUM_BUTTONS] = {
+    [GB_KEY_A] = "a",
+    [GB_KEY_B] = "b",
+    [GB_KEY_START] = "start",
+    [GB_KEY_SELECT] = "select",
+    [GB_KEY_UP] = "up",
+    [GB_KEY_DOWN] = "down",
+    [GB_KEY_LEFT] = "left",
+    [GB_KEY_RIGHT] = "right",
+};
+
+int input_script_read(struct input_script *const script,
+                      char const *const path) {
+    script->inputs = NULL;
+    script->count = 0;
+    FILE *const f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Couldn't open %s!\n", path);
+        return -1;
+    }
+    char line[256];
+    for (size_t line_number = 1; fgets(line, sizeof(line), f) != NULL;
+         line_number++) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        uint64_t frame;
+        char action[16];
+        char button[16];
+        int const matched = sscanf(line, "%" SCNu64 " %15s %15s", &frame,
+                                   action, button);
+        size_t b = 0;
+        while (matched == 3 && b < NUM_BUTTONS &&
+               strcmp(button, BUTTON_NAMES[b]) != 0) {
+            b++;
+        }
+        struct input *const inputs =
+            matched == 3
+                ? realloc(script->inputs,
+                          (script->count + 1) * sizeof(*script->inputs))
+                : NULL;
+        if (inputs != NULL) {
+            script->inputs = inputs;
+        }
+        if (inputs == NULL || b == NUM_BUTTONS ||
+            (strcmp(action, "press") != 0 && strcmp(action, "release") != 0) ||
+            (script->count > 0 &&
+             frame < script->inputs[script->count - 1].frame)) {
+            fprintf(stderr, "%s:%zu: bad input line\n", path, line_number);
+            fclose(f);
+            input_script_free(script);
+            return -1;
+        }
+        script->inputs[script->count++] = (struct input){
+            .frame = frame,
+            .press = strcmp(action, "press") == 0,
+            .button = b,
+        };
+    }
+    fclose(f);
+    return 0;
+}
+
+void input_script_apply(struct input_script const *const script,
+                        struct gb *const gb, uint64_t const frame) {
+    for (size_t i = 0; i < script->count && script->inputs[i].frame <= frame;
+         i++) {
+        if (script->inputs[i].frame != frame) {
+            continue;
+        }
+        if (script->inputs[i].press) {
+            press_button(gb, script->inputs[i].button);
+        } else {
+            release_button(gb, script->inputs[i].button);
+        }
+    }
+}
+
+void input_script_free(struct input_script *const script) {
+    free(script->inputs);
+    script->inputs = NULL;
+    script->count = 0;
+}
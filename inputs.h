@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include "gb.h"
+
+// A script of button presses and releases, each at the start of a frame.
+// Scripts are text files with lines of the form "<frame> press|release
+// <button>", in frame order; the buttons are a, b, start, select, up, down,
+// left and right. Lines starting with # are comments.
+
+struct input {
+    uint64_t frame;
+    uint1_t press;
+    enum joypad_button button;
+};
+
+struct input_script {
+    struct input *inputs;
+    size_t count;
+};
+
+// Returns 0 on success, or -1 (after printing why) on failure.
+int input_script_read(struct input_script *script, char const *path);
+
+// Applies the inputs for frame to gb.
+void input_script_apply(struct input_script const *script, struct gb *gb,
+                        uint64_t frame);
+
+void input_script_free(struct input_script *script);
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE   // for getopt(3)
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint64_t
+#include <stdio.h>    // for printf, fprintf
+#include <stdlib.h>   // for EXIT_FAILURE, EXIT_SUCCESS, strtoull
+#include <unistd.h>   // for getopt
+
+#include "compare.h"
+#include "engine.h"
+#include "gb.h"
+#include "inputs.h"
+
+// Runs the same ROM, with the same inputs, on two engines in lockstep. After
+// every block the engine under test runs, the reference engine runs the same
+// number of steps, and the two machines are compared: registers, flags, timing
+// state and (every -m steps) all of memory. The first divergence is reported
+// along with the last few instructions each machine executed.
+
+#define DEFAULT_WINDOW (16)
+
+static void usage(char const *const argv0) {
+    fprintf(stderr,
+            "Usage: %s [-r reference_engine] [-e engine] [-n frames] "
+            "[-m memory_interval] [-w window] [-i inputs] <rom_file>\n"
+            "       %s -l\n",
+            argv0, argv0);
+}
+
+int main(int argc, char *const *const argv) {
+    char const *reference_name = "reference";
+    char const *engine_name = "reference";
+    uint64_t num_frames = 600;
+    uint64_t memory_interval = 1;
+    size_t window_size = DEFAULT_WINDOW;
+    char const *inputs_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:e:n:m:w:i:l")) != -1) {
+        switch (opt) {
+        case 'r':
+            reference_name = optarg;
+            break;
+        case 'e':
+            engine_name = optarg;
+            break;
+        case 'n':
+            num_frames = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            memory_interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            window_size = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            inputs_path = optarg;
+            break;
+        case 'l':
+            for (size_t i = 0; i < NUM_ENGINES; i++) {
+                printf("%-16s %s\n", ENGINES[i].name, ENGINES[i].description);
+            }
+            return EXIT_SUCCESS;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || memory_interval == 0 || window_size == 0 ||
+        window_size > MAX_WINDOW) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    struct engine const *const reference = find_engine(reference_name);
+    struct engine const *const engine = find_engine(engine_name);
+    if (reference == NULL || engine == NULL) {
+        fprintf(stderr, "No such engine: %s\n",
+                reference == NULL ? reference_name : engine_name);
+        return EXIT_FAILURE;
+    }
+
+    struct input_script inputs = {0};
+    if (inputs_path != NULL && input_script_read(&inputs, inputs_path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    static struct gb a;
+    static struct gb b;
+    initialize(&a, argv[optind]);
+    initialize(&b, argv[optind]);
+    struct engine_instance *const instance_a = engine_open(reference, &a);
+    struct engine_instance *const instance_b = engine_open(engine, &b);
+    if (instance_a == NULL || instance_b == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+    struct lockstep ls = {
+        .reference = instance_a,
+        .a = &a,
+        .engine = instance_b,
+        .b = &b,
+        .inputs = &inputs,
+        .memory_interval = memory_interval,
+        .window_size = window_size,
+    };
+    if (lockstep_compare_frames(&ls, num_frames)) {
+        return EXIT_FAILURE;
+    }
+    printf("No divergence between %s and %s in %" PRIu64 " steps (%" PRIu64
+           " frames)\n",
+           reference->name, engine->name, ls.steps, ls.frame);
+    engine_close(instance_a);
+    engine_close(instance_b);
+    input_script_free(&inputs);
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,16 @@
+#define _GNU_SOURCE // for getopt(3)
 #include <stddef.h> // for NULL
 #include <stdio.h>  // for printf, getchar, puts
 #include <stdlib.h> // for EXIT_FAILURE
+#include <unistd.h> // for getopt
 
 #include <SDL2/SDL.h>
 
+#include "cheats.h"
 #include "gb.h"
+#include "gdbstub.h"
+#include "timeline.h"
+#include "trace.h"
 
 #define KEY_MAPPED_TO_A (SDLK_a)
 #define KEY_MAPPED_TO_B (SDLK_b)
@@ -17,9 +23,42 @@
 
 typedef unsigned _BitInt(2) uint2_t;
 
-int main(int argc, char const *const *const argv) {
-    if (argc != 2) {
-        printf("Usage: %s <rom_file>\n", argv[0]);
+int main(int argc, char *const *const argv) {
+    char const *trace_path = NULL;
+    char const *timeline_path = NULL;
+    char const *gdb_address = NULL;
+    char const *cheat_codes[MAX_CHEATS];
+    size_t num_cheat_codes = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:T:g:G:")) != -1) {
+        switch (opt) {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'T':
+            timeline_path = optarg;
+            break;
+        case 'g':
+            gdb_address = optarg;
+            break;
+        case 'G':
+            if (num_cheat_codes == MAX_CHEATS) {
+                printf("Too many cheat codes!\n");
+                return EXIT_FAILURE;
+            }
+            cheat_codes[num_cheat_codes++] = optarg;
+            break;
+        default:
+            printf("Usage: %s [-t trace_file] [-T timeline.json] "
+                   "[-g port|socket] [-G cheat_code]... <rom_file>\n",
+                   argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        printf("Usage: %s [-t trace_file] [-T timeline.json] "
+               "[-g port|socket] [-G cheat_code]... <rom_file>\n",
+               argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -59,7 +98,40 @@ int main(int argc, char const *const *const argv) {
     }
 
     struct gb gb;
-    initialize(&gb, argv[1]);
+    initialize(&gb, argv[optind]);
+    if (trace_path != NULL) {
+        gb.trace = trace_open(trace_path, TRACE_DEFAULT_CHUNKS);
+        if (gb.trace == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (timeline_path != NULL) {
+        gb.timeline = timeline_open();
+        if (gb.timeline == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_cheat_codes > 0) {
+        gb.cheats = cheats_open();
+        if (gb.cheats == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+    for (size_t i = 0; i < num_cheat_codes; i++) {
+        struct cheat cheat;
+        if (cheat_parse(cheat_codes[i], &cheat) != 0 ||
+            cheats_add(gb.cheats, &gb, &cheat) != 0) {
+            printf("Bad cheat code %s!\n", cheat_codes[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    struct gdbstub *stub = NULL;
+    if (gdb_address != NULL) {
+        stub = gdbstub_open(gdb_address);
+        if (stub == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
 
     while (1) {
         SDL_Event event;
@@ -125,10 +197,25 @@ int main(int argc, char const *const *const argv) {
                 }
             }
         }
-        step(&gb);
-        wait(&gb);
+        if (stub != NULL) {
+            // One instruction at a time, so that breakpoints can stop it
+            enum stop_reason const reason = run_cycles(&gb, 1);
+            if (reason != STOP_DONE &&
+                gdbstub_poll(stub, &gb, reason) != 0) {
+                goto done;
+            }
+        } else {
+            step(&gb);
+            wait(&gb);
+        }
 
         if (gb.cycle_count % 1000 == 0) {
+            if (stub != NULL && gdbstub_poll(stub, &gb, STOP_DONE) != 0) {
+                goto done;
+            }
+            if (gb.timeline != NULL) {
+                timeline_begin(gb.timeline, TL_TEXTURE_UPLOAD, gb.frame_count);
+            }
             void *raw_pixels = NULL;
             int unused = 0;
             SDL_LockTexture(gb_screen, NULL, &raw_pixels, &unused);
@@ -162,12 +249,26 @@ int main(int argc, char const *const *const argv) {
             }
 
             SDL_UnlockTexture(gb_screen);
+            if (gb.timeline != NULL) {
+                timeline_end(gb.timeline, TL_TEXTURE_UPLOAD);
+                timeline_begin(gb.timeline, TL_PRESENT, gb.frame_count);
+            }
             SDL_RenderCopy(renderer, gb_screen, NULL, NULL);
             SDL_RenderPresent(renderer);
             SDL_UpdateWindowSurface(window);
+            if (gb.timeline != NULL) {
+                timeline_end(gb.timeline, TL_PRESENT);
+            }
         }
     }
 done:
+    gdbstub_close(stub, &gb);
+    cheats_close(gb.cheats, &gb);
+    trace_close(gb.trace);
+    if (gb.timeline != NULL) {
+        timeline_write(gb.timeline, timeline_path);
+        timeline_close(gb.timeline);
+    }
     SDL_DestroyTexture(gb_screen);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -0,0 +1,299 @@
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint*_t, int32_t
+#include <string.h> // for memcpy, memset
+
+#include "png.h"
+
+// Deflate length codes 257-285: the base length and number of extra bits
+static uint16_t const LENGTH_BASES[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static uint8_t const LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+// Deflate distance codes 0-29
+static uint16_t const DISTANCE_BASES[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,
+    65,  97,  129, 193, 257, 385,  513,  769,  1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577,
+};
+static uint8_t const DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+#define MIN_MATCH (3)
+#define MAX_MATCH (258)
+#define HASH_BITS (12)
+
+struct bits {
+    uint8_t *out;
+    size_t size;
+    uint32_t buffer;
+    uint8_t count;
+};
+
+// Deflate packs bits starting from the least significant bit of each byte
+static void put_bits(struct bits *const b, uint32_t const value,
+                     uint8_t const n) {
+    b->buffer |= value << b->count;
+    b->count += n;
+    while (b->count >= 8) {
+        b->out[b->size++] = b->buffer;
+        b->buffer >>= 8;
+        b->count -= 8;
+    }
+}
+
+static void flush_bits(struct bits *const b) {
+    if (b->count > 0) {
+        b->out[b->size++] = b->buffer;
+    }
+    b->buffer = 0;
+    b->count = 0;
+}
+
+// Huffman codes are defined most significant bit first, so they go in reversed
+static void put_code(struct bits *const b, uint32_t const code,
+                     uint8_t const n) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        reversed |= ((code >> i) & 1) << (n - 1 - i);
+    }
+    put_bits(b, reversed, n);
+}
+
+// Writes a literal/length symbol with the fixed Huffman code (RFC 1951 3.2.6)
+static void put_symbol(struct bits *const b, uint16_t const symbol) {
+    if (symbol < 144) {
+        put_code(b, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        put_code(b, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        put_code(b, symbol - 256, 7);
+    } else {
+        put_code(b, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static void put_match(struct bits *const b, size_t const length,
+                      size_t const distance) {
+    size_t l = 28;
+    while (LENGTH_BASES[l] > length) {
+        l--;
+    }
+    put_symbol(b, 257 + l);
+    put_bits(b, length - LENGTH_BASES[l], LENGTH_EXTRA[l]);
+    size_t d = 29;
+    while (DISTANCE_BASES[d] > distance) {
+        d--;
+    }
+    put_code(b, d, 5);
+    put_bits(b, distance - DISTANCE_BASES[d], DISTANCE_EXTRA[d]);
+}
+
+static uint32_t hash3(uint8_t const *const p) {
+    uint32_t const v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// One fixed-Huffman block. The input is smaller than the 32 KiB window, so
+// any earlier position is a valid match source.
+static void deflate_fast(struct bits *const b, uint8_t const *const data,
+                         size_t const size) {
+    static_assert(PNG_RAW_SIZE <= 32768);
+    int32_t head[1 << HASH_BITS];
+    memset(head, -1, sizeof(head));
+
+    put_bits(b, 1, 1); // Final block
+    put_bits(b, 1, 2); // Fixed Huffman codes
+    size_t i = 0;
+    while (i < size) {
+        size_t length = 0;
+        if (i + MIN_MATCH <= size) {
+            uint32_t const h = hash3(data + i);
+            int32_t const candidate = head[h];
+            head[h] = i;
+            if (candidate >= 0) {
+                size_t const limit =
+                    size - i < MAX_MATCH ? size - i : MAX_MATCH;
+                while (length < limit &&
+                       data[candidate + length] == data[i + length]) {
+                    length++;
+                }
+            }
+            if (length >= MIN_MATCH) {
+                put_match(b, length, i - candidate);
+                for (size_t j = i + 1;
+                     j < i + length && j + MIN_MATCH <= size; j++) {
+                    head[hash3(data + j)] = j;
+                }
+                i += length;
+                continue;
+            }
+        }
+        put_symbol(b, data[i]);
+        i++;
+    }
+    put_symbol(b, 256); // End of block
+    flush_bits(b);
+}
+
+static size_t deflate_stored(uint8_t *const out, uint8_t const *const data,
+                             size_t const size) {
+    static_assert(PNG_RAW_SIZE <= 0xFFFF); // Fits in one stored block
+    out[0] = 1; // Final block, stored
+    out[1] = size;
+    out[2] = size >> 8;
+    out[3] = ~size;
+    out[4] = ~size >> 8;
+    memcpy(out + 5, data, size);
+    return 5 + size;
+}
+
+static uint32_t adler32(uint8_t const *const data, size_t const size) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// The CRC-32 table for PNG chunks (polynomial 0xEDB88320), precomputed so
+// that encoder threads can share it.
+static uint32_t const CRC32_TABLE[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+    0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+    0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+    0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+    0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+    0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+    0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+    0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+    0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+    0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+    0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+    0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+    0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+    0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+    0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+    0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+    0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+    0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+    0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+    0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+    0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+    0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+    0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+    0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+    0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+    0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+    0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+    0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+    0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+    0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+    0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
+};
+
+static uint32_t crc32(uint8_t const *const data, size_t const size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static uint8_t *put32(uint8_t *const p, uint32_t const val) {
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+    return p + 4;
+}
+
+// Fills in a chunk whose data has already been written after its header.
+// Returns a pointer past the chunk.
+static uint8_t *finish_chunk(uint8_t *const chunk, char const *const type,
+                             size_t const size) {
+    put32(chunk, size);
+    memcpy(chunk + 4, type, 4);
+    return put32(chunk + 8 + size, crc32(chunk + 4, 4 + size));
+}
+
+size_t png_encode(uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                  uint8_t const shades[4],
+                  enum png_compression const compression,
+                  uint8_t *const out) {
+    // Pack four pixels per byte, leftmost in the high bits, after each row's
+    // filter byte (0, no filter).
+    uint8_t raw[PNG_RAW_SIZE];
+    uint8_t *r = raw;
+    for (size_t y = 0; y < GB_SCREEN_HEIGHT; y++) {
+        *r++ = 0;
+        for (size_t x = 0; x < GB_SCREEN_WIDTH; x += 4) {
+            *r++ = (frame[y][x] & 3) << 6 | (frame[y][x + 1] & 3) << 4 |
+                   (frame[y][x + 2] & 3) << 2 | (frame[y][x + 3] & 3);
+        }
+    }
+
+    uint8_t *p = out;
+    memcpy(p, "\x89PNG\r\n\x1A\n", 8);
+    p += 8;
+
+    uint8_t *const ihdr = p;
+    put32(ihdr + 8, GB_SCREEN_WIDTH);
+    put32(ihdr + 12, GB_SCREEN_HEIGHT);
+    ihdr[16] = 2; // Bit depth
+    ihdr[17] = 3; // Color type: palette
+    ihdr[18] = 0; // Compression: deflate
+    ihdr[19] = 0; // Filter method: adaptive
+    ihdr[20] = 0; // No interlacing
+    p = finish_chunk(ihdr, "IHDR", 13);
+
+    uint8_t *const plte = p;
+    for (size_t i = 0; i < 4; i++) {
+        memset(plte + 8 + 3 * i, shades[i], 3);
+    }
+    p = finish_chunk(plte, "PLTE", 12);
+
+    uint8_t *const idat = p;
+    uint8_t *const zlib = idat + 8;
+    zlib[0] = 0x78; // Deflate, 32 KiB window
+    zlib[1] = 0x01; // Fastest compression level, header checksum
+    size_t size = 2;
+    switch (compression) {
+    case PNG_STORED:
+        size += deflate_stored(zlib + size, raw, sizeof(raw));
+        break;
+    case PNG_FAST: {
+        struct bits b = {.out = zlib + size};
+        deflate_fast(&b, raw, sizeof(raw));
+        size += b.size;
+        break;
+    }
+    default:
+        break;
+    }
+    put32(zlib + size, adler32(raw, sizeof(raw)));
+    size += 4;
+    p = finish_chunk(idat, "IDAT", size);
+
+    return finish_chunk(p, "IEND", 0) - out;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t
+
+#include "gb.h"
+
+// A minimal PNG encoder for Game Boy frames. Frames are written as 2-bit
+// palette images, so a whole frame is only a few KiB before compression.
+
+enum png_compression {
+    PNG_STORED = 0, // Uncompressed deflate blocks: fastest, ~6 KiB per frame
+    PNG_FAST = 1,   // Greedy LZ77 with the fixed Huffman codes
+};
+
+// Bytes of filtered image data: a filter byte and 40 bytes per row
+#define PNG_RAW_SIZE (GB_SCREEN_HEIGHT * (1 + GB_SCREEN_WIDTH / 4))
+
+// An upper bound on the size of an encoded frame
+#define PNG_MAX_SIZE (PNG_RAW_SIZE * 9 / 8 + 128)
+
+// Encodes a frame of color numbers (0-3), where color number i is drawn as the
+// gray level shades[i]. out must hold PNG_MAX_SIZE bytes. Returns the number of
+// bytes written.
+size_t png_encode(uint8_t const frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                  uint8_t const shades[4], enum png_compression compression,
+                  uint8_t *out);
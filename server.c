@@ -0,0 +1,579 @@
+#define _GNU_SOURCE     // for getopt(3), memfd_create(2), MSG_NOSIGNAL
+#include <errno.h>      // for errno, EINTR, EAGAIN
+#include <signal.h>     // for signal, SIGCHLD, SIG_IGN
+#include <stddef.h>     // for NULL, size_t
+#include <stdint.h>     // for uint8_t, uint16_t, uint32_t, uint64_t
+#include <stdio.h>      // for fprintf, fopen, fread, fclose, perror
+#include <stdlib.h>     // for EXIT_*, calloc, malloc, realloc, strtoull
+#include <string.h>     // for memcpy, memmove, strlen
+#include <sys/mman.h>   // for memfd_create, mmap, munmap
+#include <sys/socket.h> // for socket, bind, listen, accept, recv, sendmsg
+#include <sys/un.h>     // for sockaddr_un
+#include <unistd.h>     // for close, fork, ftruncate, getopt, unlink,
+                        // STDIN_FILENO
+
+#include "frame.h"
+#include "gb.h"
+#include "hash.h"
+#include "server.h"
+
+// Serves the protocol in server.h. Each connection gets its own machine in a
+// forked child, so clients can't disturb each other and a crash only drops
+// one connection.
+//
+// The server is also a zygote: it loads the ROM, and optionally a save state
+// and some frames (e.g., past the boot logo and intro), once, and sets up
+// everything a connection needs before forking. Children start from that
+// machine copy-on-write, so a new connection costs one fork() and pages stay
+// shared until a child writes to them.
+//
+// With -i, it instead serves a single client on standard input, which must be
+// a connected socket: that's how gb-bisect runs another build.
+
+#define HEADER_SIZE (8)
+#define MAX_PAYLOAD (sizeof(struct gb)) // Save states are the largest
+#define MAX_OUT (1 << 20) // Flush replies early past this many bytes
+
+struct session {
+    int fd;
+    struct gb *gb;
+    struct gb *state;  // For save states, which need alignment
+    struct gb *start;  // What SERVER_RESET goes back to
+    uint1_t has_start; // If not set, SERVER_RESET powers on instead
+    uint1_t loaded;
+    uint8_t rom[ADDRESS_SPACE_SIZE]; // For SERVER_RESET
+    size_t rom_size;
+    uint8_t *shared; // SERVER_SHARED_SIZE bytes, or NULL
+
+    uint8_t *in; // HEADER_SIZE + MAX_PAYLOAD bytes
+    size_t in_size;
+    uint8_t *out;
+    size_t out_size;
+    size_t out_capacity;
+};
+
+static uint16_t get_u16(uint8_t const *const p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get_u32(uint8_t const *const p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u32(uint8_t *const p, uint32_t const value) {
+    for (size_t i = 0; i < 4; i++) {
+        p[i] = value >> (8 * i);
+    }
+}
+
+static void put_u64(uint8_t *const p, uint64_t const value) {
+    for (size_t i = 0; i < 8; i++) {
+        p[i] = value >> (8 * i);
+    }
+}
+
+// Writes out every queued reply, passing the descriptor fd along with the
+// first byte unless it's -1. Returns 0 on success, or -1 if the client has
+// gone.
+static int flush(struct session *const s, int const fd) {
+    size_t done = 0;
+    while (done < s->out_size) {
+        struct iovec iov = {
+            .iov_base = s->out + done,
+            .iov_len = s->out_size - done,
+        };
+        struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1};
+        union {
+            struct cmsghdr header; // For alignment
+            uint8_t bytes[CMSG_SPACE(sizeof(int))];
+        } control;
+        if (done == 0 && fd >= 0) {
+            message.msg_control = control.bytes;
+            message.msg_controllen = sizeof(control.bytes);
+            struct cmsghdr *const header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        }
+        ssize_t const n = sendmsg(s->fd, &message, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    s->out_size = 0;
+    return 0;
+}
+
+// Queues a reply and returns where its size bytes of payload go, or NULL on
+// allocation failure.
+static uint8_t *reply(struct session *const s, enum server_status const status,
+                      size_t const size) {
+    size_t const needed = s->out_size + HEADER_SIZE + size;
+    if (needed > s->out_capacity) {
+        size_t capacity = s->out_capacity * 2;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        uint8_t *const out = realloc(s->out, capacity);
+        if (out == NULL) {
+            return NULL;
+        }
+        s->out = out;
+        s->out_capacity = capacity;
+    }
+    uint8_t *const header = s->out + s->out_size;
+    header[0] = status;
+    header[1] = 0;
+    header[2] = 0;
+    header[3] = 0;
+    put_u32(header + 4, size);
+    s->out_size = needed;
+    return header + HEADER_SIZE;
+}
+
+static size_t frame_size(enum server_frame_format const format) {
+    switch (format) {
+    case SERVER_FRAME_FULL:
+        return GB_SCREEN_HEIGHT * GB_SCREEN_WIDTH;
+    case SERVER_FRAME_HALF:
+        return FRAME_HALF_HEIGHT * FRAME_HALF_WIDTH;
+    case SERVER_FRAME_SQUARE:
+        return FRAME_SQUARE_SIZE * FRAME_SQUARE_SIZE;
+    case SERVER_FRAME_PACKED:
+        return GB_SCREEN_HEIGHT * FRAME_PACKED_ROW_SIZE;
+    default:
+        return 0;
+    }
+}
+
+static void write_frame(struct gb *const gb,
+                        enum server_frame_format const format,
+                        uint8_t *const out) {
+    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    get_frame(gb, frame);
+    switch (format) {
+    case SERVER_FRAME_FULL:
+        memcpy(out, frame, sizeof(frame));
+        break;
+    case SERVER_FRAME_HALF:
+        frame_downsample_half(frame, (uint8_t (*)[FRAME_HALF_WIDTH])out);
+        break;
+    case SERVER_FRAME_SQUARE:
+        frame_resize_square(frame, (uint8_t (*)[FRAME_SQUARE_SIZE])out);
+        break;
+    case SERVER_FRAME_PACKED:
+        frame_pack_2bpp(frame, (uint8_t (*)[FRAME_PACKED_ROW_SIZE])out);
+        break;
+    default:
+        break;
+    }
+}
+
+static void describe(struct gb const *const gb, uint8_t *const out) {
+    uint32_t pcmem = 0;
+    for (size_t i = 0; i < 4; i++) {
+        pcmem |= (uint32_t)gb->address_space[(uint16_t)(gb->pc + i)] << (8 * i);
+    }
+    struct server_machine const machine = {
+        .af = gb->af,
+        .bc = gb->bc,
+        .de = gb->de,
+        .hl = gb->hl,
+        .sp = gb->sp,
+        .pc = gb->pc,
+        .ime = gb->ime,
+        .halted = gb->halted,
+        .fault = gb->fault,
+        .need_to_do_interrupts = gb->need_to_do_interrupts,
+        .cycle_count = gb->cycle_count,
+        .cycles_to_wait = gb->cycles_to_wait,
+        .dot_count = gb->dot_count,
+        .frame_count = gb->frame_count,
+        .graphics_mode = gb->graphics_mode,
+        .joypad_mode = gb->joypad_mode,
+        .pcmem = pcmem,
+        .memory_hash =
+            hash64(gb->address_space, sizeof(gb->address_space), 0),
+        .screen_hash = hash64(gb->screen, sizeof(gb->screen), 0),
+    };
+    uint64_t fields[SERVER_MACHINE_FIELDS];
+    memcpy(fields, &machine, sizeof(fields));
+    for (size_t i = 0; i < SERVER_MACHINE_FIELDS; i++) {
+        put_u64(out + 8 * i, fields[i]);
+    }
+}
+
+// Maps a new memfd for shared frames, in place of any earlier one. Returns
+// its descriptor, for the client, or -1 on failure.
+static int share_frame(struct session *const s) {
+    int const fd = memfd_create("gb-server-frame", 0);
+    if (fd < 0) {
+        return -1;
+    }
+    void *shared = MAP_FAILED;
+    if (ftruncate(fd, SERVER_SHARED_SIZE) == 0) {
+        shared = mmap(NULL, SERVER_SHARED_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    }
+    if (shared == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (s->shared != NULL) {
+        munmap(s->shared, SERVER_SHARED_SIZE);
+    }
+    s->shared = shared;
+    return fd;
+}
+
+// Runs one request and queues its reply. Returns -1 if the reply couldn't be
+// queued.
+static int handle(struct session *const s, uint8_t const code,
+                  uint8_t const flags, uint8_t const *const payload,
+                  size_t const size) {
+    enum server_status status = SERVER_OK;
+    uint8_t *out;
+    if (!s->loaded && code != SERVER_LOAD_ROM && code != SERVER_LOAD_STATE &&
+        code != SERVER_SHARE_FRAME) {
+        return reply(s, SERVER_NO_ROM, 0) == NULL ? -1 : 0;
+    }
+    switch (code) {
+    case SERVER_LOAD_ROM:
+        if (size == 0 || size > sizeof(s->rom)) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        memcpy(s->rom, payload, size);
+        s->rom_size = size;
+        initialize_from_buffer(s->gb, s->rom, s->rom_size);
+        s->loaded = 1;
+        s->has_start = 0;
+        break;
+    case SERVER_RESET:
+        if (s->has_start) {
+            load_state(s->gb, s->start);
+            break;
+        }
+        if (s->rom_size == 0) {
+            status = SERVER_NO_ROM; // Only a save state was loaded
+            break;
+        }
+        initialize_from_buffer(s->gb, s->rom, s->rom_size);
+        break;
+    case SERVER_SET_BUTTONS:
+        if (size != 1) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        set_buttons(s->gb, payload[0]);
+        break;
+    case SERVER_RUN_FRAMES:
+        if (size != 4) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        for (uint32_t f = get_u32(payload); f > 0; f--) {
+            run_frame(s->gb);
+        }
+        out = reply(s, SERVER_OK, 8);
+        if (out == NULL) {
+            return -1;
+        }
+        put_u64(out, s->gb->frame_count);
+        return 0;
+    case SERVER_GET_FRAME: {
+        enum server_frame_format const format = flags & ~SERVER_FRAME_SHARED;
+        size_t const bytes = frame_size(format);
+        if (bytes == 0 || size != 0) {
+            status = bytes == 0 ? SERVER_BAD_COMMAND : SERVER_BAD_PAYLOAD;
+            break;
+        }
+        if (flags & SERVER_FRAME_SHARED) {
+            if (s->shared == NULL) {
+                status = SERVER_FAILED;
+                break;
+            }
+            write_frame(s->gb, format, s->shared);
+            break;
+        }
+        out = reply(s, SERVER_OK, bytes);
+        if (out == NULL) {
+            return -1;
+        }
+        write_frame(s->gb, format, out);
+        return 0;
+    }
+    case SERVER_GET_RAM: {
+        if (size != 6) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        uint16_t const start = get_u16(payload);
+        uint32_t const bytes = get_u32(payload + 2);
+        if (start + (uint64_t)bytes > ADDRESS_SPACE_SIZE) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        out = reply(s, SERVER_OK, bytes);
+        if (out == NULL) {
+            return -1;
+        }
+        memcpy(out, s->gb->address_space + start, bytes);
+        return 0;
+    }
+    case SERVER_SAVE_STATE:
+        out = reply(s, SERVER_OK, sizeof(*s->state));
+        if (out == NULL) {
+            return -1;
+        }
+        save_state(s->gb, s->state);
+        memcpy(out, s->state, sizeof(*s->state));
+        return 0;
+    case SERVER_LOAD_STATE:
+        if (size != sizeof(*s->state)) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        memcpy(s->state, payload, size);
+        load_state(s->gb, s->state);
+        s->loaded = 1;
+        break;
+    case SERVER_SHARE_FRAME: {
+        if (size != 0) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        int const fd = share_frame(s);
+        if (fd < 0) {
+            status = SERVER_FAILED;
+            break;
+        }
+        // The descriptor has to arrive with this reply, so earlier ones go
+        // out first.
+        int const result = flush(s, -1) == 0 &&
+                                   reply(s, SERVER_OK, 0) != NULL &&
+                                   flush(s, fd) == 0
+                               ? 0
+                               : -1;
+        close(fd);
+        return result;
+    }
+    case SERVER_STEP:
+        if (size != 4) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        for (uint32_t n = get_u32(payload); n > 0; n--) {
+            step(s->gb);
+            wait(s->gb);
+        }
+        out = reply(s, SERVER_OK, 8 * SERVER_MACHINE_FIELDS);
+        if (out == NULL) {
+            return -1;
+        }
+        describe(s->gb, out);
+        return 0;
+    case SERVER_HASH_STATE:
+        if (size != 0) {
+            status = SERVER_BAD_PAYLOAD;
+            break;
+        }
+        out = reply(s, SERVER_OK, 8);
+        if (out == NULL) {
+            return -1;
+        }
+        put_u64(out, hash_state(s->gb));
+        return 0;
+    default:
+        status = SERVER_BAD_COMMAND;
+        break;
+    }
+    return reply(s, status, 0) == NULL ? -1 : 0;
+}
+
+// Runs every complete request in the input buffer. Returns -1 if the
+// connection should be dropped.
+static int handle_buffered(struct session *const s) {
+    size_t pos = 0;
+    while (s->in_size - pos >= HEADER_SIZE) {
+        uint8_t const *const header = s->in + pos;
+        uint32_t const size = get_u32(header + 4);
+        if (size > MAX_PAYLOAD) {
+            return -1; // There's no way to skip it and stay in sync
+        }
+        if (s->in_size - pos < HEADER_SIZE + size) {
+            break;
+        }
+        if (handle(s, header[0], header[1], header + HEADER_SIZE, size) != 0) {
+            return -1;
+        }
+        pos += HEADER_SIZE + size;
+        if (s->out_size >= MAX_OUT && flush(s, -1) != 0) {
+            return -1;
+        }
+    }
+    memmove(s->in, s->in + pos, s->in_size - pos);
+    s->in_size -= pos;
+    return 0;
+}
+
+static void serve(struct session *const s) {
+    while (handle_buffered(s) == 0) {
+        uint8_t *const dest = s->in + s->in_size;
+        size_t const room = HEADER_SIZE + MAX_PAYLOAD - s->in_size;
+        // Only answer once the client has nothing more queued, so that
+        // pipelined requests get their replies in as few writes as possible.
+        ssize_t n = recv(s->fd, dest, room, MSG_DONTWAIT);
+        if (n < 0 && errno == EAGAIN) {
+            if (flush(s, -1) != 0) {
+                return;
+            }
+            n = recv(s->fd, dest, room, 0);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            flush(s, -1);
+            return;
+        }
+        s->in_size += n;
+    }
+}
+
+// Allocates everything a connection needs, so children don't have to. The
+// machines start zeroed, since a save state can be loaded before any ROM, and
+// load_state() keeps the host-side pointers of the machine it loads into.
+static int open_session(struct session *const s) {
+    s->gb = calloc(1, sizeof(*s->gb));
+    s->state = calloc(1, sizeof(*s->state));
+    s->start = calloc(1, sizeof(*s->start));
+    s->in = malloc(HEADER_SIZE + MAX_PAYLOAD);
+    s->out_capacity = 1 << 16;
+    s->out = malloc(s->out_capacity);
+    return s->gb == NULL || s->state == NULL || s->start == NULL ||
+                   s->in == NULL || s->out == NULL
+               ? -1
+               : 0;
+}
+
+static void usage(char const *const argv0) {
+    fprintf(stderr,
+            "Usage: %s [-r rom_file] [-l state_file] [-f frames] "
+            "<socket_path | -i>\n",
+            argv0);
+}
+
+int main(int argc, char *const *const argv) {
+    char const *rom_path = NULL;
+    char const *state_path = NULL;
+    uint64_t boot_frames = 0;
+    uint1_t serve_stdin = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:l:f:i")) != -1) {
+        switch (opt) {
+        case 'r':
+            rom_path = optarg;
+            break;
+        case 'l':
+            state_path = optarg;
+            break;
+        case 'f':
+            boot_frames = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            serve_stdin = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + !serve_stdin != argc || (boot_frames > 0 && rom_path == NULL &&
+                               state_path == NULL)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Everything a connection starts from, shared copy-on-write by children
+    static struct session session;
+    if (open_session(&session) != 0) {
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+    if (rom_path != NULL) {
+        FILE *const f = fopen(rom_path, "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Couldn't open %s!\n", rom_path);
+            return EXIT_FAILURE;
+        }
+        session.rom_size = fread(session.rom, 1, sizeof(session.rom), f);
+        fclose(f);
+        initialize_from_buffer(session.gb, session.rom, session.rom_size);
+        session.loaded = 1;
+    }
+    if (state_path != NULL) {
+        if (read_state(session.gb, state_path) != 0) {
+            fprintf(stderr, "Couldn't load state from %s!\n", state_path);
+            return EXIT_FAILURE;
+        }
+        session.loaded = 1;
+    }
+    for (uint64_t f = 0; f < boot_frames; f++) {
+        run_frame(session.gb);
+    }
+    if (state_path != NULL || boot_frames > 0) {
+        save_state(session.gb, session.start);
+        session.has_start = 1;
+    }
+    if (serve_stdin) {
+        session.fd = STDIN_FILENO;
+        serve(&session);
+        return EXIT_SUCCESS;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    char const *const path = argv[optind];
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long!\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    int const listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr const *)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 64) != 0) {
+        perror("gb-server");
+        return EXIT_FAILURE;
+    }
+    signal(SIGCHLD, SIG_IGN); // Children reap themselves
+
+    while (1) {
+        int const fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("gb-server");
+            return EXIT_FAILURE;
+        }
+        pid_t const pid = fork();
+        if (pid == 0) {
+            close(listener);
+            session.fd = fd;
+            serve(&session);
+            close(fd);
+            return EXIT_SUCCESS;
+        }
+        if (pid < 0) {
+            perror("gb-server");
+        }
+        close(fd);
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h> // for uint8_t, uint16_t, uint32_t, uint64_t
+
+#include "gb.h"
+
+// The gb-server protocol. Clients send requests over a Unix stream socket and
+// get one response per request, in order. Every message is an 8-byte header
+// followed by size bytes of payload; all integers are little-endian.
+//
+// Requests can be pipelined: the server answers everything it has received
+// before writing anything back, so many commands sent in one write share one
+// round trip.
+//
+// Save states are only good for the build that made them, but
+// SERVER_HASH_STATE and SERVER_STEP describe a machine the same way in every
+// build, so a client can compare two builds run side by side (see gb-bisect).
+
+struct server_header {
+    uint8_t code;  // enum server_command, or enum server_status in replies
+    uint8_t flags; // Per command; 0 in replies
+    uint16_t zero; // Reserved
+    uint32_t size; // Bytes of payload that follow
+};
+
+enum server_command {
+    // Payload: the ROM image. Loads it and powers on.
+    SERVER_LOAD_ROM = 1,
+    // Powers the loaded ROM back on.
+    SERVER_RESET = 2,
+    // Payload: u8 button mask (bit n for enum joypad_button n), held from now
+    // on.
+    SERVER_SET_BUTTONS = 3,
+    // Payload: u32 frame count. Reply: u64 frame counter afterwards.
+    SERVER_RUN_FRAMES = 4,
+    // Flags: enum server_frame_format, optionally | SERVER_FRAME_SHARED.
+    // Reply: the visible screen in that format (see frame.h), or nothing if
+    // it went to shared memory instead.
+    SERVER_GET_FRAME = 5,
+    // Payload: u16 start address, u32 size. Reply: that much memory, read
+    // without side effects.
+    SERVER_GET_RAM = 6,
+    // Reply: a save state (see save_state()), only loadable into the same
+    // build of gb-server.
+    SERVER_SAVE_STATE = 7,
+    // Payload: a save state from SERVER_SAVE_STATE.
+    SERVER_LOAD_STATE = 8,
+    // Maps a new SERVER_SHARED_SIZE-byte memfd, for SERVER_GET_FRAME with
+    // SERVER_FRAME_SHARED. The reply comes with the memfd's descriptor
+    // (SCM_RIGHTS ancillary data on its first byte; see recvmsg(2)), for the
+    // client to map.
+    SERVER_SHARE_FRAME = 9,
+    // Payload: u32 step count. Runs that many steps (step() then wait(), like
+    // the reference engine). Reply: a struct server_machine afterwards.
+    SERVER_STEP = 10,
+    // Reply: u64 hash_state() of the machine.
+    SERVER_HASH_STATE = 11,
+};
+
+// A machine as SERVER_STEP describes it: each field as a u64, in this order.
+struct server_machine {
+    uint64_t af;
+    uint64_t bc;
+    uint64_t de;
+    uint64_t hl;
+    uint64_t sp;
+    uint64_t pc;
+    uint64_t ime;
+    uint64_t halted;
+    uint64_t fault;
+    uint64_t need_to_do_interrupts;
+    uint64_t cycle_count;
+    uint64_t cycles_to_wait;
+    uint64_t dot_count;
+    uint64_t frame_count;
+    uint64_t graphics_mode;
+    uint64_t joypad_mode;
+    uint64_t pcmem;       // The 4 bytes at PC, first byte lowest
+    uint64_t memory_hash; // hash64() of the address space, seeded with 0
+    uint64_t screen_hash; // hash64() of the whole screen buffer, seeded with 0
+};
+
+#define SERVER_MACHINE_FIELDS (sizeof(struct server_machine) / sizeof(uint64_t))
+
+enum server_frame_format {
+    SERVER_FRAME_FULL = 0,   // 160x144, one color number (0-3) per byte
+    SERVER_FRAME_HALF = 1,   // 80x72 grayscale
+    SERVER_FRAME_SQUARE = 2, // 84x84 grayscale
+    SERVER_FRAME_PACKED = 3, // 160x144, four pixels per byte
+};
+
+#define SERVER_FRAME_SHARED (0x80)
+#define SERVER_SHARED_SIZE (GB_SCREEN_HEIGHT * GB_SCREEN_WIDTH)
+
+enum server_status {
+    SERVER_OK = 0,
+    SERVER_BAD_COMMAND = 1, // Unknown command or flags
+    SERVER_BAD_PAYLOAD = 2, // Wrong payload size or contents
+    SERVER_NO_ROM = 3,      // Nothing loaded yet
+    SERVER_FAILED = 4,      // E.g., the shared memory couldn't be mapped
+};
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE     // for memfd_create(2)
+#include <fcntl.h>      // for open, O_RDWR, O_CREAT
+#include <stdatomic.h>  // for atomic_*
+#include <stddef.h>     // for NULL
+#include <stdint.h>     // for uint8_t, uint64_t
+#include <stdlib.h>     // for malloc, free
+#include <string.h>     // for memcmp, memcpy
+#include <sys/mman.h>   // for memfd_create, mmap, munmap
+#include <unistd.h>     // for close, ftruncate
+
+#include "gb.h"
+#include "share.h"
+
+struct share {
+    int fd;
+    struct share_region *region;
+};
+
+struct share *share_open(char const *const path) {
+    struct share *const share = malloc(sizeof(*share));
+    if (share == NULL) {
+        return NULL;
+    }
+    share->fd = path != NULL ? open(path, O_RDWR | O_CREAT, 0600)
+                             : memfd_create("gb-share", 0);
+    if (share->fd < 0) {
+        free(share);
+        return NULL;
+    }
+    void *region = MAP_FAILED;
+    if (ftruncate(share->fd, sizeof(*share->region)) == 0) {
+        region = mmap(NULL, sizeof(*share->region), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, share->fd, 0);
+    }
+    if (region == MAP_FAILED) {
+        close(share->fd);
+        free(share);
+        return NULL;
+    }
+    share->region = region;
+    atomic_store_explicit(&share->region->sequence, 0, memory_order_relaxed);
+    share->region->frame_count = 0;
+    memcpy(share->region->magic, SHARE_MAGIC, sizeof(share->region->magic));
+    share->region->version = SHARE_VERSION;
+    return share;
+}
+
+int share_fd(struct share const *const share) {
+    return share->fd;
+}
+
+void share_publish(struct share *const share, struct gb *const gb) {
+    struct share_region *const region = share->region;
+    uint64_t const sequence =
+        atomic_load_explicit(&region->sequence, memory_order_relaxed);
+    atomic_store_explicit(&region->sequence, sequence + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    region->frame_count = gb->frame_count;
+    get_frame(gb, region->frame);
+    memcpy(region->wram, get_wram(gb), sizeof(region->wram));
+    atomic_store_explicit(&region->sequence, sequence + 2,
+                          memory_order_release);
+}
+
+void share_close(struct share *const share) {
+    if (share == NULL) {
+        return;
+    }
+    munmap(share->region, sizeof(*share->region));
+    close(share->fd);
+    free(share);
+}
+
+struct share_region *share_map(int const fd) {
+    struct share_region *const region =
+        mmap(NULL, sizeof(*region), PROT_READ, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+    if (memcmp(region->magic, SHARE_MAGIC, sizeof(region->magic)) != 0 ||
+        region->version != SHARE_VERSION) {
+        share_unmap(region);
+        return NULL;
+    }
+    return region;
+}
+
+void share_unmap(struct share_region *const region) {
+    munmap(region, sizeof(*region));
+}
+
+uint64_t share_read(struct share_region const *const region,
+                    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                    uint8_t wram[GB_WRAM_SIZE]) {
+    while (1) {
+        uint64_t const before =
+            atomic_load_explicit(&region->sequence, memory_order_acquire);
+        if (before % 2 != 0) {
+            continue;
+        }
+        uint64_t const frame_count = region->frame_count;
+        if (frame != NULL) {
+            memcpy(frame, region->frame, sizeof(region->frame));
+        }
+        if (wram != NULL) {
+            memcpy(wram, region->wram, sizeof(region->wram));
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&region->sequence, memory_order_relaxed) ==
+            before) {
+            return frame_count;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdatomic.h> // for _Atomic
+#include <stdint.h>    // for uint8_t, uint32_t, uint64_t
+
+#include "gb.h"
+
+// Publishes each completed frame, and work RAM as it was at that vblank, in a
+// shared memory region that other processes can map and read without any
+// copy through a pipe or socket, or any syscall per frame.
+//
+// The region starts with a struct share_region. Readers use the seqlock in
+// sequence: read it (acquire), and retry if it's odd, since a frame is being
+// written; read the data; then read sequence again and retry if it changed.
+// share_read() does this for C readers.
+
+#define SHARE_MAGIC ("GBSH")
+#define SHARE_VERSION (1)
+
+struct share_region {
+    char magic[4];
+    uint32_t version;
+    _Atomic uint64_t sequence; // Odd while the data below is being written
+    uint64_t frame_count;      // gb->frame_count of the published frame
+    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]; // As get_frame() gives
+    uint8_t wram[GB_WRAM_SIZE];
+};
+
+// Creates a region. With a path (e.g., under /dev/shm), the region is that
+// file, so unrelated processes can map it by name; with NULL, it's an
+// anonymous memfd, for passing on by descriptor (see share_fd()) or through
+// /proc/<pid>/fd. Returns NULL on failure.
+struct share *share_open(char const *path);
+
+// The region's file descriptor, for mmap() with PROT_READ and MAP_SHARED.
+int share_fd(struct share const *share);
+
+// Publishes gb's frame and work RAM. Called at every vblank of a gb with
+// this share attached; see struct gb.
+void share_publish(struct share *share, struct gb *gb);
+
+void share_close(struct share *share);
+
+// Maps a region read-only. Returns NULL if it can't be mapped or isn't a
+// region of this version.
+struct share_region *share_map(int fd);
+
+void share_unmap(struct share_region *region);
+
+// Copies out a consistent frame and work RAM (either may be NULL) and returns
+// its frame count.
+uint64_t share_read(struct share_region const *region,
+                    uint8_t frame[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                    uint8_t wram[GB_WRAM_SIZE]);
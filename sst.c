@@ -0,0 +1,500 @@
+#define _GNU_SOURCE   // for clock_gettime(2), getopt(3)
+#include <dirent.h>   // for opendir, readdir, closedir, DIR
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, offsetof, size_t
+#include <stdint.h>   // for int64_t, uint*_t
+#include <stdio.h>    // for printf, fprintf, snprintf, fopen, fread, FILE
+#include <stdlib.h>   // for EXIT_*, malloc, realloc, free, qsort, strtoll
+#include <string.h>   // for memset, strcmp, strlen, strrchr
+#include <sys/stat.h> // for stat, S_ISDIR
+#include <time.h>     // for clock_gettime
+#include <unistd.h>   // for getopt
+
+#include "gb.h"
+
+// Runs single-instruction CPU tests in the SingleStepTests JSON format: each
+// file holds an array of tests, each of which gives the registers and RAM
+// before and after one instruction, and the bus activity of every M-cycle.
+// The CPU runs on a flat bus, so the tests see 64K of plain RAM. We check the
+// registers, RAM, and the number of M-cycles taken; we don't model the bus
+// activity within an instruction.
+
+#define MAX_RAM (256)
+#define MAX_NAME (64)
+#define MAX_PRINTED_FAILURES (1)
+
+struct state {
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint8_t d;
+    uint8_t e;
+    uint8_t f;
+    uint8_t h;
+    uint8_t l;
+    uint8_t ime;
+    uint8_t ie;
+    size_t num_ram;
+    uint16_t ram_addr[MAX_RAM];
+    uint8_t ram_val[MAX_RAM];
+};
+
+struct test {
+    char name[MAX_NAME];
+    struct state initial;
+    struct state final;
+    size_t num_cycles;
+};
+
+// A parser for just enough JSON to read the tests. Anything unexpected sets
+// error, after which the results are meaningless.
+struct parser {
+    char const *p;
+    char const *end;
+    uint1_t error;
+};
+
+static void skip_space(struct parser *const ps) {
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\n' ||
+                               *ps->p == '\r' || *ps->p == '\t')) {
+        ps->p++;
+    }
+}
+
+// Returns whether the next character is c, consuming it if so.
+static uint1_t accept(struct parser *const ps, char const c) {
+    skip_space(ps);
+    if (ps->p < ps->end && *ps->p == c) {
+        ps->p++;
+        return 1;
+    }
+    return 0;
+}
+
+static void expect(struct parser *const ps, char const c) {
+    if (!accept(ps, c)) {
+        ps->error = 1;
+    }
+}
+
+static int64_t parse_int(struct parser *const ps) {
+    skip_space(ps);
+    char *end;
+    int64_t const value = strtoll(ps->p, &end, 10);
+    if (end == ps->p) {
+        ps->error = 1;
+        ps->p = ps->end;
+    } else {
+        ps->p = end;
+    }
+    return value;
+}
+
+// Copies the string, without its quotes, into out. Escapes are kept as-is.
+static void parse_string(struct parser *const ps, char *const out,
+                         size_t const out_size) {
+    expect(ps, '"');
+    size_t n = 0;
+    while (ps->p < ps->end && *ps->p != '"') {
+        if (*ps->p == '\\' && ps->p + 1 < ps->end) {
+            if (n + 1 < out_size) {
+                out[n++] = *ps->p;
+            }
+            ps->p++;
+        }
+        if (n + 1 < out_size) {
+            out[n++] = *ps->p;
+        }
+        ps->p++;
+    }
+    out[n] = '\0';
+    expect(ps, '"');
+}
+
+static void skip_value(struct parser *const ps) {
+    skip_space(ps);
+    if (ps->p >= ps->end) {
+        ps->error = 1;
+    } else if (*ps->p == '"') {
+        char ignored[1];
+        parse_string(ps, ignored, sizeof(ignored));
+    } else if (accept(ps, '[')) {
+        if (!accept(ps, ']')) {
+            do {
+                skip_value(ps);
+            } while (!ps->error && accept(ps, ','));
+            expect(ps, ']');
+        }
+    } else if (accept(ps, '{')) {
+        if (!accept(ps, '}')) {
+            do {
+                char ignored[1];
+                parse_string(ps, ignored, sizeof(ignored));
+                expect(ps, ':');
+                skip_value(ps);
+            } while (!ps->error && accept(ps, ','));
+            expect(ps, '}');
+        }
+    } else {
+        // A number, true, false or null
+        while (ps->p < ps->end && *ps->p != ',' && *ps->p != ']' &&
+               *ps->p != '}' && *ps->p != ' ' && *ps->p != '\n') {
+            ps->p++;
+        }
+    }
+}
+
+// Parses [[addr, val], ...].
+static void parse_ram(struct parser *const ps, struct state *const state) {
+    state->num_ram = 0;
+    expect(ps, '[');
+    if (accept(ps, ']')) {
+        return;
+    }
+    do {
+        expect(ps, '[');
+        int64_t const addr = parse_int(ps);
+        expect(ps, ',');
+        int64_t const val = parse_int(ps);
+        expect(ps, ']');
+        if (state->num_ram == MAX_RAM) {
+            ps->error = 1;
+            return;
+        }
+        state->ram_addr[state->num_ram] = addr;
+        state->ram_val[state->num_ram] = val;
+        state->num_ram++;
+    } while (!ps->error && accept(ps, ','));
+    expect(ps, ']');
+}
+
+static void parse_state(struct parser *const ps, struct state *const state) {
+    memset(state, 0, offsetof(struct state, ram_addr));
+    expect(ps, '{');
+    if (accept(ps, '}')) {
+        return;
+    }
+    do {
+        char key[16];
+        parse_string(ps, key, sizeof(key));
+        expect(ps, ':');
+        if (strcmp(key, "ram") == 0) {
+            parse_ram(ps, state);
+            continue;
+        }
+        uint8_t *const reg = strcmp(key, "a") == 0     ? &state->a
+                             : strcmp(key, "b") == 0   ? &state->b
+                             : strcmp(key, "c") == 0   ? &state->c
+                             : strcmp(key, "d") == 0   ? &state->d
+                             : strcmp(key, "e") == 0   ? &state->e
+                             : strcmp(key, "f") == 0   ? &state->f
+                             : strcmp(key, "h") == 0   ? &state->h
+                             : strcmp(key, "l") == 0   ? &state->l
+                             : strcmp(key, "ime") == 0 ? &state->ime
+                             : strcmp(key, "ie") == 0  ? &state->ie
+                                                       : NULL;
+        if (reg != NULL) {
+            *reg = parse_int(ps);
+        } else if (strcmp(key, "pc") == 0) {
+            state->pc = parse_int(ps);
+        } else if (strcmp(key, "sp") == 0) {
+            state->sp = parse_int(ps);
+        } else {
+            skip_value(ps);
+        }
+    } while (!ps->error && accept(ps, ','));
+    expect(ps, '}');
+}
+
+// Parses one test object. The cycles are only counted.
+static void parse_test(struct parser *const ps, struct test *const test) {
+    test->name[0] = '\0';
+    test->num_cycles = 0;
+    expect(ps, '{');
+    do {
+        char key[16];
+        parse_string(ps, key, sizeof(key));
+        expect(ps, ':');
+        if (strcmp(key, "name") == 0) {
+            parse_string(ps, test->name, sizeof(test->name));
+        } else if (strcmp(key, "initial") == 0) {
+            parse_state(ps, &test->initial);
+        } else if (strcmp(key, "final") == 0) {
+            parse_state(ps, &test->final);
+        } else if (strcmp(key, "cycles") == 0) {
+            expect(ps, '[');
+            if (!accept(ps, ']')) {
+                do {
+                    skip_value(ps);
+                    test->num_cycles++;
+                } while (!ps->error && accept(ps, ','));
+                expect(ps, ']');
+            }
+        } else {
+            skip_value(ps);
+        }
+    } while (!ps->error && accept(ps, ','));
+    expect(ps, '}');
+}
+
+static void load_test_state(struct gb *const gb,
+                            struct state const *const state) {
+    gb->af = (state->a << 8) | state->f;
+    gb->bc = (state->b << 8) | state->c;
+    gb->de = (state->d << 8) | state->e;
+    gb->hl = (state->h << 8) | state->l;
+    gb->sp = state->sp;
+    gb->pc = state->pc;
+    gb->ime = state->ime;
+    gb->halted = 0;
+    gb->cycles_to_wait = 0;
+    gb->need_to_do_interrupts = 0;
+    gb->address_space[0xFFFF] = state->ie;
+    for (size_t i = 0; i < state->num_ram; i++) {
+        gb->address_space[state->ram_addr[i]] = state->ram_val[i];
+    }
+}
+
+#define CHECK(name, expected, actual)                                          \
+    do {                                                                       \
+        if ((expected) != (actual)) {                                          \
+            if (print) {                                                       \
+                printf("    %-6s expected 0x%04X, got 0x%04X\n", name,         \
+                       (unsigned int)(expected), (unsigned int)(actual));      \
+            }                                                                  \
+            passed = 0;                                                        \
+        }                                                                      \
+    } while (0)
+
+// Runs one test, printing what went wrong if print is set. Leaves memory
+// zeroed again afterwards.
+static uint1_t run_test(struct gb *const gb, struct test const *const test,
+                        uint1_t const print) {
+    load_test_state(gb, &test->initial);
+    step(gb);
+
+    struct state const *const final = &test->final;
+    uint1_t passed = 1;
+    if (print) {
+        printf("  %s:\n", test->name);
+    }
+    CHECK("a", final->a, gb->af >> 8);
+    CHECK("f", final->f, gb->af & 0xFF);
+    CHECK("b", final->b, gb->bc >> 8);
+    CHECK("c", final->c, gb->bc & 0xFF);
+    CHECK("d", final->d, gb->de >> 8);
+    CHECK("e", final->e, gb->de & 0xFF);
+    CHECK("h", final->h, gb->hl >> 8);
+    CHECK("l", final->l, gb->hl & 0xFF);
+    CHECK("sp", final->sp, gb->sp);
+    CHECK("pc", final->pc, gb->pc);
+    CHECK("ime", final->ime, gb->ime);
+    CHECK("cycles", test->num_cycles, gb->cycles_to_wait);
+    for (size_t i = 0; i < final->num_ram; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "[%04X]", final->ram_addr[i]);
+        CHECK(name, final->ram_val[i], gb->address_space[final->ram_addr[i]]);
+    }
+
+    if (passed) {
+        for (size_t i = 0; i < test->initial.num_ram; i++) {
+            gb->address_space[test->initial.ram_addr[i]] = 0;
+        }
+        for (size_t i = 0; i < final->num_ram; i++) {
+            gb->address_space[final->ram_addr[i]] = 0;
+        }
+        gb->address_space[0xFFFF] = 0;
+    } else {
+        // It may have written somewhere unexpected.
+        memset(gb->address_space, 0, sizeof(gb->address_space));
+    }
+    return passed;
+}
+
+static char *read_file(char const *const path, size_t *const size) {
+    FILE *const f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    char *data = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long const len = ftell(f);
+        data = len < 0 ? NULL : malloc(len + 1);
+        if (data != NULL && (fseek(f, 0, SEEK_SET) != 0 ||
+                             fread(data, 1, len, f) != (size_t)len)) {
+            free(data);
+            data = NULL;
+        } else if (data != NULL) {
+            data[len] = '\0'; // So that strtoll stops at the end
+            *size = len;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+struct totals {
+    uint64_t passed;
+    uint64_t total;
+    uint64_t files_failing;
+};
+
+// Runs every test in one file and prints a line for it.
+static int run_file(char const *const path, uint1_t const verbose,
+                    uint1_t const quiet, struct totals *const totals) {
+    size_t size;
+    char *const data = read_file(path, &size);
+    if (data == NULL) {
+        fprintf(stderr, "Couldn't read %s!\n", path);
+        return -1;
+    }
+
+    static struct gb gb;
+    initialize_flat(&gb);
+    static struct test test;
+    struct parser ps = {.p = data, .end = data + size};
+    uint64_t passed = 0;
+    uint64_t total = 0;
+    size_t printed = 0;
+    expect(&ps, '[');
+    if (!accept(&ps, ']')) {
+        do {
+            parse_test(&ps, &test);
+            if (ps.error) {
+                break;
+            }
+            total++;
+            if (run_test(&gb, &test, 0)) {
+                passed++;
+            } else if (verbose || printed < MAX_PRINTED_FAILURES) {
+                if (printed == 0) {
+                    printf("%s:\n", path);
+                }
+                run_test(&gb, &test, 1); // Again, to show what went wrong
+                printed++;
+            }
+        } while (accept(&ps, ','));
+        expect(&ps, ']');
+    }
+    free(data);
+    if (ps.error) {
+        fprintf(stderr, "Couldn't parse %s near byte %td!\n", path,
+                ps.p - data);
+        return -1;
+    }
+
+    char const *const slash = strrchr(path, '/');
+    if (!quiet || passed != total) {
+        printf("%-16s %6" PRIu64 "/%6" PRIu64 " %s\n",
+               slash == NULL ? path : slash + 1, passed, total,
+               passed == total ? "pass" : "FAIL");
+    }
+    totals->passed += passed;
+    totals->total += total;
+    totals->files_failing += passed != total;
+    return 0;
+}
+
+static int compare_names(void const *const a, void const *const b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Runs every .json file in dir, in name order.
+static int run_dir(char const *const dir, uint1_t const verbose,
+                   uint1_t const quiet, struct totals *const totals) {
+    DIR *const d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "Couldn't open %s!\n", dir);
+        return -1;
+    }
+    char **paths = NULL;
+    size_t num_paths = 0;
+    struct dirent const *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t const len = strlen(entry->d_name);
+        if (len < 5 || strcmp(entry->d_name + len - 5, ".json") != 0) {
+            continue;
+        }
+        char **const new_paths =
+            realloc(paths, (num_paths + 1) * sizeof(*paths));
+        char *const path = malloc(strlen(dir) + len + 2);
+        if (new_paths == NULL || path == NULL) {
+            free(path);
+            closedir(d);
+            return -1;
+        }
+        paths = new_paths;
+        sprintf(path, "%s/%s", dir, entry->d_name);
+        paths[num_paths++] = path;
+    }
+    closedir(d);
+
+    qsort(paths, num_paths, sizeof(*paths), compare_names);
+    int status = 0;
+    for (size_t i = 0; i < num_paths; i++) {
+        if (run_file(paths[i], verbose, quiet, totals) != 0) {
+            status = -1;
+        }
+        free(paths[i]);
+    }
+    free(paths);
+    return status;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(char const *const argv0) {
+    fprintf(stderr, "Usage: %s [-v] [-q] <test_file_or_dir>...\n", argv0);
+}
+
+int main(int argc, char *const *const argv) {
+    uint1_t verbose = 0;
+    uint1_t quiet = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "vq")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct totals totals = {0};
+    int status = EXIT_SUCCESS;
+    uint64_t const start = now_ns();
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+        int const result =
+            stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)
+                ? run_dir(argv[i], verbose, quiet, &totals)
+                : run_file(argv[i], verbose, quiet, &totals);
+        if (result != 0) {
+            status = EXIT_FAILURE;
+        }
+    }
+    uint64_t const wall_ns = now_ns() - start;
+
+    printf("%" PRIu64 "/%" PRIu64 " tests passed, %" PRIu64
+           " files failing, in %.2fs\n",
+           totals.passed, totals.total, totals.files_failing, wall_ns / 1e9);
+    if (totals.passed != totals.total) {
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
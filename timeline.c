@@ -0,0 +1,131 @@
+#define _GNU_SOURCE   // for clock_gettime(2)
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint*_t
+#include <stdio.h>    // for FILE, fopen, fprintf, fclose
+#include <stdlib.h>   // for calloc, realloc, free
+#include <time.h>     // for clock_gettime
+
+#include "timeline.h"
+
+struct timeline_record {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t arg;
+    enum timeline_event event;
+};
+
+struct timeline {
+    uint64_t origin_ns;
+    uint64_t open_since[NUM_TIMELINE_EVENTS];
+    uint32_t open_arg[NUM_TIMELINE_EVENTS];
+    uint8_t is_open[NUM_TIMELINE_EVENTS];
+    struct timeline_record *records;
+    size_t num_records;
+    size_t capacity;
+};
+
+static char const *const EVENT_NAMES[NUM_TIMELINE_EVENTS] = {
+    [TL_FRAME] = "frame",
+    [TL_SCANLINE] = "scanline",
+    [TL_VBLANK_RENDER] = "vblank render",
+    [TL_TEXTURE_UPLOAD] = "texture upload",
+    [TL_PRESENT] = "present",
+};
+
+static char const *const ARG_NAMES[NUM_TIMELINE_EVENTS] = {
+    [TL_FRAME] = "frame",
+    [TL_SCANLINE] = "ly",
+    [TL_VBLANK_RENDER] = "frame",
+    [TL_TEXTURE_UPLOAD] = "frame",
+    [TL_PRESENT] = "frame",
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct timeline *timeline_open(void) {
+    struct timeline *const timeline = calloc(1, sizeof(*timeline));
+    if (timeline != NULL) {
+        timeline->origin_ns = now_ns();
+    }
+    return timeline;
+}
+
+void timeline_begin(struct timeline *const timeline,
+                    enum timeline_event const event, uint32_t const arg) {
+    timeline->open_since[event] = now_ns();
+    timeline->open_arg[event] = arg;
+    timeline->is_open[event] = 1;
+}
+
+void timeline_end(struct timeline *const timeline,
+                  enum timeline_event const event) {
+    if (!timeline->is_open[event]) {
+        return;
+    }
+    uint64_t const end = now_ns();
+    timeline->is_open[event] = 0;
+
+    if (timeline->num_records == timeline->capacity) {
+        size_t const new_capacity =
+            timeline->capacity == 0 ? 4096 : 2 * timeline->capacity;
+        struct timeline_record *const new_records = realloc(
+            timeline->records, new_capacity * sizeof(*timeline->records));
+        if (new_records == NULL) {
+            return; // Drop the event rather than disturb the emulator.
+        }
+        timeline->records = new_records;
+        timeline->capacity = new_capacity;
+    }
+    timeline->records[timeline->num_records++] = (struct timeline_record){
+        .start_ns = timeline->open_since[event] - timeline->origin_ns,
+        .duration_ns = end - timeline->open_since[event],
+        .arg = timeline->open_arg[event],
+        .event = event,
+    };
+}
+
+int timeline_write(struct timeline const *const timeline,
+                   char const *const path) {
+    FILE *const f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+
+    // Each kind of event gets its own row (tid) in the viewer, so that events
+    // which overlap without nesting, like frames and scanlines, display sanely.
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+               "\"args\":{\"name\":\"gb\"}}");
+    for (size_t i = 0; i < NUM_TIMELINE_EVENTS; i++) {
+        fprintf(f,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                i + 1, EVENT_NAMES[i]);
+    }
+    for (size_t i = 0; i < timeline->num_records; i++) {
+        struct timeline_record const *const r = &timeline->records[i];
+        // Timestamps are in microseconds.
+        fprintf(f,
+                ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64
+                ".%03" PRIu64 ",\"args\":{\"%s\":%" PRIu32 "}}",
+                EVENT_NAMES[r->event], (int)r->event + 1, r->start_ns / 1000,
+                r->start_ns % 1000, r->duration_ns / 1000,
+                r->duration_ns % 1000, ARG_NAMES[r->event], r->arg);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+void timeline_close(struct timeline *const timeline) {
+    if (timeline == NULL) {
+        return;
+    }
+    free(timeline->records);
+    free(timeline);
+}
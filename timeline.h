@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h> // for uint32_t
+
+// A timeline of host-side phases (frames, scanlines, vblank rendering,
+// frontend work), written out as Chrome trace-event JSON for a timeline
+// viewer such as chrome://tracing or Perfetto.
+
+enum timeline_event {
+    TL_FRAME = 0,          // Emulating one frame, vblank to vblank
+    TL_SCANLINE = 1,       // Emulating one scanline
+    TL_VBLANK_RENDER = 2,  // Drawing the frame at the start of vblank
+    TL_TEXTURE_UPLOAD = 3, // Frontend: copying the screen into the texture
+    TL_PRESENT = 4,        // Frontend: presenting the texture
+    NUM_TIMELINE_EVENTS = 5,
+};
+
+struct timeline *timeline_open(void);
+
+// Starts an event. arg is shown in the viewer (e.g., frame number or LY).
+// Starting an event that's already open restarts it.
+void timeline_begin(struct timeline *timeline, enum timeline_event event,
+                    uint32_t arg);
+
+// Ends an event. Ending an event that isn't open does nothing.
+void timeline_end(struct timeline *timeline, enum timeline_event event);
+
+// Returns 0 on success, -1 on failure.
+int timeline_write(struct timeline const *timeline, char const *path);
+
+void timeline_close(struct timeline *timeline);
@@ -0,0 +1,316 @@
+#include <pthread.h> // for pthread_*
+#include <stddef.h>  // for NULL, size_t
+#include <stdint.h>  // for uint*_t
+#include <stdio.h>   // for FILE, fopen, fwrite, fclose
+#include <stdlib.h>  // for calloc, free
+#include <string.h>  // for memcpy
+
+#include "trace.h"
+
+// Layout of one record:
+//   u8  mask (see below)
+//   u8  cycles since the previous record, or u64 absolute cycle count
+//   u16 pc
+//   u8  bank
+//   u8  pcmem[4]
+//   u16 for each register whose bit is set in mask, in AF, BC, DE, HL, SP order
+enum record_mask {
+    REC_AF = 0b00000001,
+    REC_BC = 0b00000010,
+    REC_DE = 0b00000100,
+    REC_HL = 0b00001000,
+    REC_SP = 0b00010000,
+    REC_ALL_REGS = 0b00011111,
+    REC_ABSOLUTE_CYCLE = 0b00100000,
+    REC_IME = 0b01000000,
+};
+
+#define MAX_RECORD_SIZE (1 + 8 + 2 + 1 + 4 + 5 * 2)
+
+struct trace {
+    uint8_t *data; // num_chunks chunks of TRACE_CHUNK_SIZE bytes
+    uint32_t *sizes;
+    uint64_t *sequences;
+    uint1_t *pending; // Chunks that are full and waiting for the writer
+    size_t num_chunks;
+    size_t current;
+    size_t fill;
+    uint64_t sequence;
+    struct trace_entry prev;
+    uint1_t need_full_record;
+
+    // Only used when streaming to a file
+    FILE *out;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next_to_write;
+    uint1_t closing;
+};
+
+static uint8_t *put16(uint8_t *p, uint16_t const val) {
+    p[0] = val;
+    p[1] = val >> 8;
+    return p + 2;
+}
+
+static uint8_t const *get16(uint8_t const *p, uint16_t *const val) {
+    *val = p[0] | (p[1] << 8);
+    return p + 2;
+}
+
+static void write_chunk(FILE *const f, uint8_t const *const data,
+                        uint32_t const size, uint64_t const sequence) {
+    struct trace_chunk_header header = {.size = size, .sequence = sequence};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(data, 1, size, f);
+}
+
+static void *writer_main(void *const arg) {
+    struct trace *const trace = arg;
+
+    pthread_mutex_lock(&trace->lock);
+    while (1) {
+        size_t const i = trace->next_to_write;
+        while (!trace->pending[i] && !trace->closing) {
+            pthread_cond_wait(&trace->cond, &trace->lock);
+        }
+        if (!trace->pending[i]) { // Closing, and everything is written
+            break;
+        }
+        pthread_mutex_unlock(&trace->lock);
+
+        // The producer never touches a pending chunk, so no lock is needed
+        write_chunk(trace->out, trace->data + i * TRACE_CHUNK_SIZE,
+                    trace->sizes[i], trace->sequences[i]);
+
+        pthread_mutex_lock(&trace->lock);
+        trace->pending[i] = 0;
+        trace->next_to_write = (i + 1) % trace->num_chunks;
+        pthread_cond_broadcast(&trace->cond);
+    }
+    pthread_mutex_unlock(&trace->lock);
+    return NULL;
+}
+
+struct trace *trace_open(char const *const path, size_t const num_chunks) {
+    struct trace *const trace = calloc(1, sizeof(*trace));
+    if (trace == NULL || num_chunks == 0) {
+        free(trace);
+        return NULL;
+    }
+    trace->num_chunks = num_chunks;
+    trace->data = calloc(num_chunks, TRACE_CHUNK_SIZE);
+    trace->sizes = calloc(num_chunks, sizeof(*trace->sizes));
+    trace->sequences = calloc(num_chunks, sizeof(*trace->sequences));
+    trace->pending = calloc(num_chunks, sizeof(*trace->pending));
+    trace->need_full_record = 1;
+    if (trace->data == NULL || trace->sizes == NULL ||
+        trace->sequences == NULL || trace->pending == NULL) {
+        goto fail;
+    }
+
+    if (path != NULL) {
+        trace->out = fopen(path, "wb");
+        if (trace->out == NULL) {
+            goto fail;
+        }
+        pthread_mutex_init(&trace->lock, NULL);
+        pthread_cond_init(&trace->cond, NULL);
+        if (pthread_create(&trace->writer, NULL, writer_main, trace) != 0) {
+            fclose(trace->out);
+            goto fail;
+        }
+    }
+    return trace;
+
+fail:
+    free(trace->data);
+    free(trace->sizes);
+    free(trace->sequences);
+    free(trace->pending);
+    free(trace);
+    return NULL;
+}
+
+static void next_chunk(struct trace *const trace) {
+    size_t const next = (trace->current + 1) % trace->num_chunks;
+
+    trace->sizes[trace->current] = trace->fill;
+    if (trace->out != NULL) {
+        pthread_mutex_lock(&trace->lock);
+        trace->pending[trace->current] = 1;
+        pthread_cond_broadcast(&trace->cond);
+        while (trace->pending[next]) { // The writer has fallen a ring behind
+            pthread_cond_wait(&trace->cond, &trace->lock);
+        }
+        pthread_mutex_unlock(&trace->lock);
+    }
+
+    trace->current = next;
+    trace->fill = 0;
+    trace->sizes[next] = 0;
+    trace->sequences[next] = ++trace->sequence;
+    trace->need_full_record = 1;
+}
+
+static uint8_t bank_of(uint16_t const pc) {
+    // There's no MBC support, so the only banks are the two fixed ones.
+    return pc < 0x4000 ? 0 : 1;
+}
+
+void trace_record(struct trace *const trace, struct gb const *const gb,
+                  uint32_t const pcmem) {
+    if (trace->fill + MAX_RECORD_SIZE > TRACE_CHUNK_SIZE) {
+        next_chunk(trace);
+    }
+
+    struct trace_entry *const prev = &trace->prev;
+    uint8_t *const start =
+        trace->data + trace->current * TRACE_CHUNK_SIZE + trace->fill;
+    uint8_t *p = start + 1;
+
+    uint8_t mask = gb->ime ? REC_IME : 0;
+    if (trace->need_full_record) {
+        mask |= REC_ALL_REGS;
+        trace->need_full_record = 0;
+    } else {
+        mask |= (gb->af != prev->af ? REC_AF : 0) |
+                (gb->bc != prev->bc ? REC_BC : 0) |
+                (gb->de != prev->de ? REC_DE : 0) |
+                (gb->hl != prev->hl ? REC_HL : 0) |
+                (gb->sp != prev->sp ? REC_SP : 0);
+    }
+
+    uint64_t const cycle_delta = gb->cycle_count - prev->cycle;
+    if ((mask & REC_ALL_REGS) == REC_ALL_REGS || cycle_delta > UINT8_MAX) {
+        mask |= REC_ABSOLUTE_CYCLE;
+        for (int i = 0; i < 8; i++) {
+            *p++ = gb->cycle_count >> (8 * i);
+        }
+    } else {
+        *p++ = cycle_delta;
+    }
+
+    p = put16(p, gb->pc);
+    *p++ = bank_of(gb->pc);
+    for (int i = 0; i < 4; i++) {
+        *p++ = pcmem >> (8 * i);
+    }
+    if (mask & REC_AF) {
+        p = put16(p, gb->af);
+    }
+    if (mask & REC_BC) {
+        p = put16(p, gb->bc);
+    }
+    if (mask & REC_DE) {
+        p = put16(p, gb->de);
+    }
+    if (mask & REC_HL) {
+        p = put16(p, gb->hl);
+    }
+    if (mask & REC_SP) {
+        p = put16(p, gb->sp);
+    }
+    *start = mask;
+    trace->fill = p - (trace->data + trace->current * TRACE_CHUNK_SIZE);
+
+    prev->cycle = gb->cycle_count;
+    prev->af = gb->af;
+    prev->bc = gb->bc;
+    prev->de = gb->de;
+    prev->hl = gb->hl;
+    prev->sp = gb->sp;
+}
+
+int trace_save(struct trace *const trace, char const *const path) {
+    FILE *const f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    trace->sizes[trace->current] = trace->fill;
+    // The chunk after the current one is the oldest, if the ring has wrapped.
+    for (size_t i = 1; i <= trace->num_chunks; i++) {
+        size_t const idx = (trace->current + i) % trace->num_chunks;
+        if (trace->sizes[idx] > 0) {
+            write_chunk(f, trace->data + idx * TRACE_CHUNK_SIZE,
+                        trace->sizes[idx], trace->sequences[idx]);
+        }
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+void trace_close(struct trace *const trace) {
+    if (trace == NULL) {
+        return;
+    }
+    if (trace->out != NULL) {
+        pthread_mutex_lock(&trace->lock);
+        if (trace->fill > 0) {
+            trace->sizes[trace->current] = trace->fill;
+            trace->pending[trace->current] = 1;
+        }
+        trace->closing = 1;
+        pthread_cond_broadcast(&trace->cond);
+        pthread_mutex_unlock(&trace->lock);
+
+        pthread_join(trace->writer, NULL);
+        pthread_cond_destroy(&trace->cond);
+        pthread_mutex_destroy(&trace->lock);
+        fclose(trace->out);
+    }
+    free(trace->data);
+    free(trace->sizes);
+    free(trace->sequences);
+    free(trace->pending);
+    free(trace);
+}
+
+int trace_decode(uint8_t const *const data, size_t const size,
+                 void (*const emit)(struct trace_entry const *entry, void *arg),
+                 void *const arg) {
+    struct trace_entry entry = {0};
+    uint8_t const *p = data;
+    uint8_t const *const end = data + size;
+
+    while (p < end) {
+        uint8_t const mask = *p++;
+        size_t const cycle_size = (mask & REC_ABSOLUTE_CYCLE) ? 8 : 1;
+        size_t const num_regs = __builtin_popcount(mask & REC_ALL_REGS);
+        if ((size_t)(end - p) < cycle_size + 2 + 1 + 4 + 2 * num_regs) {
+            return -1;
+        }
+
+        if (mask & REC_ABSOLUTE_CYCLE) {
+            entry.cycle = 0;
+            for (int i = 0; i < 8; i++) {
+                entry.cycle |= (uint64_t)*p++ << (8 * i);
+            }
+        } else {
+            entry.cycle += *p++;
+        }
+        p = get16(p, &entry.pc);
+        entry.bank = *p++;
+        memcpy(entry.pcmem, p, sizeof(entry.pcmem));
+        p += sizeof(entry.pcmem);
+        if (mask & REC_AF) {
+            p = get16(p, &entry.af);
+        }
+        if (mask & REC_BC) {
+            p = get16(p, &entry.bc);
+        }
+        if (mask & REC_DE) {
+            p = get16(p, &entry.de);
+        }
+        if (mask & REC_HL) {
+            p = get16(p, &entry.hl);
+        }
+        if (mask & REC_SP) {
+            p = get16(p, &entry.sp);
+        }
+        entry.ime = (mask & REC_IME) != 0;
+        emit(&entry, arg);
+    }
+    return 0;
+}
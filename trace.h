@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint32_t, uint64_t
+
+#include "gb.h"
+
+// A binary execution trace. Each instruction step() executes becomes one
+// variable-length record holding the PC, ROM bank, the 4 bytes at PC, the
+// cycle stamp, and whichever registers changed since the previous record.
+// Records are packed into fixed-size chunks; the first record of every chunk
+// stores all registers, so any chunk can be decoded on its own.
+//
+// The trace either lives purely in memory (a ring of chunks, oldest
+// overwritten first), or is streamed to a file by a background writer thread.
+
+#define TRACE_CHUNK_SIZE (1 << 16) // Bytes of record data per chunk
+#define TRACE_DEFAULT_CHUNKS (64)
+
+#define TRACE_MAGIC ("GBTR")
+
+struct trace_chunk_header {
+    char magic[4];
+    uint32_t size;     // Bytes of record data following this header
+    uint64_t sequence; // Chunk number, so a wrapped ring can be put in order
+};
+
+// The fully decoded state at one traced instruction.
+struct trace_entry {
+    uint64_t cycle;
+    uint16_t af;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    uint16_t sp;
+    uint16_t pc;
+    uint8_t bank;
+    uint8_t ime;
+    uint8_t pcmem[4];
+};
+
+// Opens a trace. If path is NULL, the trace is only kept in memory, in a ring
+// of num_chunks chunks. Otherwise, chunks are written to path as they fill.
+struct trace *trace_open(char const *path, size_t num_chunks);
+
+// Appends a record for the instruction about to execute. pcmem holds the 4
+// bytes at PC, first byte lowest.
+void trace_record(struct trace *trace, struct gb const *gb, uint32_t pcmem);
+
+// Writes the contents of an in-memory trace to path, oldest chunk first.
+int trace_save(struct trace *trace, char const *path);
+
+// Flushes any buffered records, stops the writer thread, and frees the trace.
+void trace_close(struct trace *trace);
+
+// Decodes one chunk's worth of record data, calling emit on each entry.
+// Returns 0 on success, or -1 if the data is truncated.
+int trace_decode(uint8_t const *data, size_t size,
+                 void (*emit)(struct trace_entry const *entry, void *arg),
+                 void *arg);
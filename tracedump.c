@@ -0,0 +1,76 @@
+#define _GNU_SOURCE   // for getopt(3)
+#include <inttypes.h> // for PRI*
+#include <stdint.h>   // for uint8_t
+#include <stdio.h>    // for printf, fprintf, stderr, fopen, fread, fclose
+#include <stdlib.h>   // for EXIT_FAILURE, EXIT_SUCCESS
+#include <string.h>   // for memcmp
+#include <unistd.h>   // for getopt
+
+#include "disasm.h"
+#include "trace.h"
+
+// Renders one entry exactly the way dump() would have printed it.
+static void print_dump(struct trace_entry const *const e, void *const arg) {
+    (void)arg;
+    printf("A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X "
+           "PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
+           e->af >> 8, e->af & 0xffu, e->bc >> 8, e->bc & 0xffu, e->de >> 8,
+           e->de & 0xffu, e->hl >> 8, e->hl & 0xffu, e->sp, e->pc,
+           e->pcmem[0], e->pcmem[1], e->pcmem[2], e->pcmem[3]);
+}
+
+// Renders one entry the way step() prints its disassembly, plus the cycle.
+static void print_disassembly(struct trace_entry const *const e,
+                              void *const arg) {
+    (void)arg;
+    char mnemonic[32];
+    disassemble(e->pcmem, mnemonic, sizeof(mnemonic));
+    printf("%12" PRIu64 " %02" PRIX8 ":[0x%04" PRIX16 "]: 0x%02" PRIX8 "\t%s\n",
+           e->cycle, e->bank, e->pc, e->pcmem[0], mnemonic);
+}
+
+int main(int argc, char *const *const argv) {
+    void (*emit)(struct trace_entry const *, void *) = print_dump;
+    int opt;
+    while ((opt = getopt(argc, argv, "d")) != -1) {
+        switch (opt) {
+        case 'd':
+            emit = print_disassembly;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d] <trace_file>\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "Usage: %s [-d] <trace_file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *const f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Couldn't open trace from %s!\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    static uint8_t data[TRACE_CHUNK_SIZE];
+    struct trace_chunk_header header;
+    int status = EXIT_SUCCESS;
+    while (fread(&header, sizeof(header), 1, f) == 1) {
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.size > TRACE_CHUNK_SIZE) {
+            fprintf(stderr, "Bad chunk header in %s!\n", argv[optind]);
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (fread(data, 1, header.size, f) != header.size ||
+            trace_decode(data, header.size, emit, NULL) != 0) {
+            fprintf(stderr, "Truncated chunk %" PRIu64 " in %s!\n",
+                    header.sequence, argv[optind]);
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+    fclose(f);
+    return status;
+}
@@ -0,0 +1,151 @@
+#define _GNU_SOURCE   // for clock_gettime(2), getopt(3)
+#include <inttypes.h> // for PRI*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint8_t, uint64_t
+#include <stdio.h>    // for printf, fprintf, fopen, fread, fclose
+#include <stdlib.h>   // for EXIT_FAILURE, EXIT_SUCCESS, malloc, free, strtoull
+#include <string.h>   // for strcmp
+#include <time.h>     // for clock_gettime
+#include <unistd.h>   // for getopt
+
+#include "gb.h"
+#include "gb_vec.h"
+
+// Steps a vectorised environment with random buttons and reports throughput,
+// to check that a step's cost is emulation rather than coordination.
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(char const *const argv0) {
+    fprintf(stderr,
+            "Usage: %s [-N envs] [-t threads] [-k frames_per_step] "
+            "[-s steps] [-r ram_start:ram_size] [-o frame|half|square|packed] "
+            "[-b] [-m] <rom_file>\n",
+            argv0);
+}
+
+static uint1_t parse_observation(char const *const name,
+                                enum gb_vec_observation *const out) {
+    static struct {
+        char const *name;
+        enum gb_vec_observation observation;
+    } const OBSERVATIONS[] = {
+        {"frame", GB_VEC_FRAME},
+        {"half", GB_VEC_FRAME_HALF},
+        {"square", GB_VEC_FRAME_SQUARE},
+        {"packed", GB_VEC_FRAME_PACKED},
+    };
+    for (size_t i = 0; i < sizeof(OBSERVATIONS) / sizeof(OBSERVATIONS[0]);
+         i++) {
+        if (strcmp(OBSERVATIONS[i].name, name) == 0) {
+            *out = OBSERVATIONS[i].observation;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *const *const argv) {
+    struct gb_vec_config config = {
+        .num_envs = 256,
+        .frames_per_step = 4,
+        .observation = GB_VEC_FRAME,
+    };
+    uint64_t num_steps = 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "N:t:k:s:r:o:bm")) != -1) {
+        switch (opt) {
+        case 'N':
+            config.num_envs = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            config.num_threads = strtoull(optarg, NULL, 0);
+            break;
+        case 'k':
+            config.frames_per_step = strtoull(optarg, NULL, 0);
+            break;
+        case 's':
+            num_steps = strtoull(optarg, NULL, 0);
+            break;
+        case 'r': {
+            char *end;
+            config.observation = GB_VEC_RAM;
+            config.ram_start = strtoul(optarg, &end, 0);
+            config.ram_size = *end == ':' ? strtoull(end + 1, NULL, 0) : 0;
+            break;
+        }
+        case 'o':
+            if (!parse_observation(optarg, &config.observation)) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            config.batched = 1;
+            break;
+        case 'm':
+            config.max_pool = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc || config.frames_per_step == 0 || num_steps == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *const f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Couldn't open %s!\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    static uint8_t rom[ADDRESS_SPACE_SIZE];
+    size_t const rom_size = fread(rom, 1, sizeof(rom), f);
+    fclose(f);
+
+    struct gb_vec *const vec = gb_vec_open(rom, rom_size, &config);
+    if (vec == NULL) {
+        fprintf(stderr, "Couldn't create the environment!\n");
+        return EXIT_FAILURE;
+    }
+    size_t const num_envs = gb_vec_num_envs(vec);
+    uint8_t *const buttons = malloc(num_envs);
+    uint8_t *const observations =
+        malloc(num_envs * gb_vec_observation_size(vec));
+    if (buttons == NULL || observations == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+    gb_vec_reset(vec, observations);
+
+    uint64_t rng = 0x9E3779B97F4A7C15;
+    uint64_t const start = now_ns();
+    for (uint64_t s = 0; s < num_steps; s++) {
+        for (size_t i = 0; i < num_envs; i++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            buttons[i] = rng;
+        }
+        gb_vec_step(vec, buttons, observations);
+    }
+    uint64_t const wall_ns = now_ns() - start;
+
+    double const seconds = wall_ns / 1e9;
+    double const env_steps = (double)num_steps * num_envs;
+    printf("%zu envs, %" PRIu64 " steps of %" PRIu64 " frames\n", num_envs,
+           num_steps, config.frames_per_step);
+    printf("%.0f env steps/s, %.0f frames/s, %.1f us per batch step\n",
+           env_steps / seconds, env_steps * config.frames_per_step / seconds,
+           wall_ns / 1e3 / num_steps);
+    free(buttons);
+    free(observations);
+    gb_vec_close(vec);
+    return EXIT_SUCCESS;
+}
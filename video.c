@@ -0,0 +1,280 @@
+#include <inttypes.h> // for PRIu64
+#include <pthread.h>  // for pthread_*
+#include <stddef.h>   // for NULL, size_t
+#include <stdint.h>   // for uint8_t, uint64_t
+#include <stdio.h>    // for FILE, fopen, fwrite, fclose, snprintf, stdout
+#include <stdlib.h>   // for calloc, malloc, free
+#include <string.h>   // for memcmp, memcpy, memset, strcmp, strlen
+
+#include "png.h"
+#include "video.h"
+
+// Gray level of each color number, as the SDL frontend draws them
+static uint8_t const SHADES[4] = {0xFF, 0xAA, 0x55, 0x00};
+
+// 160x144 at the Game Boy's 4194304 / 70224 Hz refresh rate
+static char const Y4M_HEADER[] = "YUV4MPEG2 W160 H144 F4194304:70224 Ip A1:1 "
+                                 "C420jpeg XCOLORRANGE=LIMITED\n";
+
+struct video_frame {
+    uint64_t number;
+    uint8_t pixels[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+};
+
+struct video {
+    enum video_format format;
+    uint1_t dedup;
+    char *prefix; // PNG formats only
+    FILE *out;    // Stream formats only
+
+    struct video_frame *slots;
+    uint1_t *pending; // Slots that are full and waiting for the encoder
+    size_t num_slots;
+    size_t next_to_fill;
+    struct video_stats stats;
+
+    pthread_t encoder;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next_to_encode;
+    uint1_t closing;
+
+    // Only touched by the encoder thread
+    uint8_t previous[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    uint1_t have_previous;
+    uint64_t duplicates;
+    uint64_t written;
+    uint1_t failed;
+};
+
+static int write_png(char const *const path,
+                     uint8_t const pixels[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH],
+                     enum png_compression const compression) {
+    uint8_t png[PNG_MAX_SIZE];
+    size_t const size = png_encode(pixels, SHADES, compression, png);
+    FILE *const f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    uint1_t const ok = fwrite(png, 1, size, f) == size;
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+static int write_rgb(FILE *const f,
+                     uint8_t const pixels[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]) {
+    uint8_t rgb[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH][3];
+    for (size_t y = 0; y < GB_SCREEN_HEIGHT; y++) {
+        for (size_t x = 0; x < GB_SCREEN_WIDTH; x++) {
+            memset(rgb[y][x], SHADES[pixels[y][x] & 3], 3);
+        }
+    }
+    return fwrite(rgb, sizeof(rgb), 1, f) == 1 ? 0 : -1;
+}
+
+static int write_y4m(FILE *const f,
+                     uint8_t const pixels[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH]) {
+    // Limited-range luma, with both chroma planes at their neutral value
+    static uint8_t const LUMA[4] = {
+        16 + 0xFF * 219 / 255,
+        16 + 0xAA * 219 / 255,
+        16 + 0x55 * 219 / 255,
+        16,
+    };
+    uint8_t y_plane[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    uint8_t uv_planes[2][GB_SCREEN_HEIGHT / 2][GB_SCREEN_WIDTH / 2];
+    for (size_t y = 0; y < GB_SCREEN_HEIGHT; y++) {
+        for (size_t x = 0; x < GB_SCREEN_WIDTH; x++) {
+            y_plane[y][x] = LUMA[pixels[y][x] & 3];
+        }
+    }
+    memset(uv_planes, 128, sizeof(uv_planes));
+    return fputs("FRAME\n", f) >= 0 &&
+                   fwrite(y_plane, sizeof(y_plane), 1, f) == 1 &&
+                   fwrite(uv_planes, sizeof(uv_planes), 1, f) == 1
+               ? 0
+               : -1;
+}
+
+static int write_frame(struct video const *const video,
+                       struct video_frame const *const frame) {
+    switch (video->format) {
+    case VIDEO_PNG:
+    case VIDEO_PNG_STORED: {
+        size_t const size = strlen(video->prefix) + 32;
+        char *const path = malloc(size);
+        if (path == NULL) {
+            return -1;
+        }
+        snprintf(path, size, "%s%06" PRIu64 ".png", video->prefix,
+                 frame->number);
+        int const result =
+            write_png(path, frame->pixels,
+                      video->format == VIDEO_PNG ? PNG_FAST : PNG_STORED);
+        free(path);
+        return result;
+    }
+    case VIDEO_RGB:
+        return write_rgb(video->out, frame->pixels);
+    case VIDEO_Y4M:
+        return write_y4m(video->out, frame->pixels);
+    default:
+        return -1;
+    }
+}
+
+static void encode(struct video *const video,
+                   struct video_frame const *const frame) {
+    uint1_t const duplicate =
+        video->have_previous &&
+        memcmp(frame->pixels, video->previous, sizeof(video->previous)) == 0;
+    memcpy(video->previous, frame->pixels, sizeof(video->previous));
+    video->have_previous = 1;
+    if (duplicate) {
+        video->duplicates++;
+        if (video->dedup) {
+            return;
+        }
+    }
+    if (!video->failed && write_frame(video, frame) != 0) {
+        video->failed = 1;
+    }
+    video->written += !video->failed;
+}
+
+static void *encoder_main(void *const arg) {
+    struct video *const video = arg;
+
+    pthread_mutex_lock(&video->lock);
+    while (1) {
+        size_t const i = video->next_to_encode;
+        while (!video->pending[i] && !video->closing) {
+            pthread_cond_wait(&video->cond, &video->lock);
+        }
+        if (!video->pending[i]) { // Closing, and everything is written
+            break;
+        }
+        pthread_mutex_unlock(&video->lock);
+
+        // The producer never touches a pending slot, so no lock is needed
+        encode(video, &video->slots[i]);
+
+        pthread_mutex_lock(&video->lock);
+        video->pending[i] = 0;
+        video->next_to_encode = (i + 1) % video->num_slots;
+        pthread_cond_broadcast(&video->cond);
+    }
+    pthread_mutex_unlock(&video->lock);
+    return NULL;
+}
+
+struct video *video_open(char const *const path,
+                         enum video_format const format, uint1_t const dedup) {
+    struct video *const video = calloc(1, sizeof(*video));
+    if (video == NULL) {
+        return NULL;
+    }
+    video->format = format;
+    video->dedup = dedup;
+    video->num_slots = VIDEO_DEFAULT_SLOTS;
+    video->slots = calloc(video->num_slots, sizeof(*video->slots));
+    video->pending = calloc(video->num_slots, sizeof(*video->pending));
+    if (video->slots == NULL || video->pending == NULL) {
+        goto fail;
+    }
+
+    switch (format) {
+    case VIDEO_PNG:
+    case VIDEO_PNG_STORED:
+        video->prefix = malloc(strlen(path) + 1);
+        if (video->prefix == NULL) {
+            goto fail;
+        }
+        memcpy(video->prefix, path, strlen(path) + 1);
+        break;
+    case VIDEO_RGB:
+    case VIDEO_Y4M:
+        video->out = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+        if (video->out == NULL) {
+            goto fail;
+        }
+        if (format == VIDEO_Y4M && fputs(Y4M_HEADER, video->out) < 0) {
+            goto fail;
+        }
+        break;
+    default:
+        goto fail;
+    }
+
+    pthread_mutex_init(&video->lock, NULL);
+    pthread_cond_init(&video->cond, NULL);
+    if (pthread_create(&video->encoder, NULL, encoder_main, video) != 0) {
+        pthread_cond_destroy(&video->cond);
+        pthread_mutex_destroy(&video->lock);
+        goto fail;
+    }
+    return video;
+
+fail:
+    if (video->out != NULL && video->out != stdout) {
+        fclose(video->out);
+    }
+    free(video->prefix);
+    free(video->slots);
+    free(video->pending);
+    free(video);
+    return NULL;
+}
+
+void video_push(struct video *const video, struct gb *const gb) {
+    size_t const i = video->next_to_fill;
+
+    pthread_mutex_lock(&video->lock);
+    while (video->pending[i]) { // The encoder has fallen a ring behind
+        pthread_cond_wait(&video->cond, &video->lock);
+    }
+    pthread_mutex_unlock(&video->lock);
+
+    video->slots[i].number = gb->frame_count;
+    get_frame(gb, video->slots[i].pixels);
+    video->stats.frames++;
+
+    pthread_mutex_lock(&video->lock);
+    video->pending[i] = 1;
+    pthread_cond_broadcast(&video->cond);
+    pthread_mutex_unlock(&video->lock);
+    video->next_to_fill = (i + 1) % video->num_slots;
+}
+
+int video_close(struct video *const video, struct video_stats *const stats) {
+    pthread_mutex_lock(&video->lock);
+    video->closing = 1;
+    pthread_cond_broadcast(&video->cond);
+    pthread_mutex_unlock(&video->lock);
+
+    pthread_join(video->encoder, NULL);
+    pthread_cond_destroy(&video->cond);
+    pthread_mutex_destroy(&video->lock);
+
+    uint1_t failed = video->failed;
+    if (video->out == stdout) {
+        failed |= fflush(stdout) != 0;
+    } else if (video->out != NULL) {
+        failed |= fclose(video->out) != 0;
+    }
+    if (stats != NULL) {
+        *stats = video->stats;
+        stats->duplicates = video->duplicates;
+        stats->written = video->written;
+    }
+    free(video->prefix);
+    free(video->slots);
+    free(video->pending);
+    free(video);
+    return failed ? -1 : 0;
+}
+
+int write_screenshot(struct gb *const gb, char const *const path) {
+    uint8_t pixels[GB_SCREEN_HEIGHT][GB_SCREEN_WIDTH];
+    get_frame(gb, pixels);
+    return write_png(path, pixels, PNG_FAST);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h> // for uint64_t
+
+#include "gb.h"
+
+// Writes the frames of a run as PNG files or as a raw video stream. Frames are
+// copied into a ring of slots and encoded and written by a background thread,
+// so the emulator only waits if it gets a whole ring ahead of the encoder.
+
+enum video_format {
+    VIDEO_PNG = 0,        // One PNG file per frame
+    VIDEO_PNG_STORED = 1, // The same, with uncompressed deflate blocks
+    VIDEO_RGB = 2,        // Raw 160x144 RGB24 frames, back to back
+    VIDEO_Y4M = 3,        // YUV4MPEG2 (4:2:0), readable by ffmpeg and mpv
+};
+
+#define VIDEO_DEFAULT_SLOTS (64)
+
+struct video_stats {
+    uint64_t frames;     // Frames pushed
+    uint64_t duplicates; // Frames identical to the frame before them
+    uint64_t written;    // Frames written out
+};
+
+// Opens a video sink. For the PNG formats, path is a prefix, and each frame
+// goes to <path><frame number>.png; otherwise, path is the stream's file, or
+// "-" for stdout. If dedup is set, frames identical to the one before them
+// are counted but not written. Returns NULL on failure.
+struct video *video_open(char const *path, enum video_format format,
+                         uint1_t dedup);
+
+// Queues the frame gb just drew, as get_frame() sees it.
+void video_push(struct video *video, struct gb *gb);
+
+// Writes the remaining frames, stops the encoder thread, and frees the sink.
+// If stats isn't NULL, it's filled in. Returns 0 if everything was written,
+// or -1 on failure.
+int video_close(struct video *video, struct video_stats *stats);
+
+// Writes the frame gb just drew to path as a PNG. Returns 0 on success, or
+// -1 on failure.
+int write_screenshot(struct gb *gb, char const *path);
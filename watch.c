@@ -0,0 +1,30 @@
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint32_t
+
+#include "gb.h"
+#include "watch.h"
+
+uint1_t watch_vars_valid(struct watch_var const *const vars,
+                         size_t const count) {
+    for (size_t i = 0; i < count; i++) {
+        if (vars[i].width == 0 || vars[i].width > 4 ||
+            vars[i].address + vars[i].width > ADDRESS_SPACE_SIZE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void watch_read(struct gb const *const gb, struct watch_var const *const vars,
+                size_t const count, uint32_t *const out) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t const *const bytes = gb->address_space + vars[i].address;
+        uint32_t value = 0;
+        for (uint8_t b = 0; b < vars[i].width; b++) {
+            uint8_t const byte =
+                vars[i].big_endian ? bytes[b] : bytes[vars[i].width - 1 - b];
+            value = value << 8 | byte;
+        }
+        out[i] = value;
+    }
+}
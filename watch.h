@@ -0,0 +1,22 @@
+#pragma once
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint16_t, uint32_t
+
+#include "gb.h"
+
+// Game variables (score, lives, position...) read straight out of memory, for
+// reward functions and the like.
+
+struct watch_var {
+    uint16_t address;
+    uint8_t width;      // In bytes, 1 to 4
+    uint1_t big_endian; // Most significant byte first; most games use little
+};
+
+// Returns 1 iff every variable has a valid width and fits below 0x10000.
+uint1_t watch_vars_valid(struct watch_var const *vars, size_t count);
+
+// Writes the current value of each of vars into out, one per variable. Memory
+// is read directly, without bus side effects.
+void watch_read(struct gb const *gb, struct watch_var const *vars,
+                size_t count, uint32_t *out);